@@ -2,16 +2,24 @@
 #include "common.h"
 
 #include "ast/type.h"
+#include "utils/arena.h"
 #include "utils/error.h"
+#include "utils/symbol.h"
 
 namespace dp {
 namespace internal {
 
+// File names are interned like any other symbol, so a location is four
+// 32-bit fields.
 struct Location {
-	std::string  fileName;
-	unsigned int line;
-	unsigned int firstColumn;
-	unsigned int lastColumn;
+	Symbol   file;
+	uint32_t line        = 0;
+	uint32_t firstColumn = 0;
+	uint32_t lastColumn  = 0;
+
+	const std::string& fileName() const {
+		return file.str();
+	}
 };
 
 class ASTNode {
@@ -19,44 +27,53 @@ public:
 	ASTNode(const Location& loc = Location())
 			: loc(loc) {
 	}
-	~ASTNode() {
-	}
 	std::string toString() const;
-	Location loc;
+	Location    loc;
 };
 
 class Identifier {
 public:
-	std::string name;
+	Symbol name;
 
-	Identifier(const std::string& name)
+	Identifier(Symbol name)
 			: name(name) {
 	}
-	~Identifier() {
+	Identifier(const char* name)
+			: name(Symbol::intern(name)) {
+	}
+
+	const std::string& str() const {
+		return name.str();
 	}
+
 	std::string toString() const {
 		return "Identifier";
 	}
 };
 
+// Every node below is allocated in its Module's arena and refers to its
+// children with plain pointers; none of them owns anything that needs a
+// destructor.
+
 class Statement;
-typedef std::unique_ptr<Statement> StatementPtr;
-typedef std::vector<StatementPtr>  StatementVector;
+typedef ArenaArray<Statement*> StatementVector;
 
 // Module
 
 class Module : public ASTNode {
 public:
-	Module(std::string name, const Location& loc = Location())
-			: ASTNode(loc), id(name) {
-	}
-	~Module() {
+	Module(Identifier id, const Location& loc = Location())
+			: ASTNode(loc), id(id) {
 	}
 
+	Module(const Module&) = delete;
+	Module& operator=(const Module&) = delete;
+
 	std::string toString() const {
 		return "Module";
 	}
 
+	Arena           arena;
 	Identifier      id;
 	StatementVector stmts;
 };
@@ -65,7 +82,7 @@ typedef std::unique_ptr<Module> ModulePtr;
 
 // Statement
 
-enum class StatementKind {
+enum class StatementKind : uint8_t {
 	VariableDeclaration,
 	FunctionDeclaration,
 	Expression
@@ -73,8 +90,7 @@ enum class StatementKind {
 
 class Statement : public ASTNode {
 public:
-	Statement()          = delete;
-	virtual ~Statement() = default;
+	Statement() = delete;
 
 	StatementKind kind() const {
 		return kind_;
@@ -109,8 +125,7 @@ public:
 };
 
 class Expression;
-typedef std::unique_ptr<Expression> ExpressionPtr;
-typedef std::vector<ExpressionPtr>  ExpressionVector;
+typedef ArenaArray<Expression*> ExpressionVector;
 
 class ExpressionStatement : public StatementMixin<StatementKind::Expression> {
 public:
@@ -122,50 +137,45 @@ public:
 		return "ExpressionStatement";
 	}
 
-	ExpressionPtr expr;
+	Expression* expr = nullptr;
 };
 
 class VariableDeclaration : public StatementMixin<StatementKind::VariableDeclaration> {
 public:
-	VariableDeclaration(std::string name, const Location& loc = Location())
-			: StatementMixin<StatementKind::VariableDeclaration>(loc), id(name) {
-	}
-	~VariableDeclaration() {
+	VariableDeclaration(Identifier id, const Location& loc = Location())
+			: StatementMixin<StatementKind::VariableDeclaration>(loc), id(id) {
 	}
 
 	std::string toString() const {
 		return "VariableDeclaration";
 	}
 
-
-	Identifier                  id;
-	std::unique_ptr<Type>       vartype;
-	std::unique_ptr<Expression> init;
+	Identifier  id;
+	Type*       vartype = nullptr;
+	Expression* init    = nullptr;
 };
 
 class BlockExpession;
 
 class FunctionDeclaration : public StatementMixin<StatementKind::FunctionDeclaration> {
 public:
-	FunctionDeclaration(std::string name, const Location& loc = Location())
-			: StatementMixin<StatementKind::FunctionDeclaration>(loc), id(name), isPublic(true) {
-	}
-	~FunctionDeclaration() {
+	FunctionDeclaration(Identifier id, const Location& loc = Location())
+			: StatementMixin<StatementKind::FunctionDeclaration>(loc), id(id), isPublic(true) {
 	}
 
 	std::string toString() const {
 		return "FunctionDeclaration";
 	}
 
-	Identifier                      id;
-	std::unique_ptr<FunctionType>   signature;
-	std::unique_ptr<ExpressionStatement> body;
-	bool                            isPublic;
+	Identifier           id;
+	FunctionType*        signature = nullptr;
+	ExpressionStatement* body      = nullptr;
+	bool                 isPublic;
 };
 
 // Expression
 
-enum class ExpressionKind {
+enum class ExpressionKind : uint8_t {
 	Array,
 	Binary,
 	Block,
@@ -179,8 +189,7 @@ enum class ExpressionKind {
 
 class Expression : public ASTNode {
 public:
-	Expression()          = delete;
-	virtual ~Expression() = default;
+	Expression() = delete;
 
 	ExpressionKind kind() const {
 		return kind_;
@@ -190,6 +199,9 @@ public:
 		return "Expression";
 	}
 
+	// Resolved by the TypeChecker; null until then.
+	VariableType* type = nullptr;
+
 protected:
 	explicit Expression(ExpressionKind kind, const Location& loc = Location())
 			: ASTNode(loc), kind_(kind) {
@@ -212,16 +224,16 @@ public:
 	std::string toString() const {
 		return "ExpressionMixin";
 	}
-
 };
 
-enum class BinaryOperator {
+enum class BinaryOperator : uint8_t {
 	Plus,
 	Minus,
 	Mult,
 	Div,
 	BitwiseAnd,
 	BitwiseOr,
+	ShiftLeft, // only introduced by the ConstantFolder
 };
 
 class BinaryExpression : public ExpressionMixin<ExpressionKind::Binary> {
@@ -235,8 +247,8 @@ public:
 	}
 
 	BinaryOperator op;
-	ExpressionPtr  left;
-	ExpressionPtr  right;
+	Expression*    left  = nullptr;
+	Expression*    right = nullptr;
 };
 
 class CallExpression : public ExpressionMixin<ExpressionKind::Call> {
@@ -249,41 +261,41 @@ public:
 		return "CallExpression";
 	}
 
-	ExpressionPtr  receiver;
-	ExpressionPtr  method;
+	Expression*      receiver = nullptr;
+	Expression*      method   = nullptr;
 	ExpressionVector params;
-	
 };
 
-
 class LiteralExpression : public ExpressionMixin<ExpressionKind::Literal> {
 public:
 	LiteralExpression(int32_t value, const Location& loc = Location())
-			: ExpressionMixin<ExpressionKind::Literal>(loc), i32val(value), typ(LiteralExpression::Typ::DPI32) {
+			: ExpressionMixin<ExpressionKind::Literal>(loc), typ(LiteralExpression::Typ::DPI32), i32val(value) {
 	}
 
-	LiteralExpression(std::string value, const Location& loc = Location())
-			: ExpressionMixin<ExpressionKind::Literal>(loc), strval(value), typ(LiteralExpression::Typ::DPString) {
+	LiteralExpression(StringRef value, const Location& loc = Location())
+			: ExpressionMixin<ExpressionKind::Literal>(loc), typ(LiteralExpression::Typ::DPString), strval(value) {
 	}
 
 	LiteralExpression(int64_t value, const Location& loc = Location())
-			: ExpressionMixin<ExpressionKind::Literal>(loc), i64val(value), typ(LiteralExpression::Typ::DPI64) {
+			: ExpressionMixin<ExpressionKind::Literal>(loc), typ(LiteralExpression::Typ::DPI64), i64val(value) {
 	}
 
-	LiteralExpression(double value, const Location& loc = Location())
-			: ExpressionMixin<ExpressionKind::Literal>(loc), f64val(value), typ(LiteralExpression::Typ::DPF64) {
+	LiteralExpression(float value, const Location& loc = Location())
+			: ExpressionMixin<ExpressionKind::Literal>(loc), typ(LiteralExpression::Typ::DPF32), f32val(value) {
 	}
 
-	~LiteralExpression() {
+	LiteralExpression(double value, const Location& loc = Location())
+			: ExpressionMixin<ExpressionKind::Literal>(loc), typ(LiteralExpression::Typ::DPF64), f64val(value) {
 	}
 
 	std::string toString() const {
 		return "LiteralExpression";
 	}
 
-	enum class Typ {
+	enum class Typ : uint8_t {
 		DPI32,
 		DPI64,
+		DPF32,
 		DPF64,
 		DPDouble,
 		DPString
@@ -292,18 +304,18 @@ public:
 	Typ typ;
 
 	union {
-		int32_t     i32val;
-		int64_t     i64val;
-		float       f32val;
-		double      f64val;
-		std::string strval;
+		int32_t   i32val;
+		int64_t   i64val;
+		float     f32val;
+		double    f64val;
+		StringRef strval;
 	};
 };
 
 class PathExpression : public ExpressionMixin<ExpressionKind::Path> {
 public:
-	PathExpression(std::string name, const Location& loc = Location())
-			: ExpressionMixin<ExpressionKind::Path>(loc), id(name) {
+	PathExpression(Identifier id, const Location& loc = Location())
+			: ExpressionMixin<ExpressionKind::Path>(loc), id(id) {
 	}
 
 	std::string toString() const {
@@ -0,0 +1,29 @@
+#include "type.h"
+
+namespace dp {
+namespace internal {
+
+const char* typeName(PrimitiveVariableTypes typ) {
+	switch (typ) {
+	case PrimitiveVariableTypes::I32:
+		return "i32";
+	case PrimitiveVariableTypes::I64:
+		return "i64";
+	case PrimitiveVariableTypes::F32:
+		return "f32";
+	case PrimitiveVariableTypes::F64:
+		return "f64";
+	case PrimitiveVariableTypes::Unit:
+		return "()";
+	case PrimitiveVariableTypes::Str:
+		return "str";
+	}
+	return "?";
+}
+
+const char* VariableType::name() const {
+	return typeName(typ);
+}
+
+}
+}
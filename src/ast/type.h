@@ -1,32 +1,51 @@
 #pragma once
 
+#include "utils/arena.h"
+#include "utils/symbol.h"
+
 namespace dp {
 namespace internal {
 
+enum class TypeKind : uint8_t {
+	Variable,
+	Function,
+	Named,
+};
+
 class Type {
 public:
-	Type() {
+	TypeKind kind() const {
+		return kind_;
 	}
 
-	~Type() {
+protected:
+	explicit Type(TypeKind kind)
+		: kind_(kind) {
 	}
 
+	TypeKind kind_;
 };
 
-enum class PrimitiveVariableTypes {
+enum class PrimitiveVariableTypes : uint8_t {
 	I32,
 	I64,
+	F32,
+	F64,
 	Unit,
+	// The checker keeps strings apart from numbers; the IR builder lowers
+	// them to the i64 ir::StringPool::pack() makes.
+	Str,
 };
 
+// "i32", "i64", "f32", "f64", "()" or "str".
+const char* typeName(PrimitiveVariableTypes typ);
+
 class VariableType : public Type {
 public:
 	PrimitiveVariableTypes typ;
 
 	VariableType(PrimitiveVariableTypes typ)
-		: typ(typ) {
-	}
-	~VariableType() {
+		: Type(TypeKind::Variable), typ(typ) {
 	}
 
 	bool isI32() const {
@@ -37,19 +56,47 @@ public:
 		return typ == PrimitiveVariableTypes::I64;
 	}
 
+	bool isF32() const {
+		return typ == PrimitiveVariableTypes::F32;
+	}
+
+	bool isF64() const {
+		return typ == PrimitiveVariableTypes::F64;
+	}
+
 	bool isUnit() const {
 		return typ == PrimitiveVariableTypes::Unit;
 	}
+
+	bool isStr() const {
+		return typ == PrimitiveVariableTypes::Str;
+	}
+
+	bool isFloat() const {
+		return isF32() || isF64();
+	}
+
+	const char* name() const;
 };
 
-class FunctionType : public Type {
+// A type written by name in the source, such as `i64`, before the
+// TypeChecker resolves it.
+class NamedType : public Type {
 public:
-	std::vector<std::unique_ptr<Type>> Params;
-	std::unique_ptr<Type>              Result;
+	Symbol name;
 
-	FunctionType() {
+	NamedType(Symbol name)
+		: Type(TypeKind::Named), name(name) {
 	}
-	~FunctionType() {
+};
+
+class FunctionType : public Type {
+public:
+	ArenaArray<Type*> Params;
+	Type*             Result = nullptr;
+
+	FunctionType()
+		: Type(TypeKind::Function) {
 	}
 };
 
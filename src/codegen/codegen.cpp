@@ -1,10 +1,17 @@
 #include "codegen.h"
+#include "encoder.h"
+#include "locals.h"
 
+#include "wabt/src/binary-reader-ir.h"
 #include "wabt/src/binary-writer.h"
 #include "wabt/src/error.h"
 #include "wabt/src/ir.h"
 #include "wabt/src/validator.h"
 
+#include <algorithm>
+#include <fstream>
+#include <map>
+
 namespace dp {
 namespace internal {
 
@@ -13,194 +20,289 @@ enum class Result {
 	Error
 };
 
-class WasmVisitor {
+static wabt::Type wasmType(PrimitiveVariableTypes type) {
+	switch (type) {
+	case PrimitiveVariableTypes::I64:
+		return wabt::Type::I64;
+	case PrimitiveVariableTypes::F32:
+		return wabt::Type::F32;
+	case PrimitiveVariableTypes::F64:
+		return wabt::Type::F64;
+	default:
+		return wabt::Type::I32;
+	}
+}
+
+// Indexed by PrimitiveVariableTypes (i32, i64, f32, f64), then by the
+// binary ir::Opcodes from Add. The checker rejects bitwise operators on
+// floats and the folder only shifts integers.
+static const wabt::Opcode::Enum kBinaryOpcodes[4][7] = {
+		{ wabt::Opcode::I32Add, wabt::Opcode::I32Sub, wabt::Opcode::I32Mul, wabt::Opcode::I32DivS, wabt::Opcode::I32And, wabt::Opcode::I32Or, wabt::Opcode::I32Shl },
+		{ wabt::Opcode::I64Add, wabt::Opcode::I64Sub, wabt::Opcode::I64Mul, wabt::Opcode::I64DivS, wabt::Opcode::I64And, wabt::Opcode::I64Or, wabt::Opcode::I64Shl },
+		{ wabt::Opcode::F32Add, wabt::Opcode::F32Sub, wabt::Opcode::F32Mul, wabt::Opcode::F32Div, wabt::Opcode::Unreachable, wabt::Opcode::Unreachable, wabt::Opcode::Unreachable },
+		{ wabt::Opcode::F64Add, wabt::Opcode::F64Sub, wabt::Opcode::F64Mul, wabt::Opcode::F64Div, wabt::Opcode::Unreachable, wabt::Opcode::Unreachable, wabt::Opcode::Unreachable },
+};
+
+// The function types of a wabt module, each distinct signature appended
+// once and shared by every function that has it.
+class SignatureTable {
 public:
-	Result visitModule(Module* node) {
-		for (auto& stmt : node->stmts) {
-			visitStatement(stmt.get());
+	explicit SignatureTable(wabt::Module* module)
+			: module(module) {
+	}
+
+	// The index of the type of `sig`, appending it to the module if it is
+	// new.
+	wabt::Index intern(const wabt::FuncSignature& sig) {
+		std::vector<int32_t> key;
+		for (wabt::Type type : sig.param_types) {
+			key.push_back(static_cast<wabt::Type::Enum>(type));
 		}
-		return Result::Ok;
+		// Signatures never hold Type::Any, which is zero, so it separates
+		// params from results.
+		key.push_back(0);
+		for (wabt::Type type : sig.result_types) {
+			key.push_back(static_cast<wabt::Type::Enum>(type));
+		}
+		auto found = indices.find(key);
+		if (found != indices.end()) {
+			return found->second;
+		}
+
+		wabt::Location loc;
+		auto           type_field = std::make_unique<wabt::TypeModuleField>(loc);
+		auto           type       = std::make_unique<wabt::FuncType>();
+		type->sig                 = sig;
+		type_field->type.reset(type.release());
+		module->AppendField(std::move(type_field));
+		wabt::Index index = static_cast<wabt::Index>(module->types.size() - 1);
+		indices.emplace(std::move(key), index);
+		return index;
 	}
 
-	// Statements
+	size_t size() const {
+		return indices.size();
+	}
 
-	Result visitStatement(Statement* stmt) {
-		switch (stmt->kind()) {
-		case StatementKind::Expression:
-			visitExpressionStatement(static_cast<ExpressionStatement*>(stmt));
-			break;
-		case StatementKind::FunctionDeclaration:
-			visitFunction(static_cast<FunctionDeclaration*>(stmt));
-			break;
-		case StatementKind::VariableDeclaration:
-			visitVariableDeclaration(static_cast<VariableDeclaration*>(stmt));
-			break;
-		default:
+private:
+	wabt::Module*                               module;
+	std::map<std::vector<int32_t>, wabt::Index> indices;
+};
+
+// Emits IR functions into a wabt module, with the values that are not on
+// the operand stack in the locals LocalAllocation assigns them.
+class WasmEmitter {
+public:
+	WasmEmitter(std::ostream& errors, const CodegenOptions& options)
+			: module(std::make_unique<wabt::Module>()), signatures(module.get()), errors(errors), options(options) {
+	}
+
+	Result emitFunction(const ir::Function& function) {
+		if (!hasSimpleLayout(function)) {
+			errors << "function '" << function.name << "': control flow is not supported by the wasm backend yet"
+			       << std::endl;
 			return Result::Error;
 		}
-		return Result::Ok;
-	}
 
-	Result visitFunction(FunctionDeclaration* funNode) {
-		auto           name = funNode->id.name;
 		wabt::Location loc;
+		auto           func_field = std::make_unique<wabt::FuncModuleField>(loc, function.name);
+		func                      = &func_field->func;
+		exprs                     = &func->exprs;
+
+		// decl.sig stays empty, so every function is `() -> ()`: functionDecl
+		// takes no parameters and only `()` passes the TypeChecker as a result.
+		func->decl.has_func_type = true;
+		func->decl.type_var      = wabt::Var(signatures.intern(func->decl.sig), loc);
+
+		LocalAllocation allocation(function);
+		locals = &allocation;
+		for (PrimitiveVariableTypes type : { PrimitiveVariableTypes::I32, PrimitiveVariableTypes::I64,
+		                                     PrimitiveVariableTypes::F32, PrimitiveVariableTypes::F64 }) {
+			if (allocation.count(type)) {
+				func->local_types.AppendDecl(wasmType(type), allocation.count(type));
+			}
+		}
+		values += allocation.valueCount();
+		localCount += allocation.localCount();
 
-		auto func_field = std::make_unique<wabt::FuncModuleField>(loc, name);
-		func            = &func_field->func;
-
-		visitFunctionType(funNode->signature.get());
-		visitExpressionStatement(funNode->body.get());
-		func->exprs.swap(exprs);
+		for (auto& block : function.blocks) {
+			if (emitBlock(*block, block.get() == function.blocks.back().get()) != Result::Ok) {
+				return Result::Error;
+			}
+		}
+		locals = nullptr;
 
 		module->AppendField(std::move(func_field));
 
-		if (funNode->isPublic) {
+		if (function.isPublic) {
 			auto export_field          = std::make_unique<wabt::ExportModuleField>(loc);
 			export_field->export_.kind = wabt::ExternalKind::Func;
-			export_field->export_.name = name;
+			export_field->export_.name = function.name;
 			auto index                 = module->funcs.size() - 1;
 			export_field->export_.var  = wabt::Var(index, loc);
 			module->AppendField(std::move(export_field));
 		}
-
-		return Result::Ok;
-	}
-
-	Result visitFunctionType(FunctionType* node) {
-		wabt::Location loc;
-
-		// TODO: params type
-		//func->decl.sig.result_types.push_back(wabt::Type::I32);
-
-		auto type_field = std::make_unique<wabt::TypeModuleField>(loc);
-		auto type       = std::make_unique<wabt::FuncType>();
-
-		type->sig = func->decl.sig;
-		type_field->type.reset(type.release());
-
-		module->AppendField(std::move(type_field));
 		return Result::Ok;
 	}
 
-	Result visitVariableDeclaration(VariableDeclaration* varDecl) {
-		std::string    name  = varDecl->id.name;
-		int            index = func->local_types.size();
-		wabt::Type     type  = wabt::Type::I32;
-		wabt::Location loc;
-
-		func->bindings.emplace(name, wabt::Binding(index));
-		func->local_types.AppendDecl(type, 1);
-
-		visitExpression(varDecl->init.get());
-
-		wabt::Var var(name, loc);
-		var.set_index(index);
-		auto expr = std::make_unique<wabt::LocalSetExpr>(var);
-		exprs.push_back(std::move(expr));
-		return Result::Ok;
-	}
-
-	Result visitExpressionStatement(ExpressionStatement* exprStmt) {
-		return visitExpression(exprStmt->expr.get());
-	}
+	std::unique_ptr<wabt::Module> module;
+	SignatureTable                signatures;
+	size_t                        values     = 0; // values kept in locals
+	size_t                        localCount = 0; // locals declared for them
+	size_t                        tailCalls  = 0; // calls emitted as return_call
+
+	// The index calls use for each function, filled in before emitting.
+	std::unordered_map<Symbol, wabt::Index, SymbolHash> functionIndices;
+
+private:
+	Result emitBlock(const ir::BasicBlock& block, bool last) {
+		wabt::Location                  loc;
+		const ir::Instruction*          terminator = block.terminator();
+		wabt::ExprList*                 outer      = exprs;
+		std::unique_ptr<wabt::LoopExpr> loop;
+		if (terminator->op == ir::Opcode::Br && terminator->targets[0] == &block) {
+			loop  = std::make_unique<wabt::LoopExpr>(loc);
+			exprs = &loop->block.exprs;
+		}
 
-	// Expressions
+		for (size_t i = 0; i + 1 < block.insts.size(); i++) {
+			const ir::Instruction* inst = block.insts[i].get();
+			if (locals->onStack(inst) || isCoalescedCopy(inst)) {
+				continue;
+			}
+			if (inst->op == ir::Opcode::Call && options.tailCalls && block.insts[i + 1].get() == terminator &&
+			    terminator->op == ir::Opcode::Return) {
+				// The frame is released before the call, and the return is
+				// part of it.
+				auto found = functionIndices.find(inst->callee);
+				if (found != functionIndices.end()) {
+					exprs->push_back(std::make_unique<wabt::ReturnCallExpr>(wabt::Var(found->second, loc), loc));
+					tailCalls++;
+					return Result::Ok;
+				}
+			}
+			if (emitInstruction(inst) != Result::Ok) {
+				return Result::Error;
+			}
+			if (locals->inLocal(inst)) {
+				exprs->push_back(std::make_unique<wabt::LocalSetExpr>(wabt::Var(locals->slot(inst), loc)));
+			} else if (inst->hasResult()) {
+				exprs->push_back(std::make_unique<wabt::DropExpr>());
+			}
+		}
 
-	Result visitExpression(Expression* expr) {
-		switch (expr->kind()) {
-		case ExpressionKind::Literal:
-			visitLiteral(static_cast<LiteralExpression*>(expr));
-			break;
-		case ExpressionKind::Path:
-			visitPathExpression(static_cast<PathExpression*>(expr));
-			break;
-		case ExpressionKind::Binary:
-			visitBinaryExpression(static_cast<BinaryExpression*>(expr));
-			break;
-		case ExpressionKind::Block:
-			visitBlockExpression(static_cast<BlockExpession*>(expr));
-			break;
-		default:
-			return Result::Error;
+		// The end of the function returns, and so does falling through to
+		// the next block.
+		if (loop) {
+			exprs->push_back(std::make_unique<wabt::BrExpr>(wabt::Var(0, loc), loc));
+			exprs = outer;
+			exprs->push_back(std::move(loop));
+		} else if (terminator->op == ir::Opcode::Return && !last) {
+			exprs->push_back(std::make_unique<wabt::ReturnExpr>(loc));
 		}
 		return Result::Ok;
 	}
 
-	Result visitLiteral(LiteralExpression* lit) {
-		wabt::Location              loc;
-		std::unique_ptr<wabt::Expr> expr =
-				std::make_unique<wabt::ConstExpr>(wabt::Const::I32(lit->i32val, loc), loc);
-		exprs.push_back(std::move(expr));
-		return Result::Ok;
+	// A copy that shares the local of its operand.
+	bool isCoalescedCopy(const ir::Instruction* inst) const {
+		return inst->op == ir::Opcode::Copy && locals->inLocal(inst) && locals->inLocal(inst->operand(0)) &&
+		       locals->slot(inst) == locals->slot(inst->operand(0));
 	}
 
-	Result visitBlockExpression(BlockExpession* block) {
-		for (auto& stmt : block->stmts) {
-			visitStatement(stmt.get());
+	Result emitOperand(const ir::Instruction* value) {
+		if (locals->onStack(value)) {
+			return emitInstruction(value);
 		}
+		wabt::Location loc;
+		exprs->push_back(std::make_unique<wabt::LocalGetExpr>(wabt::Var(locals->slot(value), loc)));
 		return Result::Ok;
 	}
 
-	Result visitPathExpression(PathExpression* path) {
+	// Pushes the instructions that compute `inst`, leaving its result on
+	// the stack.
+	Result emitInstruction(const ir::Instruction* inst) {
 		wabt::Location loc;
-		int            ind = func->bindings.FindIndex(path->id.name);
-		wabt::Var      var(ind, loc);
-
-		if (ind < 0) {
-			std::cout << "var '" << path->id.name << "' is not found!" << std::endl;
+		switch (inst->op) {
+		case ir::Opcode::Const: {
+			wabt::Const value;
+			switch (inst->type) {
+			case PrimitiveVariableTypes::I32:
+				value = wabt::Const::I32(static_cast<uint32_t>(inst->bits), loc);
+				break;
+			case PrimitiveVariableTypes::I64:
+				value = wabt::Const::I64(inst->bits, loc);
+				break;
+			case PrimitiveVariableTypes::F32:
+				value = wabt::Const::F32(static_cast<uint32_t>(inst->bits), loc);
+				break;
+			default:
+				value = wabt::Const::F64(inst->bits, loc);
+				break;
+			}
+			exprs->push_back(std::make_unique<wabt::ConstExpr>(value, loc));
+			return Result::Ok;
 		}
-
-		std::unique_ptr<wabt::Expr> expr =
-				std::make_unique<wabt::LocalGetExpr>(var);
-		exprs.push_back(std::move(expr));
-		return Result::Ok;
-	}
-
-	Result visitBinaryExpression(BinaryExpression* node) {
-		wabt::Location              loc;
-		std::unique_ptr<wabt::Expr> expr;
-
-		visitExpression(node->right.get());
-		visitExpression(node->left.get());
-
-		switch (node->op) {
-		case BinaryOperator::Plus:
-			expr = std::make_unique<wabt::BinaryExpr>(wabt::Opcode::I32Add, loc);
-			break;
-		case BinaryOperator::Minus:
-			expr = std::make_unique<wabt::BinaryExpr>(wabt::Opcode::I32Sub, loc);
-			break;
-		case BinaryOperator::Mult:
-			expr = std::make_unique<wabt::BinaryExpr>(wabt::Opcode::I32Mul, loc);
-			break;
-		case BinaryOperator::Div:
-			expr = std::make_unique<wabt::BinaryExpr>(wabt::Opcode::I32DivS, loc);
+		case ir::Opcode::Copy:
+			return emitOperand(inst->operand(0));
+		case ir::Opcode::Call: {
+			auto found = functionIndices.find(inst->callee);
+			if (found == functionIndices.end()) {
+				errors << "function '" << func->name << "': calls undefined function '" << inst->callee.str() << "'"
+				       << std::endl;
+				return Result::Error;
+			}
+			exprs->push_back(std::make_unique<wabt::CallExpr>(wabt::Var(found->second, loc), loc));
+			return Result::Ok;
+		}
+		default:
 			break;
-			//case BinaryOperator::BitwiseAnd:
-			//	expr = std::make_unique<BinaryExpr>(Opcode::I32And, loc);
-			//	break;
-			//case BinaryOperator::BitwiseOr:
-			//	expr = std::make_unique<BinaryExpr>(Opcode::I32Or, loc);
-			//	break;
 		}
-
-		exprs.push_back(std::move(expr));
-
+		if (!inst->isBinary()) {
+			errors << "function '" << func->name << "': cannot emit " << ir::opcodeName(inst->op) << std::endl;
+			return Result::Error;
+		}
+		if (emitOperand(inst->operand(0)) != Result::Ok || emitOperand(inst->operand(1)) != Result::Ok) {
+			return Result::Error;
+		}
+		size_t       column = static_cast<size_t>(inst->op) - static_cast<size_t>(ir::Opcode::Add);
+		wabt::Opcode opcode = kBinaryOpcodes[static_cast<size_t>(inst->type)][column];
+		exprs->push_back(std::make_unique<wabt::BinaryExpr>(opcode, loc));
 		return Result::Ok;
 	}
 
-	std::string result() {
-		return std::string();
-	}
+	std::ostream&          errors;
+	const CodegenOptions&  options;
+	wabt::Func*            func   = nullptr;
+	wabt::ExprList*        exprs  = nullptr; // where instructions are emitted
+	const LocalAllocation* locals = nullptr;
+};
 
-	WasmVisitor()
-			: module(std::make_unique<wabt::Module>()) {
+// Adds the memory that holds `strings`, its export and the data segment
+// with them, as encodeWasm lays them out. Returns the segment, or nullptr
+// if there are no strings and so no memory.
+static wabt::DataSegment* appendStrings(wabt::Module* module, const ir::StringPool& strings) {
+	if (strings.data().empty()) {
+		return nullptr;
 	}
-
-	std::unique_ptr<wabt::Module> module;
-	wabt::ExprList                exprs;
-	wabt::Func*                   func;
-};
+	wabt::Location loc;
+	auto           memory_field              = std::make_unique<wabt::MemoryModuleField>(loc);
+	memory_field->memory.page_limits.initial = memoryPages(strings);
+	module->AppendField(std::move(memory_field));
+
+	auto export_field          = std::make_unique<wabt::ExportModuleField>(loc);
+	export_field->export_.kind = wabt::ExternalKind::Memory;
+	export_field->export_.name = "memory";
+	export_field->export_.var  = wabt::Var(0, loc);
+	module->AppendField(std::move(export_field));
+
+	auto               data_field = std::make_unique<wabt::DataSegmentModuleField>(loc);
+	wabt::DataSegment* segment    = &data_field->data_segment;
+	segment->memory_var           = wabt::Var(0, loc);
+	segment->offset.push_back(std::make_unique<wabt::ConstExpr>(wabt::Const::I32(0, loc), loc));
+	segment->data.assign(strings.data().begin(), strings.data().end());
+	module->AppendField(std::move(data_field));
+	return segment;
+}
 
 static void WriteBufferToFile(wabt::string_view         filename,
 															const wabt::OutputBuffer& buffer) {
@@ -217,30 +319,251 @@ static void WriteBufferToFile(wabt::string_view         filename,
 	buffer.WriteToFile(filename);
 }
 
-std::string CodeGen::generateWasm(Module* mod, const std::string& fileName) {
-	auto visitor = std::make_unique<WasmVisitor>();
-	visitor->visitModule(mod);
+static void reportErrors(const wabt::Errors& errors, std::ostream& out) {
+	out << "Codegen Error: " << std::endl;
+	for (auto err : errors) {
+		out << err.message << std::endl;
+	}
+}
+
+// The wasm proposals the emitted code may use.
+static wabt::Features featuresOf(const CodegenOptions& codegen) {
+	wabt::Features features;
+	features.set_tail_call_enabled(codegen.tailCalls);
+	// Nothing emitted copies or fills memory, and with bulk memory wabt
+	// would also write a data count section.
+	features.set_bulk_memory_enabled(false);
+	return features;
+}
 
+static bool validate(const wabt::Module* module, const CodegenOptions& codegen, std::ostream& out) {
 	wabt::Errors          errors;
-	wabt::ValidateOptions options;
-	auto                  result = wabt::ValidateModule(visitor->module.get(), &errors, options);
-	if (wabt::Succeeded(result)) {
-		wabt::MemoryStream       stream;
-		wabt::WriteBinaryOptions options;
-		result = wabt::WriteBinaryModule(&stream, visitor->module.get(), options);
+	wabt::ValidateOptions options(featuresOf(codegen));
+	if (!wabt::Succeeded(wabt::ValidateModule(module, &errors, options))) {
+		reportErrors(errors, out);
+		return false;
+	}
+	return true;
+}
+
+// Validates `module` and writes it into `stream`.
+static bool serialize(const wabt::Module* module, const CodegenOptions& codegen, std::ostream& out,
+                      wabt::MemoryStream* stream) {
+	if (!validate(module, codegen, out)) {
+		return false;
+	}
+	wabt::WriteBinaryOptions options;
+	options.features = featuresOf(codegen);
+	return wabt::Succeeded(wabt::WriteBinaryModule(stream, module, options));
+}
+
+static bool writeModule(wabt::Module* module, const std::string& fileName, const CodegenOptions& codegen,
+                        std::ostream& out, size_t* bytes = nullptr) {
+	wabt::MemoryStream stream;
+	if (!serialize(module, codegen, out, &stream)) {
+		return false;
+	}
+	WriteBufferToFile(fileName, stream.output_buffer());
+	if (bytes) {
+		*bytes = stream.output_buffer().size();
+	}
+	return true;
+}
+
+// Reads `bytes` with wabt and validates the module they hold.
+static bool validateBinary(const std::vector<uint8_t>& bytes, const CodegenOptions& codegen, std::ostream& out) {
+	wabt::Module            module;
+	wabt::Errors            errors;
+	wabt::ReadBinaryOptions options(featuresOf(codegen), nullptr, false, true, true);
+	if (!wabt::Succeeded(wabt::ReadBinaryIr("", bytes.data(), bytes.size(), options, &errors, &module))) {
+		reportErrors(errors, out);
+		return false;
+	}
+	return validate(&module, codegen, out);
+}
+
+// Builds `mod` again as a wabt module, validates it, and checks that wabt
+// writes the same bytes the direct encoder did.
+static bool matchesWabt(const ir::Module& mod, const std::vector<uint8_t>& bytes, std::ostream& out,
+                        const CodegenOptions& options) {
+	if (options.peephole) {
+		// wabt makes none of the peephole rewrites, so it is compared with
+		// the bodies as they were before them, and the rewritten module is
+		// read back and validated.
+		CodegenOptions       plain = options;
+		std::vector<uint8_t> unrewritten;
+		plain.peephole = false;
+		return validateBinary(bytes, options, out) && encodeWasm(mod, &unrewritten, out, nullptr, plain) &&
+		       matchesWabt(mod, unrewritten, out, plain);
+	}
+	WasmEmitter emitter(out, options);
+	for (size_t i = 0; i < mod.functions.size(); i++) {
+		emitter.functionIndices[Symbol::intern(mod.functions[i]->name)] = static_cast<wabt::Index>(i);
+	}
+	for (auto& function : mod.functions) {
+		if (emitter.emitFunction(*function) != Result::Ok) {
+			return false;
+		}
+	}
+	appendStrings(emitter.module.get(), mod.strings);
+	wabt::MemoryStream stream;
+	if (!serialize(emitter.module.get(), options, out, &stream)) {
+		return false;
+	}
+	const std::vector<uint8_t>& expected = stream.output_buffer().data;
+	if (bytes != expected) {
+		size_t common = bytes.size() < expected.size() ? bytes.size() : expected.size();
+		size_t at     = std::mismatch(bytes.begin(), bytes.begin() + common, expected.begin()).first - bytes.begin();
+		out << "wasm mismatch: the encoder wrote " << bytes.size() << " bytes and wabt " << expected.size()
+		    << ", differing from byte " << at << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CodeGen::generateWasm(const ir::Module& mod, const std::string& fileName, std::ostream& out,
+                           CodegenStats* stats, const CodegenOptions& options) {
+	std::vector<uint8_t> bytes;
+	if (!encodeWasm(mod, &bytes, out, stats, options) || (options.verify && !matchesWabt(mod, bytes, out, options))) {
+		return false;
+	}
+	std::ofstream file(fileName, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+	if (!file) {
+		out << "cannot write '" << fileName << "'" << std::endl;
+		return false;
+	}
+	if (stats) {
+		stats->bytes += bytes.size();
+	}
+	return true;
+}
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const CodegenStats& stats) {
+	sink << "codegen: " << stats.locals << " locals for " << stats.values << " values, " << stats.types
+	     << " types, " << stats.tailCalls << " tail calls, " << stats.bytes << " bytes\n";
+	sink << stats.peephole;
+	return sink;
+}
+
+struct ModuleBuilder::Function {
+	wabt::Func* func  = nullptr;
+	wabt::Index index = 0;
+};
+
+// Points the calls in `exprs` at the functions `indices` maps their index to.
+static void retargetCalls(wabt::ExprList* exprs, const std::vector<wabt::Index>& indices) {
+	for (wabt::Expr& expr : *exprs) {
+		if (auto call = wabt::dyn_cast<wabt::CallExpr>(&expr)) {
+			call->var = wabt::Var(indices[call->var.index()], call->loc);
+		} else if (auto call = wabt::dyn_cast<wabt::ReturnCallExpr>(&expr)) {
+			call->var = wabt::Var(indices[call->var.index()], call->loc);
+		} else if (auto loop = wabt::dyn_cast<wabt::LoopExpr>(&expr)) {
+			retargetCalls(&loop->block.exprs, indices);
+		}
+	}
+}
 
-		if (wabt::Succeeded(result)) {
-			WriteBufferToFile(fileName, stream.output_buffer());
+ModuleBuilder::ModuleBuilder(const CodegenOptions& options)
+		: options(options), module(std::make_unique<wabt::Module>()),
+		  signatures(std::make_unique<SignatureTable>(module.get())) {
+}
+
+ModuleBuilder::~ModuleBuilder() {
+}
+
+size_t ModuleBuilder::functionCount() const {
+	return functions.size();
+}
+
+bool ModuleBuilder::define(const ir::Function& fun, std::ostream& out) {
+	Symbol name  = Symbol::intern(fun.name);
+	auto   found = functions.find(name);
+
+	// Compiled and validated in a module of its own first, so a function with
+	// errors never reaches the session's module. The function is index 0
+	// there and each session function it calls gets a stand-in, with the
+	// same signature and an empty body, so the module validates without the
+	// rest of the session. `sessionIndices` maps scratch indices back.
+	WasmEmitter              emitter(out, options);
+	std::vector<wabt::Index> sessionIndices;
+	std::vector<wabt::Func*> standIns; // the session functions, by scratch index
+	emitter.functionIndices[name] = 0;
+	sessionIndices.push_back(found != functions.end() ? found->second->index
+	                                                  : static_cast<wabt::Index>(module->funcs.size()));
+	standIns.push_back(nullptr);
+	for (auto& block : fun.blocks) {
+		for (auto& inst : block->insts) {
+			auto callee = inst->op == ir::Opcode::Call ? functions.find(inst->callee) : functions.end();
+			if (callee != functions.end() &&
+			    emitter.functionIndices.emplace(inst->callee, static_cast<wabt::Index>(sessionIndices.size())).second) {
+				sessionIndices.push_back(callee->second->index);
+				standIns.push_back(callee->second->func);
+			}
 		}
 	}
-	else {
-		std::cout << "Codegen Error: " << std::endl;
-		for (auto err : errors) {
-			std::cout << err.message << std::endl;
+	if (emitter.emitFunction(fun) != Result::Ok) {
+		return false;
+	}
+	wabt::Location loc;
+	for (size_t i = 1; i < standIns.size(); i++) {
+		auto standIn                     = std::make_unique<wabt::FuncModuleField>(loc, "");
+		standIn->func.decl.sig           = standIns[i]->decl.sig;
+		standIn->func.decl.has_func_type = true;
+		standIn->func.decl.type_var      = wabt::Var(emitter.signatures.intern(standIns[i]->decl.sig), loc);
+		emitter.module->AppendField(std::move(standIn));
+	}
+	if (!validate(emitter.module.get(), options, out)) {
+		return false;
+	}
+
+	// Types are shared in the session's module, so the function is pointed
+	// at the session's copy of its signature rather than the scratch one.
+	wabt::Func& compiled   = *emitter.module->funcs[0];
+	compiled.decl.type_var = wabt::Var(signatures->intern(compiled.decl.sig), loc);
+	retargetCalls(&compiled.exprs, sessionIndices);
+
+	if (found != functions.end()) {
+		// Redefined in place: the index, and with it every reference to the
+		// function, stays valid.
+		Function& existing = *found->second;
+		existing.func->exprs.swap(compiled.exprs);
+		existing.func->local_types = compiled.local_types;
+		existing.func->decl        = compiled.decl;
+		return true;
+	}
+
+	std::unique_ptr<Function> function = std::make_unique<Function>();
+	while (!emitter.module->fields.empty()) {
+		std::unique_ptr<wabt::ModuleField> field = emitter.module->fields.extract(emitter.module->fields.begin());
+		if (wabt::isa<wabt::TypeModuleField>(field.get())) {
+			continue;
+		}
+		if (auto funcField = wabt::dyn_cast<wabt::FuncModuleField>(field.get())) {
+			if (&funcField->func != &compiled) {
+				continue; // a stand-in
+			}
+			function->func  = &funcField->func;
+			function->index = static_cast<wabt::Index>(module->funcs.size());
+		} else if (auto exportField = wabt::dyn_cast<wabt::ExportModuleField>(field.get())) {
+			exportField->export_.var = wabt::Var(function->index, exportField->loc);
 		}
+		module->AppendField(std::move(field));
 	}
+	functions.emplace(name, std::move(function));
+	return true;
+}
 
-	return std::string();
+bool ModuleBuilder::write(const std::string& fileName, std::ostream& out) {
+	// The memory is added with the first string, and then grows with the
+	// pool.
+	if (!data) {
+		data = appendStrings(module.get(), strings_);
+	} else {
+		data->data.assign(strings_.data().begin(), strings_.data().end());
+		module->memories[0]->page_limits.initial = memoryPages(strings_);
+	}
+	return writeModule(module.get(), fileName, options, out);
 }
 
 } // namespace internal
@@ -1,16 +1,103 @@
 #pragma once
 
 #include "common.h"
-#include "ast/ast.h"
-#include "DLParserVisitor.h"
+#include "codegen/peephole.h"
+#include "ir/ir.h"
+#include "utils/diagnostics.h"
+#include "utils/symbol.h"
+
+#include <iostream>
+#include <unordered_map>
+
+namespace wabt {
+struct DataSegment;
+struct Module;
+}
 
 namespace dp {
 namespace internal {
 
+class SignatureTable;
+
+struct CodegenOptions {
+	// Emit a call directly followed by a return as return_call, from the
+	// tail-call proposal, which reuses the caller's frame. Off for engines
+	// without it.
+	bool tailCalls = true;
+
+	// Rewrite each function body with the rules in peephole.h before it is
+	// encoded.
+	bool peephole = true;
+
+	// Also build the module with wabt, validate it, and check that wabt
+	// writes the same bytes as the direct encoder. Nothing is written if it
+	// does not.
+	bool verify = false;
+
+	// Function bodies are encoded on this many threads. The output is the
+	// same whatever the number.
+	size_t threads = 1;
+};
+
+struct CodegenStats {
+	size_t values    = 0; // IR values kept in wasm locals
+	size_t locals    = 0; // locals declared for them, after slots are shared
+	size_t types     = 0; // distinct function signatures
+	size_t tailCalls = 0; // calls emitted as return_call
+	size_t bytes     = 0; // size of the binary written
+
+	PeepholeStats peephole;
+};
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const CodegenStats& stats);
+
 class CodeGen {
 public:
 	//static std::string generateWat(Module& bexp);
-	static std::string generateWasm(Module* bexp, const std::string& fileName);
+	// Encodes `module` with encodeWasm and writes it to `fileName`. Errors
+	// are reported to `errors`, and then false is returned and nothing is
+	// written. Adds what was emitted to `stats`.
+	static bool generateWasm(const ir::Module& module, const std::string& fileName,
+	                                std::ostream& errors = std::cerr, CodegenStats* stats = nullptr,
+	                                const CodegenOptions& options = CodegenOptions());
+};
+
+// A wasm module built up one function at a time, for the REPL. Defining a
+// function compiles and validates only that function, and a redefined
+// function keeps its index, so the cost of a definition does not grow with
+// the size of the module.
+class ModuleBuilder {
+public:
+	explicit ModuleBuilder(const CodegenOptions& options = CodegenOptions());
+	~ModuleBuilder();
+
+	ModuleBuilder(const ModuleBuilder&) = delete;
+	ModuleBuilder& operator=(const ModuleBuilder&) = delete;
+
+	// Compiles `fun` into the module, replacing the function of the same name
+	// if there is one. If it does not compile, reports why to `errors`, leaves
+	// the module as it was and returns false.
+	bool define(const ir::Function& fun, std::ostream& errors);
+
+	size_t functionCount() const;
+
+	// Where functions lowered for the module keep their string literals.
+	ir::StringPool* strings() {
+		return &strings_;
+	}
+
+	// Validates the whole module and writes it to `fileName`.
+	bool write(const std::string& fileName, std::ostream& errors);
+
+private:
+	struct Function;
+
+	CodegenOptions                                                    options;
+	std::unique_ptr<wabt::Module>                                     module;
+	std::unique_ptr<SignatureTable>                                   signatures; // of `module`
+	std::unordered_map<Symbol, std::unique_ptr<Function>, SymbolHash> functions;
+	ir::StringPool                                                    strings_;
+	wabt::DataSegment*                                                data = nullptr; // of `module`, once there are strings
 };
 
 } // namespace internal
@@ -0,0 +1,473 @@
+#include "encoder.h"
+#include "locals.h"
+#include "peephole.h"
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+
+namespace {
+
+// Section ids and type codes of the wasm binary format. The opcodes are in
+// peephole.h.
+enum : uint8_t {
+	kTypeSection     = 1,
+	kFunctionSection = 3,
+	kMemorySection   = 5,
+	kExportSection   = 7,
+	kCodeSection     = 10,
+	kDataSection     = 11,
+
+	kFuncType     = 0x60,
+	kEmptyBlock   = 0x40,
+	kExternFunc   = 0x00,
+	kExternMemory = 0x02,
+	kNoMaximum    = 0x00, // limits flags
+	kActiveData   = 0x00, // data segment flags: active, in memory 0
+};
+
+// Indexed by PrimitiveVariableTypes.
+const uint8_t kValueTypes[4] = { 0x7f, 0x7e, 0x7d, 0x7c };
+
+// Indexed like kBinaryOpcodes in codegen.cpp; zero where there is none.
+const uint8_t kBinaryOpcodes[4][7] = {
+		{ 0x6a, 0x6b, 0x6c, 0x6d, 0x71, 0x72, 0x74 },
+		{ 0x7c, 0x7d, 0x7e, 0x7f, 0x83, 0x84, 0x86 },
+		{ 0x92, 0x93, 0x94, 0x95, 0x00, 0x00, 0x00 },
+		{ 0xa0, 0xa1, 0xa2, 0xa3, 0x00, 0x00, 0x00 },
+};
+
+// A growable buffer of wasm binary.
+class ByteBuffer {
+public:
+	void byte(uint8_t value) {
+		bytes.push_back(value);
+	}
+
+	static size_t u32Size(uint32_t value) {
+		size_t size = 1;
+		while (value >>= 7) {
+			size++;
+		}
+		return size;
+	}
+
+	void u32(uint32_t value) {
+		do {
+			uint8_t low = value & 0x7f;
+			value >>= 7;
+			bytes.push_back(value ? low | 0x80 : low);
+		} while (value);
+	}
+
+	void s64(int64_t value) {
+		for (;;) {
+			uint8_t low = value & 0x7f;
+			value >>= 7;
+			// Done once the rest is the sign extension of the bit just written.
+			if ((value == 0 && !(low & 0x40)) || (value == -1 && (low & 0x40))) {
+				bytes.push_back(low);
+				return;
+			}
+			bytes.push_back(low | 0x80);
+		}
+	}
+
+	void fixed(uint64_t value, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	void name(const std::string& text) {
+		u32(static_cast<uint32_t>(text.size()));
+		bytes.insert(bytes.end(), text.begin(), text.end());
+	}
+
+	// `contents` preceded by its size.
+	void sized(const ByteBuffer& contents) {
+		u32(static_cast<uint32_t>(contents.bytes.size()));
+		bytes.insert(bytes.end(), contents.bytes.begin(), contents.bytes.end());
+	}
+
+	std::vector<uint8_t> bytes;
+};
+
+// A section of entries that starts with their count.
+struct Section {
+	uint32_t   count = 0;
+	ByteBuffer entries;
+
+	void writeTo(uint8_t id, ByteBuffer* out) const {
+		if (!count) {
+			return;
+		}
+		out->byte(id);
+		out->u32(static_cast<uint32_t>(ByteBuffer::u32Size(count) + entries.bytes.size()));
+		out->u32(count);
+		out->bytes.insert(out->bytes.end(), entries.bytes.begin(), entries.bytes.end());
+	}
+};
+
+typedef std::unordered_map<Symbol, uint32_t, SymbolHash> FunctionIndices;
+
+// The body of one function, encoded apart from the others so bodies can be
+// encoded in any order, and what went into it.
+struct EncodedBody {
+	ByteBuffer         bytes;
+	std::ostringstream errors;
+	bool               ok         = false;
+	size_t             values     = 0; // values kept in locals
+	size_t             localCount = 0; // locals declared for them
+	size_t             tailCalls  = 0; // calls emitted as return_call
+	PeepholeStats      peephole;
+};
+
+// Encodes the body of an IR function, with the values that are not on the
+// operand stack in the locals LocalAllocation assigns them. Makes the same
+// choices as WasmEmitter in codegen.cpp, and then the peephole rewrites
+// if they are on. Only reads the function and the
+// indices, so several bodies can be encoded at once.
+class BodyEncoder {
+public:
+	BodyEncoder(const FunctionIndices& functionIndices, const CodegenOptions& options, EncodedBody* out)
+			: functionIndices(functionIndices), options(options), out(out), body(out->bytes), errors(out->errors) {
+	}
+
+	void encode(const ir::Function& function) {
+		name = &function.name;
+		if (!hasSimpleLayout(function)) {
+			errors << "function '" << function.name << "': control flow is not supported by the wasm backend yet"
+			       << std::endl;
+			return;
+		}
+
+		LocalAllocation allocation(function);
+		locals         = &allocation;
+		uint32_t decls = 0;
+		for (size_t type = 0; type < 4; type++) {
+			decls += allocation.count(static_cast<PrimitiveVariableTypes>(type)) != 0;
+		}
+		body.u32(decls);
+		for (size_t type = 0; type < 4; type++) {
+			if (uint32_t count = allocation.count(static_cast<PrimitiveVariableTypes>(type))) {
+				body.u32(count);
+				body.byte(kValueTypes[type]);
+			}
+		}
+		out->values     = allocation.valueCount();
+		out->localCount = allocation.localCount();
+
+		for (auto& block : function.blocks) {
+			if (!encodeBlock(*block, block.get() == function.blocks.back().get())) {
+				return;
+			}
+		}
+		emit(kEnd);
+		if (options.peephole) {
+			peephole(&code, &out->peephole);
+		}
+		for (const WasmInstruction& inst : code) {
+			write(inst);
+		}
+		out->ok = true;
+	}
+
+private:
+	bool encodeBlock(const ir::BasicBlock& block, bool last) {
+		const ir::Instruction* terminator = block.terminator();
+		bool                   loop       = terminator->op == ir::Opcode::Br && terminator->targets[0] == &block;
+		if (loop) {
+			emit(kLoop, kEmptyBlock);
+		}
+
+		for (size_t i = 0; i + 1 < block.insts.size(); i++) {
+			const ir::Instruction* inst = block.insts[i].get();
+			if (locals->onStack(inst) || isCoalescedCopy(inst)) {
+				continue;
+			}
+			if (inst->op == ir::Opcode::Call && options.tailCalls && block.insts[i + 1].get() == terminator &&
+			    terminator->op == ir::Opcode::Return) {
+				auto found = functionIndices.find(inst->callee);
+				if (found != functionIndices.end()) {
+					emit(kReturnCall, found->second);
+					out->tailCalls++;
+					return true;
+				}
+			}
+			if (!encodeInstruction(inst)) {
+				return false;
+			}
+			if (locals->inLocal(inst)) {
+				emit(kLocalSet, locals->slot(inst));
+			} else if (inst->hasResult()) {
+				emit(kDrop);
+			}
+		}
+
+		if (loop) {
+			emit(kBr, 0);
+			emit(kEnd);
+		} else if (terminator->op == ir::Opcode::Return && !last) {
+			emit(kReturn);
+		}
+		return true;
+	}
+
+	bool isCoalescedCopy(const ir::Instruction* inst) const {
+		return inst->op == ir::Opcode::Copy && locals->inLocal(inst) && locals->inLocal(inst->operand(0)) &&
+		       locals->slot(inst) == locals->slot(inst->operand(0));
+	}
+
+	bool encodeOperand(const ir::Instruction* value) {
+		if (locals->onStack(value)) {
+			return encodeInstruction(value);
+		}
+		emit(kLocalGet, locals->slot(value));
+		return true;
+	}
+
+	bool encodeInstruction(const ir::Instruction* inst) {
+		switch (inst->op) {
+		case ir::Opcode::Const:
+			switch (inst->type) {
+			case PrimitiveVariableTypes::I32:
+				emit(kI32Const, inst->bits & 0xffffffffu);
+				break;
+			case PrimitiveVariableTypes::I64:
+				emit(kI64Const, inst->bits);
+				break;
+			case PrimitiveVariableTypes::F32:
+				emit(kF32Const, inst->bits & 0xffffffffu);
+				break;
+			default:
+				emit(kF64Const, inst->bits);
+				break;
+			}
+			return true;
+		case ir::Opcode::Copy:
+			return encodeOperand(inst->operand(0));
+		case ir::Opcode::Call: {
+			auto found = functionIndices.find(inst->callee);
+			if (found == functionIndices.end()) {
+				errors << "function '" << *name << "': calls undefined function '" << inst->callee.str() << "'"
+				       << std::endl;
+				return false;
+			}
+			emit(kCall, found->second);
+			return true;
+		}
+		default:
+			break;
+		}
+		if (!inst->isBinary()) {
+			errors << "function '" << *name << "': cannot emit " << ir::opcodeName(inst->op) << std::endl;
+			return false;
+		}
+		if (!encodeOperand(inst->operand(0)) || !encodeOperand(inst->operand(1))) {
+			return false;
+		}
+		size_t column = static_cast<size_t>(inst->op) - static_cast<size_t>(ir::Opcode::Add);
+		emit(kBinaryOpcodes[static_cast<size_t>(inst->type)][column]);
+		return true;
+	}
+
+	void emit(uint8_t opcode, uint64_t immediate = 0) {
+		code.push_back(WasmInstruction{ opcode, immediate });
+	}
+
+	// Appends `inst` to the body, with its immediate in the encoding of its
+	// opcode.
+	void write(const WasmInstruction& inst) {
+		body.byte(inst.opcode);
+		switch (inst.opcode) {
+		case kLoop:
+			body.byte(static_cast<uint8_t>(inst.immediate));
+			break;
+		case kBr:
+		case kCall:
+		case kReturnCall:
+		case kLocalGet:
+		case kLocalSet:
+		case kLocalTee:
+			body.u32(static_cast<uint32_t>(inst.immediate));
+			break;
+		case kI32Const:
+			body.s64(static_cast<int32_t>(inst.immediate));
+			break;
+		case kI64Const:
+			body.s64(static_cast<int64_t>(inst.immediate));
+			break;
+		case kF32Const:
+			body.fixed(inst.immediate, 4);
+			break;
+		case kF64Const:
+			body.fixed(inst.immediate, 8);
+			break;
+		default:
+			break;
+		}
+	}
+
+	const FunctionIndices& functionIndices;
+	const CodegenOptions&  options;
+	EncodedBody*           out;
+	ByteBuffer&            body;
+	std::ostream&          errors;
+	const std::string*     name   = nullptr;
+	const LocalAllocation* locals = nullptr;
+	InstructionList        code; // the body after the local declarations
+};
+
+} // namespace
+
+bool hasSimpleLayout(const ir::Function& function) {
+	for (size_t i = 0; i < function.blocks.size(); i++) {
+		const ir::BasicBlock*  block      = function.blocks[i].get();
+		const ir::Instruction* terminator = block->terminator();
+		if (!terminator || terminator->op == ir::Opcode::BrIf) {
+			return false;
+		}
+		if (terminator->op == ir::Opcode::Br && terminator->targets[0] != block &&
+		    terminator->targets[0]->index != i + 1) {
+			return false;
+		}
+		for (auto& inst : block->insts) {
+			if (inst->op == ir::Opcode::Phi) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+uint32_t memoryPages(const ir::StringPool& strings) {
+	const size_t kPageSize = 65536;
+	return static_cast<uint32_t>(std::max<size_t>(1, (strings.data().size() + kPageSize - 1) / kPageSize));
+}
+
+bool encodeWasm(const ir::Module& module, std::vector<uint8_t>* bytes, std::ostream& errors, CodegenStats* stats,
+                const CodegenOptions& options) {
+	// Everything but the bodies first, in order, so every index a body can
+	// refer to is known before any is encoded.
+	FunctionIndices                          functionIndices;
+	std::map<std::vector<uint8_t>, uint32_t> typeIndices; // by encoded signature
+	Section                                  types;
+	Section                                  functions;
+	Section                                  exports;
+	for (size_t i = 0; i < module.functions.size(); i++) {
+		functionIndices[Symbol::intern(module.functions[i]->name)] = static_cast<uint32_t>(i);
+	}
+	for (size_t i = 0; i < module.functions.size(); i++) {
+		const ir::Function& function = *module.functions[i];
+
+		// No params and no results: the grammar has no parameter lists, and
+		// the TypeChecker rejects any function result but `()`.
+		std::vector<uint8_t> signature = { kFuncType, 0, 0 };
+		auto                 type      = typeIndices.emplace(signature, types.count);
+		if (type.second) {
+			types.count++;
+			types.entries.bytes.insert(types.entries.bytes.end(), signature.begin(), signature.end());
+		}
+		functions.count++;
+		functions.entries.u32(type.first->second);
+
+		if (function.isPublic) {
+			exports.count++;
+			exports.entries.name(function.name);
+			exports.entries.byte(kExternFunc);
+			exports.entries.u32(static_cast<uint32_t>(i));
+		}
+	}
+
+	// The string literals, in memory 0 from address 0. Without any, the
+	// module has no memory.
+	const std::string& data = module.strings.data();
+	Section            memories;
+	Section            segments;
+	if (!data.empty()) {
+		memories.count++;
+		memories.entries.byte(kNoMaximum);
+		memories.entries.u32(memoryPages(module.strings));
+		exports.count++;
+		exports.entries.name("memory");
+		exports.entries.byte(kExternMemory);
+		exports.entries.u32(0);
+		segments.count++;
+		segments.entries.byte(kActiveData);
+		segments.entries.byte(kI32Const);
+		segments.entries.u32(0);
+		segments.entries.byte(kEnd);
+		segments.entries.name(data);
+	}
+
+	std::vector<EncodedBody> bodies(module.functions.size());
+	size_t                   threads = std::min(options.threads, bodies.size());
+	if (threads > 1) {
+		ThreadPool pool(threads);
+		for (size_t i = 0; i < bodies.size(); i++) {
+			pool.submit([&, i](size_t) { BodyEncoder(functionIndices, options, &bodies[i]).encode(*module.functions[i]); });
+		}
+		pool.wait();
+	} else {
+		for (size_t i = 0; i < bodies.size(); i++) {
+			BodyEncoder(functionIndices, options, &bodies[i]).encode(*module.functions[i]);
+		}
+	}
+
+	// Assembled in source order, so neither the bytes nor the errors depend
+	// on the threads. A function that fails would shift the index of the
+	// ones after it, as in generateWasm, so nothing is written then.
+	bool   ok       = true;
+	size_t codeSize = ByteBuffer::u32Size(static_cast<uint32_t>(bodies.size()));
+	for (EncodedBody& body : bodies) {
+		errors << body.errors.str();
+		ok = body.ok && ok;
+		codeSize += ByteBuffer::u32Size(static_cast<uint32_t>(body.bytes.bytes.size())) + body.bytes.bytes.size();
+		if (stats) {
+			stats->values += body.values;
+			stats->locals += body.localCount;
+			stats->tailCalls += body.tailCalls;
+			for (size_t i = 0; i < kPeepholeRuleCount; i++) {
+				stats->peephole.hits[i] += body.peephole.hits[i];
+			}
+			stats->peephole.removed += body.peephole.removed;
+		}
+	}
+	if (stats) {
+		stats->types += typeIndices.size();
+	}
+	bytes->clear();
+	if (!ok) {
+		return false;
+	}
+
+	ByteBuffer out;
+	out.bytes.reserve(codeSize + types.entries.bytes.size() + functions.entries.bytes.size() +
+	                  exports.entries.bytes.size() + segments.entries.bytes.size() + 64);
+	out.fixed(0x6d736100, 4); // "\0asm"
+	out.fixed(1, 4);
+	types.writeTo(kTypeSection, &out);
+	functions.writeTo(kFunctionSection, &out);
+	memories.writeTo(kMemorySection, &out);
+	exports.writeTo(kExportSection, &out);
+	if (!bodies.empty()) {
+		out.byte(kCodeSection);
+		out.u32(static_cast<uint32_t>(codeSize));
+		out.u32(static_cast<uint32_t>(bodies.size()));
+		for (const EncodedBody& body : bodies) {
+			out.sized(body.bytes);
+		}
+	}
+	segments.writeTo(kDataSection, &out);
+	bytes->swap(out.bytes);
+	return true;
+}
+
+} // namespace internal
+} // namespace dp
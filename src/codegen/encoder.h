@@ -0,0 +1,42 @@
+#pragma once
+#include "common.h"
+
+#include "codegen/codegen.h"
+#include "ir/ir.h"
+
+#include <iostream>
+
+namespace dp {
+namespace internal {
+
+// Encodes `module` as a wasm binary into `bytes` in one walk over the IR,
+// without building a wabt module. Sections and function bodies are laid
+// out the way wabt's binary writer lays them out, minimal LEB128s
+// included, so the two outputs can be compared byte for byte when
+// `options.peephole` is off; otherwise each body is first rewritten by
+// peephole(), which wabt does not do. Functions that cannot be encoded are
+// reported to `errors`, and then `bytes` is left empty and false is
+// returned. Adds what was emitted to `stats`, except the size.
+//
+// The signatures, exports and indices are laid out first, in order. The
+// bodies only depend on those, so they are then encoded on
+// `options.threads` threads, each into a buffer of its own, and the code
+// section is assembled from the buffers in order. Errors are reported in
+// order too, so the result does not depend on the number of threads.
+//
+// The string literals of `module` are placed in one active data segment at
+// address 0 of a memory exported as "memory", which is only declared when
+// there are strings.
+bool encodeWasm(const ir::Module& module, std::vector<uint8_t>* bytes, std::ostream& errors,
+                CodegenStats* stats = nullptr, const CodegenOptions& options = CodegenOptions());
+
+// The initial size, in 64 KiB pages, of the memory that holds `strings`.
+uint32_t memoryPages(const ir::StringPool& strings);
+
+// Blocks are laid out in order, so each one must end by returning, falling
+// through to the next one, or branching back to its own start, which
+// makes it a loop. That is every shape the passes produce from source.
+bool hasSimpleLayout(const ir::Function& function);
+
+} // namespace internal
+} // namespace dp
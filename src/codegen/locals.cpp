@@ -0,0 +1,121 @@
+#include "locals.h"
+#include "ir/liveness.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+
+LocalAllocation::LocalAllocation(const ir::Function& function) {
+	typedef std::unordered_set<const ir::Instruction*> ValueSet;
+
+	std::vector<const ir::Instruction*> values; // in order of definition
+	for (auto& block : function.blocks) {
+		for (auto& inst : block->insts) {
+			if (inst->hasResult() && !inst->users().empty() && !onStack(inst.get())) {
+				values.push_back(inst.get());
+			}
+		}
+	}
+	ValueSet locals(values.begin(), values.end());
+
+	// A value interferes with every value that is live where it is set.
+	// Each block is walked backwards from what is live on exit, one emitted
+	// tree at a time: the tree reads its operands before the value it
+	// computes is set.
+	ir::Liveness                                         liveness(function);
+	std::unordered_map<const ir::Instruction*, ValueSet> interference;
+	std::vector<const ir::Instruction*>                  reads;
+	for (auto& block : function.blocks) {
+		ValueSet live;
+		for (const ir::Instruction* value : liveness.liveOut(block.get())) {
+			if (locals.count(value)) {
+				live.insert(value);
+			}
+		}
+		for (auto it = block->insts.rbegin(); it != block->insts.rend(); ++it) {
+			const ir::Instruction* inst = it->get();
+			if (onStack(inst)) {
+				continue;
+			}
+			if (locals.count(inst)) {
+				live.erase(inst);
+				for (const ir::Instruction* other : live) {
+					if (other->type == inst->type) {
+						interference[inst].insert(other);
+						interference[other].insert(inst);
+					}
+				}
+			}
+			reads.clear();
+			addReads(inst, &reads);
+			live.insert(reads.begin(), reads.end());
+		}
+	}
+
+	// Greedy, in order of definition, which is optimal for the straight
+	// line code lowering produces.
+	std::unordered_map<const ir::Instruction*, uint32_t> typeSlots;
+	std::vector<bool>                                    taken;
+	for (const ir::Instruction* value : values) {
+		taken.assign(counts[static_cast<size_t>(value->type)] + 1, false);
+		for (const ir::Instruction* other : interference[value]) {
+			auto found = typeSlots.find(other);
+			if (found != typeSlots.end()) {
+				taken[found->second] = true;
+			}
+		}
+		uint32_t chosen = 0;
+		auto     source = value->op == ir::Opcode::Copy ? typeSlots.find(value->operand(0)) : typeSlots.end();
+		if (source != typeSlots.end() && !taken[source->second]) {
+			chosen = source->second;
+		} else {
+			while (taken[chosen]) {
+				chosen++;
+			}
+		}
+		typeSlots[value] = chosen;
+		uint32_t& count  = counts[static_cast<size_t>(value->type)];
+		count            = std::max(count, chosen + 1);
+	}
+
+	uint32_t offsets[4] = { 0, counts[0], counts[0] + counts[1], counts[0] + counts[1] + counts[2] };
+	for (const ir::Instruction* value : values) {
+		slots[value] = offsets[static_cast<size_t>(value->type)] + typeSlots[value];
+	}
+}
+
+bool LocalAllocation::onStack(const ir::Instruction* inst) const {
+	if (inst->users().empty()) {
+		return false;
+	}
+	if (inst->op == ir::Opcode::Const) {
+		return true;
+	}
+	if (!inst->isBinary() && inst->op != ir::Opcode::Copy) {
+		return false;
+	}
+	return inst->users().size() == 1 && inst->users()[0]->block == inst->block && !inst->hasSideEffects();
+}
+
+// The local values read while the tree that computes `inst` is emitted.
+void LocalAllocation::addReads(const ir::Instruction* inst, std::vector<const ir::Instruction*>* reads) const {
+	if (inst->op == ir::Opcode::Phi) {
+		return;
+	}
+	for (const ir::Instruction* operand : inst->operands()) {
+		if (onStack(operand)) {
+			addReads(operand, reads);
+		} else {
+			reads->push_back(operand);
+		}
+	}
+}
+
+size_t LocalAllocation::localCount() const {
+	return counts[0] + counts[1] + counts[2] + counts[3];
+}
+
+} // namespace internal
+} // namespace dp
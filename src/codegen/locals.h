@@ -0,0 +1,55 @@
+#pragma once
+#include "common.h"
+
+#include "ir/ir.h"
+
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+
+// Decides where each IR value lives while a function is emitted as wasm,
+// and packs the values that need a local into as few slots as their live
+// ranges allow.
+//
+// A value used once, by an instruction of the same block, that cannot trap
+// is computed where it is used and stays on the operand stack; constants
+// are computed again at every use. Every other value that is used is kept
+// in a local. Two such values share a slot unless one is live where the
+// other is set, found from ir::Liveness and the points where the stack
+// trees are emitted. A copy takes the slot of its operand when it can, so
+// it costs no code at all. Slots are numbered by type, i32 first, then i64,
+// f32 and f64, so the declarations are at most four runs.
+class LocalAllocation {
+public:
+	explicit LocalAllocation(const ir::Function& function);
+
+	bool onStack(const ir::Instruction* inst) const;
+
+	bool inLocal(const ir::Instruction* inst) const {
+		return slots.count(inst) != 0;
+	}
+	// The local index of a value for which inLocal() is true.
+	uint32_t slot(const ir::Instruction* inst) const {
+		return slots.at(inst);
+	}
+
+	// How many locals of `type` to declare, in PrimitiveVariableTypes order.
+	uint32_t count(PrimitiveVariableTypes type) const {
+		return counts[static_cast<size_t>(type)];
+	}
+
+	size_t localCount() const;
+	size_t valueCount() const {
+		return slots.size();
+	}
+
+private:
+	void addReads(const ir::Instruction* inst, std::vector<const ir::Instruction*>* reads) const;
+
+	uint32_t                                             counts[4] = { 0, 0, 0, 0 };
+	std::unordered_map<const ir::Instruction*, uint32_t> slots;
+};
+
+} // namespace internal
+} // namespace dp
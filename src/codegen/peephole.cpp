@@ -0,0 +1,167 @@
+#include "peephole.h"
+
+namespace dp {
+namespace internal {
+
+// 32 or 64 for the integer constants and arithmetic the rules rewrite, 0
+// for every other opcode.
+static unsigned integerWidth(uint8_t opcode) {
+	switch (opcode) {
+	case kI32Const:
+	case kI32Add:
+	case kI32Sub:
+	case kI32Mul:
+	case kI32And:
+	case kI32Or:
+	case kI32Shl:
+		return 32;
+	case kI64Const:
+	case kI64Add:
+	case kI64Sub:
+	case kI64Mul:
+	case kI64And:
+	case kI64Or:
+	case kI64Shl:
+		return 64;
+	default:
+		return 0;
+	}
+}
+
+static bool isConst(const WasmInstruction& inst) {
+	return inst.opcode == kI32Const || inst.opcode == kI64Const || inst.opcode == kF32Const ||
+	       inst.opcode == kF64Const;
+}
+
+static uint64_t truncate(uint64_t bits, unsigned width) {
+	return width == 32 ? bits & 0xffffffffu : bits;
+}
+
+// local.set x; local.get x => local.tee x
+static bool teeLocal(WasmInstruction* window, size_t* length) {
+	if (window[0].opcode != kLocalSet || window[1].opcode != kLocalGet || window[0].immediate != window[1].immediate) {
+		return false;
+	}
+	window[0].opcode = kLocalTee;
+	*length          = 1;
+	return true;
+}
+
+// A push that is dropped goes away; so does the get of a tee.
+static bool removeDrop(WasmInstruction* window, size_t* length) {
+	if (window[1].opcode != kDrop) {
+		return false;
+	}
+	if (window[0].opcode == kLocalGet || isConst(window[0])) {
+		*length = 0;
+		return true;
+	}
+	if (window[0].opcode == kLocalTee) {
+		window[0].opcode = kLocalSet;
+		*length          = 1;
+		return true;
+	}
+	return false;
+}
+
+// Two integer constants and the arithmetic on them => its result. Division
+// may trap, so it is left alone.
+static bool foldConstants(WasmInstruction* window, size_t* length) {
+	unsigned width = integerWidth(window[0].opcode);
+	if (!isConst(window[0]) || !width || window[1].opcode != window[0].opcode ||
+	    integerWidth(window[2].opcode) != width || isConst(window[2])) {
+		return false;
+	}
+	uint64_t a = window[0].immediate;
+	uint64_t b = window[1].immediate;
+	uint64_t result;
+	switch (window[2].opcode) {
+	case kI32Add:
+	case kI64Add:
+		result = a + b;
+		break;
+	case kI32Sub:
+	case kI64Sub:
+		result = a - b;
+		break;
+	case kI32Mul:
+	case kI64Mul:
+		result = a * b;
+		break;
+	case kI32And:
+	case kI64And:
+		result = a & b;
+		break;
+	case kI32Or:
+	case kI64Or:
+		result = a | b;
+		break;
+	default:
+		result = a << (b & (width - 1));
+		break;
+	}
+	window[0].immediate = truncate(result, width);
+	*length             = 1;
+	return true;
+}
+
+// x * 2^k => x << k, which wraps the same way.
+static bool shiftForMultiply(WasmInstruction* window, size_t* length) {
+	if (window[1].opcode != kI32Mul && window[1].opcode != kI64Mul) {
+		return false;
+	}
+	unsigned width = integerWidth(window[1].opcode);
+	uint64_t bits  = window[0].immediate;
+	if (window[0].opcode != (width == 32 ? kI32Const : kI64Const) || bits < 2 || (bits & (bits - 1)) != 0) {
+		return false;
+	}
+	uint64_t shift = 0;
+	while (bits >>= 1) {
+		shift++;
+	}
+	window[0].immediate = shift;
+	window[1].opcode    = width == 32 ? kI32Shl : kI64Shl;
+	*length             = 2;
+	return true;
+}
+
+const PeepholeRule kPeepholeRules[kPeepholeRuleCount] = {
+		{ "local.tee", 2, teeLocal },
+		{ "drop", 2, removeDrop },
+		{ "fold", 3, foldConstants },
+		{ "shift", 2, shiftForMultiply },
+};
+
+void peephole(InstructionList* code, PeepholeStats* stats) {
+	// Rules only shrink code, so the rewritten code is built in place, in
+	// front of what is still to be read.
+	InstructionList& insts = *code;
+	size_t           kept  = 0;
+	for (size_t i = 0; i < insts.size(); i++) {
+		insts[kept++] = insts[i];
+		for (size_t rule = 0; rule < kPeepholeRuleCount;) {
+			size_t length = kPeepholeRules[rule].length;
+			if (kept >= length && kPeepholeRules[rule].apply(&insts[kept - length], &length)) {
+				kept -= kPeepholeRules[rule].length - length;
+				stats->hits[rule]++;
+				rule = 0;
+			} else {
+				rule++;
+			}
+		}
+	}
+	stats->removed += insts.size() - kept;
+	insts.resize(kept);
+}
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const PeepholeStats& stats) {
+	sink << "peephole: " << stats.removed << " instructions removed (";
+	for (size_t i = 0; i < kPeepholeRuleCount; i++) {
+		sink << (i ? ", " : "") << stats.hits[i] << " " << kPeepholeRules[i].name;
+	}
+	sink << ")\n";
+	return sink;
+}
+
+} // namespace internal
+} // namespace dp
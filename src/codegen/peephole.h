@@ -0,0 +1,83 @@
+#pragma once
+#include "common.h"
+
+#include "utils/diagnostics.h"
+
+#include <vector>
+
+namespace dp {
+namespace internal {
+
+// Opcodes of the wasm binary format.
+enum : uint8_t {
+	kLoop       = 0x03,
+	kEnd        = 0x0b,
+	kBr         = 0x0c,
+	kReturn     = 0x0f,
+	kCall       = 0x10,
+	kReturnCall = 0x12,
+	kDrop       = 0x1a,
+	kLocalGet   = 0x20,
+	kLocalSet   = 0x21,
+	kLocalTee   = 0x22,
+	kI32Const   = 0x41,
+	kI64Const   = 0x42,
+	kF32Const   = 0x43,
+	kF64Const   = 0x44,
+	kI32Add     = 0x6a,
+	kI32Sub     = 0x6b,
+	kI32Mul     = 0x6c,
+	kI32And     = 0x71,
+	kI32Or      = 0x72,
+	kI32Shl     = 0x74,
+	kI64Add     = 0x7c,
+	kI64Sub     = 0x7d,
+	kI64Mul     = 0x7e,
+	kI64And     = 0x83,
+	kI64Or      = 0x84,
+	kI64Shl     = 0x86,
+};
+
+// A wasm instruction of a function body before it is encoded.
+struct WasmInstruction {
+	uint8_t  opcode;
+	uint64_t immediate; // the index, depth or block type, or the bits of a constant; 0 if none
+
+	bool operator==(const WasmInstruction& other) const {
+		return opcode == other.opcode && immediate == other.immediate;
+	}
+};
+
+typedef std::vector<WasmInstruction> InstructionList;
+
+// A rewrite of a few adjacent instructions into fewer or cheaper ones that
+// leave the same values on the stack. `apply` is given `length`
+// instructions; if they match, it rewrites them in place, sets `*length` to
+// how many are left, never more, and returns true.
+struct PeepholeRule {
+	const char* name;
+	size_t      length;
+	bool (*apply)(WasmInstruction* window, size_t* length);
+};
+
+// local.set x; local.get x, dropped pushes, constants combined by integer
+// arithmetic, and multiplications by a power of two.
+const size_t kPeepholeRuleCount = 4;
+
+extern const PeepholeRule kPeepholeRules[kPeepholeRuleCount];
+
+struct PeepholeStats {
+	size_t hits[kPeepholeRuleCount] = {}; // rewrites, by rule
+	size_t removed                  = 0;  // instructions removed
+};
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const PeepholeStats& stats);
+
+// Rewrites `code`, the instructions of one function body, with the rules
+// of kPeepholeRules. The window slides over the rewritten code, so the
+// result of one rule is matched again, by every rule. Adds what was done
+// to `stats`.
+void peephole(InstructionList* code, PeepholeStats* stats);
+
+} // namespace internal
+} // namespace dp
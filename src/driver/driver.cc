@@ -0,0 +1,174 @@
+#include "driver.h"
+#include "ir/builder.h"
+#include "parsing/mapped_stream.h"
+#include "sema/type_checker.h"
+#include "utils/thread_pool.h"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace dp {
+namespace internal {
+
+CompileResult compileFile(const std::string& inFile, const std::string& outFile,
+                          const CompileOptions& options, DiagnosticSink& sink,
+                          std::ostream& errors, PredictionCache* cache) {
+	CompileResult result;
+	auto          start = std::chrono::steady_clock::now();
+
+	MappedCharStream input(inFile);
+	if (!input.isOpen()) {
+		return result;
+	}
+	result.read = true;
+
+	Parser parser(options.diagnostics, &sink);
+	parser.setLexer(options.lexer);
+	parser.setPredictionCache(cache);
+	parser.setErrorStream(&errors);
+	ModulePtr module(parser.parseModule(input));
+	result.parse = parser.stats();
+
+	if (options.diagnostics.stats) {
+		sink << parser.stats();
+		sink << "ast: " << module->arena.allocationCount() << " allocations, "
+		     << module->arena.bytesAllocated() / 1024 << " KiB used of "
+		     << module->arena.bytesReserved() / 1024 << " KiB in "
+		     << module->arena.chunkCount() << " chunks\n";
+	}
+
+	TypeChecker checker(errors);
+	if (!result.parse.syntaxErrors && checker.check(module.get())) {
+		if (options.optimizationLevel > 0) {
+			ConstantFolder folder;
+			folder.run(module.get());
+			result.fold = folder.stats();
+			if (options.diagnostics.stats) {
+				sink << result.fold;
+			}
+		}
+		std::unique_ptr<ir::Module> lowered = ir::lowerModule(module.get());
+		if (options.optimizationLevel > 0) {
+			// Callees are measured for inlining after the passes, and what was
+			// inlined is cleaned up with the code around it.
+			ir::optimize(lowered.get(), &result.passes);
+			ir::inlineCalls(lowered.get(), options.inlining, &result.inlining);
+			if (result.inlining.sites) {
+				ir::optimize(lowered.get(), &result.passes);
+				result.inlining.instructions = lowered->instructionCount();
+			}
+			if (options.diagnostics.stats) {
+				sink << result.passes;
+				sink << result.inlining;
+			}
+		}
+		if (options.diagnostics.dumpIR) {
+			std::ostringstream text;
+			lowered->print(text);
+			sink << text.str();
+		}
+		result.ok = CodeGen::generateWasm(*lowered, outFile, errors, &result.codegen, options.codegen);
+		if (options.diagnostics.stats) {
+			sink << result.codegen;
+		}
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+namespace {
+
+struct PendingFile {
+	std::ostringstream out;
+	std::ostringstream errors;
+	bool               ok   = false;
+	bool               done = false;
+};
+
+} // namespace
+
+size_t compileFiles(const std::vector<CompileJob>& jobs, const CompileOptions& options, size_t workers,
+                    std::ostream& out, std::ostream& errors) {
+	auto start = std::chrono::steady_clock::now();
+
+	std::vector<std::unique_ptr<PendingFile>> pending;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		pending.emplace_back(new PendingFile());
+	}
+	std::mutex mutex; // guards `done`, `flushed`, `failed` and the streams
+	size_t     flushed = 0;
+	size_t     failed  = 0;
+
+	ThreadPool                                    pool(std::min(workers, std::max<size_t>(jobs.size(), 1)));
+	std::vector<std::unique_ptr<PredictionCache>> caches;
+	for (size_t i = 0; i < pool.size(); i++) {
+		caches.emplace_back(new PredictionCache());
+	}
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		pool.submit([&, i](size_t worker) {
+			PendingFile&  file = *pending[i];
+			CompileResult result;
+			{
+				DiagnosticSink sink(file.out);
+				result = compileFile(jobs[i].inFile, jobs[i].outFile, options, sink, file.errors,
+				                     caches[worker].get());
+			}
+			file.ok = result.ok;
+			if (!result.read) {
+				file.errors << "dp: cannot read " << jobs[i].inFile << "\n";
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			file.done = true;
+			while (flushed < pending.size() && pending[flushed]->done) {
+				PendingFile& next = *pending[flushed++];
+				out << next.out.str();
+				errors << next.errors.str();
+				failed += next.ok ? 0 : 1;
+				next.out.str(std::string());
+				next.errors.str(std::string());
+			}
+		});
+	}
+	pool.wait();
+
+	if (options.diagnostics.stats) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		out << "compiled " << jobs.size() << " files in " << seconds * 1000 << " ms on " << pool.size()
+		    << " threads\n";
+	}
+	out.flush();
+	errors.flush();
+	return failed;
+}
+
+bool readManifest(const std::string& manifest, std::vector<std::string>* files) {
+	std::ifstream in(manifest);
+	if (!in) {
+		return false;
+	}
+	std::string directory;
+	size_t      slash = manifest.rfind('/');
+	if (slash != std::string::npos) {
+		directory = manifest.substr(0, slash + 1);
+	}
+
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t begin = line.find_first_not_of(" \t\r");
+		if (begin == std::string::npos || line[begin] == '#') {
+			continue;
+		}
+		size_t      end  = line.find_last_not_of(" \t\r");
+		std::string path = line.substr(begin, end - begin + 1);
+		files->push_back(path[0] == '/' ? path : directory + path);
+	}
+	return true;
+}
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,64 @@
+#pragma once
+#include "common.h"
+
+#include "codegen/codegen.h"
+#include "ir/inliner.h"
+#include "ir/passes.h"
+#include "opt/constant_folder.h"
+#include "parsing/parsing.h"
+#include "utils/diagnostics.h"
+
+#include <iostream>
+
+namespace dp {
+namespace internal {
+
+struct CompileOptions {
+	DiagnosticOptions diagnostics;
+	LexerKind         lexer = LexerKind::Generated;
+
+	// 0 skips every optimization pass.
+	int               optimizationLevel = 1;
+	ir::InlineOptions inlining;
+	CodegenOptions    codegen;
+};
+
+struct CompileResult {
+	bool            read    = false; // false if the input could not be read
+	bool            ok      = false; // parsed, checked, encoded and written without errors
+	double          seconds = 0;     // wall time for parse and codegen
+	ParseStats      parse;
+	FoldStats       fold;
+	ir::PassStats   passes;
+	ir::InlineStats inlining;
+	CodegenStats    codegen;
+};
+
+// Compiles one source file to a wasm binary at `outFile`. Dumps and
+// statistics requested in `options` are written to `sink`, syntax and codegen
+// errors to `errors`. With a `cache` the parse predicts from it instead of the
+// process-wide DFA.
+CompileResult compileFile(const std::string& inFile, const std::string& outFile,
+                          const CompileOptions& options, DiagnosticSink& sink,
+                          std::ostream& errors = std::cerr, PredictionCache* cache = nullptr);
+
+struct CompileJob {
+	std::string inFile;
+	std::string outFile;
+};
+
+// Compiles `jobs` on a work-stealing pool of `workers` threads, each parsing
+// with its own PredictionCache. What a file prints is buffered and copied to
+// `out` and `errors` once it and every file before it have finished, so the
+// output is that of compiling the files one by one in order. Returns the
+// number of files that could not be read or compiled.
+size_t compileFiles(const std::vector<CompileJob>& jobs, const CompileOptions& options, size_t workers,
+                    std::ostream& out, std::ostream& errors);
+
+// Reads a manifest naming one source file per line. Blank lines and lines
+// starting with '#' are skipped; relative paths are taken relative to the
+// manifest's directory. Returns false if the manifest cannot be read.
+bool readManifest(const std::string& manifest, std::vector<std::string>* files);
+
+} // namespace internal
+} // namespace dp
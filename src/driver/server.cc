@@ -0,0 +1,267 @@
+#include "server.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#ifndef _WIN32
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace dp {
+namespace internal {
+
+#ifndef _WIN32
+
+// Requests are a few paths; replies are diagnostics and dumps.
+static const uint32_t kMaxMessageSize = 256 * 1024 * 1024;
+
+static bool writeAll(int fd, const char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = ::write(fd, data, size);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool readAll(int fd, char* data, size_t size) {
+	while (size > 0) {
+		ssize_t n = ::read(fd, data, size);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+static bool sendMessage(int fd, const std::string& payload) {
+	uint32_t size = static_cast<uint32_t>(payload.size());
+	return writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size)) &&
+	       writeAll(fd, payload.data(), payload.size());
+}
+
+static bool receiveMessage(int fd, std::string* payload) {
+	uint32_t size;
+	if (!readAll(fd, reinterpret_cast<char*>(&size), sizeof(size)) || size > kMaxMessageSize) {
+		return false;
+	}
+	payload->resize(size);
+	return size == 0 || readAll(fd, &(*payload)[0], size);
+}
+
+static std::vector<std::string> splitFields(const std::string& payload) {
+	std::vector<std::string> fields;
+	size_t                   start = 0;
+	while (start <= payload.size()) {
+		size_t end = payload.find('\0', start);
+		if (end == std::string::npos) {
+			end = payload.size();
+		}
+		fields.push_back(payload.substr(start, end - start));
+		start = end + 1;
+	}
+	return fields;
+}
+
+static bool socketAddress(const std::string& path, sockaddr_un* address) {
+	std::memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address->sun_path)) {
+		std::cerr << "socket path too long: " << path << "\n";
+		return false;
+	}
+	std::memcpy(address->sun_path, path.c_str(), path.size() + 1);
+	return true;
+}
+
+// The server does not share the client's working directory.
+static std::string absolutePath(const std::string& path) {
+	if (!path.empty() && path[0] == '/') {
+		return path;
+	}
+	char cwd[PATH_MAX];
+	if (!::getcwd(cwd, sizeof(cwd))) {
+		return path;
+	}
+	return std::string(cwd) + "/" + path;
+}
+
+CompileServer::CompileServer(const std::string& socketPath, const CompileOptions& options)
+		: socketPath(socketPath), options(options) {
+}
+
+bool CompileServer::run(std::ostream& log) {
+	sockaddr_un address;
+	if (!socketAddress(socketPath, &address)) {
+		return false;
+	}
+
+	// A socket file left behind by a server that did not shut down cleanly
+	// would make bind() fail; anything else at that path is left alone.
+	struct stat st;
+	if (::lstat(socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+		::unlink(socketPath.c_str());
+	}
+
+	int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+	    ::listen(listener, 64) != 0) {
+		std::cerr << "cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+		if (listener >= 0) {
+			::close(listener);
+		}
+		return false;
+	}
+	// A client that goes away mid-reply must not take the server down.
+	std::signal(SIGPIPE, SIG_IGN);
+	log << "dp: serving on " << socketPath << std::endl;
+
+	bool running = true;
+	while (running) {
+		int client = ::accept(listener, nullptr, nullptr);
+		if (client < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		std::string payload;
+		if (receiveMessage(client, &payload)) {
+			std::vector<std::string> fields = splitFields(payload);
+			std::string              reply;
+			if (fields[0] == "compile" && fields.size() == 4) {
+				reply = handleCompile(fields, log);
+			} else if (fields[0] == "shutdown") {
+				reply   = std::string(1, '\0');
+				running = false;
+			} else {
+				reply = std::string(1, '\1') + "dp server: malformed request\n";
+			}
+			sendMessage(client, reply);
+		}
+		::close(client);
+	}
+
+	::close(listener);
+	::unlink(socketPath.c_str());
+	log << "dp: served " << requests << " requests";
+	if (requests) {
+		log << ", mean latency " << totalSeconds / requests * 1000 << " ms";
+	}
+	log << std::endl;
+	return true;
+}
+
+std::string CompileServer::handleCompile(const std::vector<std::string>& fields, std::ostream& log) {
+	CompileOptions requestOptions    = options;
+	requestOptions.diagnostics.stats = fields[3] == "stats";
+	// Profiling slows prediction down, so only requests that print stats pay
+	// for it.
+	if (requestOptions.diagnostics.stats) {
+		requestOptions.diagnostics.profilePrediction = true;
+	}
+
+	// Everything the compilation prints, errors included, goes back to the
+	// client.
+	std::ostringstream output;
+	CompileResult      result;
+	{
+		DiagnosticSink sink(output);
+		result = compileFile(fields[1], fields[2], requestOptions, sink, output);
+	}
+
+	if (!result.read) {
+		output << "dp: cannot read " << fields[1] << "\n";
+	}
+
+	requests++;
+	totalSeconds += result.seconds;
+	log << "request " << requests << ": " << fields[1] << " " << result.seconds * 1000 << " ms";
+	if (requestOptions.diagnostics.profilePrediction) {
+		log << ", dfa hit rate " << result.parse.dfaHitRate() * 100 << "% (" << result.parse.dfaMisses
+		    << " misses), " << result.parse.dfaStates << " dfa states";
+	}
+	log << std::endl;
+
+	return std::string(1, result.ok ? '\0' : '\1') + output.str();
+}
+
+static int sendRequest(const std::string& socketPath, const std::string& payload, std::string* reply) {
+	sockaddr_un address;
+	if (!socketAddress(socketPath, &address)) {
+		return -1;
+	}
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		std::cerr << "cannot connect to " << socketPath << ": " << std::strerror(errno) << "\n";
+		if (fd >= 0) {
+			::close(fd);
+		}
+		return -1;
+	}
+	bool ok = sendMessage(fd, payload) && receiveMessage(fd, reply) && !reply->empty();
+	::close(fd);
+	if (!ok) {
+		std::cerr << "dp server at " << socketPath << " closed the connection\n";
+		return -1;
+	}
+	return (*reply)[0] == '\0' ? 0 : 1;
+}
+
+int requestCompile(const std::string& socketPath, const std::string& inFile, const std::string& outFile,
+                   bool stats, std::ostream& out) {
+	std::string payload = std::string("compile") + '\0' + absolutePath(inFile) + '\0' + absolutePath(outFile) +
+	                      '\0' + (stats ? "stats" : "");
+	std::string reply;
+	int         status = sendRequest(socketPath, payload, &reply);
+	if (status >= 0) {
+		out.write(reply.data() + 1, reply.size() - 1);
+	}
+	return status;
+}
+
+int requestShutdown(const std::string& socketPath) {
+	std::string reply;
+	return sendRequest(socketPath, "shutdown", &reply);
+}
+
+#else
+
+CompileServer::CompileServer(const std::string& socketPath, const CompileOptions& options)
+		: socketPath(socketPath), options(options) {
+}
+
+bool CompileServer::run(std::ostream&) {
+	std::cerr << "compile server mode needs Unix domain sockets\n";
+	return false;
+}
+
+std::string CompileServer::handleCompile(const std::vector<std::string>&, std::ostream&) {
+	return std::string();
+}
+
+int requestCompile(const std::string&, const std::string&, const std::string&, bool, std::ostream&) {
+	std::cerr << "compile server mode needs Unix domain sockets\n";
+	return -1;
+}
+
+int requestShutdown(const std::string&) {
+	return -1;
+}
+
+#endif
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,51 @@
+#pragma once
+#include "common.h"
+
+#include "driver/driver.h"
+
+#include <ostream>
+
+namespace dp {
+namespace internal {
+
+// A resident `dp` that compiles on request over a Unix domain socket. The
+// lexer and parser ATNs are deserialized and the prediction DFA is built up
+// once for the life of the process, so every request after the first parses
+// against a warm DFA instead of starting cold.
+//
+// Requests are served one at a time. Each one is a framed message (a 32-bit
+// length, then the payload) holding NUL-separated fields: the command,
+// followed for "compile" by the input path, output path and "stats" or "".
+// The reply is a status byte, 0 on success, followed by everything the
+// compilation printed.
+class CompileServer {
+public:
+	CompileServer(const std::string& socketPath, const CompileOptions& options);
+
+	// Serves requests until a client sends "shutdown". Writes one line per
+	// request to `log` with its latency, and the DFA hit rate for requests
+	// with stats, which are the only ones whose prediction is profiled.
+	// Returns false if the socket could not be set up.
+	bool run(std::ostream& log);
+
+private:
+	std::string handleCompile(const std::vector<std::string>& fields, std::ostream& log);
+
+	std::string    socketPath;
+	CompileOptions options;
+
+	size_t requests     = 0;
+	double totalSeconds = 0;
+};
+
+// Thin client: has the server at `socketPath` compile `inFile` to `outFile`
+// and copies what the compilation printed to `out`. Returns 0 on success, 1
+// if the compilation failed and -1 if the server could not be reached.
+int requestCompile(const std::string& socketPath, const std::string& inFile, const std::string& outFile,
+                   bool stats, std::ostream& out);
+
+// Asks the server at `socketPath` to exit. Returns -1 if it is unreachable.
+int requestShutdown(const std::string& socketPath);
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,296 @@
+#include "builder.h"
+#include "utils/symbol_table.h"
+
+#include <cstring>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+Builder::Builder(Function* function)
+		: function(function) {
+}
+
+BasicBlock* Builder::createBlock() {
+	function->blocks.emplace_back(new BasicBlock(function, function->blocks.size()));
+	return function->blocks.back().get();
+}
+
+void Builder::setInsertBlock(BasicBlock* block) {
+	current = block;
+}
+
+Instruction* Builder::append(BasicBlock* block, std::unique_ptr<Instruction> inst) {
+	inst->block = block;
+	block->insts.push_back(std::move(inst));
+	return block->insts.back().get();
+}
+
+Instruction* Builder::constant(PrimitiveVariableTypes type, uint64_t bits) {
+	std::unique_ptr<Instruction> inst(new Instruction(Opcode::Const, type));
+	inst->bits = bits;
+	return append(current, std::move(inst));
+}
+
+Instruction* Builder::binary(Opcode op, Instruction* left, Instruction* right) {
+	std::unique_ptr<Instruction> inst(new Instruction(op, left->type));
+	inst->addOperand(left);
+	inst->addOperand(right);
+	return append(current, std::move(inst));
+}
+
+Instruction* Builder::copy(Instruction* value) {
+	std::unique_ptr<Instruction> inst(new Instruction(Opcode::Copy, value->type));
+	inst->addOperand(value);
+	return append(current, std::move(inst));
+}
+
+void Builder::call(Symbol callee) {
+	std::unique_ptr<Instruction> inst(new Instruction(Opcode::Call, PrimitiveVariableTypes::Unit));
+	inst->callee = callee;
+	append(current, std::move(inst));
+}
+
+void Builder::br(BasicBlock* target) {
+	std::unique_ptr<Instruction> inst(new Instruction(Opcode::Br, PrimitiveVariableTypes::Unit));
+	inst->targets.push_back(target);
+	append(current, std::move(inst));
+	addEdge(current, target);
+}
+
+void Builder::brIf(Instruction* condition, BasicBlock* taken, BasicBlock* notTaken) {
+	std::unique_ptr<Instruction> inst(new Instruction(Opcode::BrIf, PrimitiveVariableTypes::Unit));
+	inst->addOperand(condition);
+	inst->targets.push_back(taken);
+	inst->targets.push_back(notTaken);
+	append(current, std::move(inst));
+	addEdge(current, taken);
+	addEdge(current, notTaken);
+}
+
+void Builder::ret() {
+	append(current, std::unique_ptr<Instruction>(new Instruction(Opcode::Return, PrimitiveVariableTypes::Unit)));
+}
+
+void Builder::addEdge(BasicBlock* from, BasicBlock* to) {
+	from->succs.push_back(to);
+	to->preds.push_back(from);
+}
+
+Builder::Variable Builder::newVariable(PrimitiveVariableTypes type) {
+	variableTypes.push_back(type);
+	definitions.emplace_back();
+	return static_cast<Variable>(variableTypes.size() - 1);
+}
+
+void Builder::writeVariable(Variable variable, Instruction* value) {
+	definitions[variable][current] = value;
+}
+
+Instruction* Builder::readVariable(Variable variable) {
+	return readVariable(variable, current);
+}
+
+Instruction* Builder::readVariable(Variable variable, BasicBlock* block) {
+	auto found = definitions[variable].find(block);
+	if (found != definitions[variable].end()) {
+		return found->second;
+	}
+
+	Instruction* value;
+	if (!sealed[block]) {
+		// More predecessors may come; the operands are filled in by sealBlock.
+		value = newPhi(variable, block);
+		incompletePhis[block].push_back(PendingPhi{ variable, value });
+	} else if (block->preds.size() == 1) {
+		value = readVariable(variable, block->preds[0]);
+	} else if (block->preds.empty()) {
+		// Read before any write on this path: the initial zero, defined at the
+		// top of the entry block so that it dominates every use.
+		std::unique_ptr<Instruction> zero(new Instruction(Opcode::Const, variableTypes[variable]));
+		zero->block = block;
+		block->insts.insert(block->insts.begin(), std::move(zero));
+		value = block->insts.front().get();
+	} else {
+		// Recorded before the operands are read, so a loop back to this block
+		// finds the phi instead of recursing forever.
+		value                        = newPhi(variable, block);
+		definitions[variable][block] = value;
+		addPhiOperands(variable, value);
+	}
+	definitions[variable][block] = value;
+	return value;
+}
+
+Instruction* Builder::newPhi(Variable variable, BasicBlock* block) {
+	auto position = block->insts.begin();
+	while (position != block->insts.end() && (*position)->op == Opcode::Phi) {
+		++position;
+	}
+	std::unique_ptr<Instruction> phi(new Instruction(Opcode::Phi, variableTypes[variable]));
+	phi->block = block;
+	return block->insts.insert(position, std::move(phi))->get();
+}
+
+void Builder::addPhiOperands(Variable variable, Instruction* phi) {
+	for (BasicBlock* pred : phi->block->preds) {
+		phi->addOperand(readVariable(variable, pred));
+	}
+}
+
+void Builder::sealBlock(BasicBlock* block) {
+	auto pending = incompletePhis.find(block);
+	if (pending != incompletePhis.end()) {
+		std::vector<PendingPhi> phis;
+		phis.swap(pending->second);
+		incompletePhis.erase(pending);
+		for (const PendingPhi& entry : phis) {
+			addPhiOperands(entry.variable, entry.phi);
+		}
+	}
+	sealed[block] = true;
+}
+
+// Strings are numbers in the IR: see StringPool::pack().
+static PrimitiveVariableTypes irType(PrimitiveVariableTypes type) {
+	return type == PrimitiveVariableTypes::Str ? PrimitiveVariableTypes::I64 : type;
+}
+
+namespace {
+
+// Walks the checked AST of one function and emits it into a single block,
+// in evaluation order. The lowering is literal: a `let` initialized from
+// another variable becomes a copy, and repeated subexpressions are computed
+// again. Cleaning that up is the job of the passes.
+class Lowering {
+public:
+	Lowering(Function* function, StringPool* strings)
+			: builder(function), strings(strings) {
+	}
+
+	void lowerBody(ExpressionStatement* body) {
+		BasicBlock* entry = builder.createBlock();
+		builder.setInsertBlock(entry);
+		builder.sealBlock(entry);
+		lowerExpression(body->expr);
+		builder.ret();
+	}
+
+private:
+	void lowerStatement(Statement* stmt) {
+		switch (stmt->kind()) {
+		case StatementKind::VariableDeclaration:
+			lowerVariable(static_cast<VariableDeclaration*>(stmt));
+			return;
+		case StatementKind::Expression:
+			lowerExpression(static_cast<ExpressionStatement*>(stmt)->expr);
+			return;
+		case StatementKind::FunctionDeclaration:
+			return;
+		}
+	}
+
+	void lowerVariable(VariableDeclaration* var) {
+		PrimitiveVariableTypes type     = irType(static_cast<VariableType*>(var->vartype)->typ);
+		Builder::Variable      variable = builder.newVariable(type);
+		// Bound before its initializer is lowered, as the checker binds it.
+		variables.insert(var->id.name, variable);
+
+		Instruction* value;
+		if (!var->init) {
+			value = builder.constant(type, 0);
+		} else {
+			value = lowerExpression(var->init);
+			if (var->init->kind() == ExpressionKind::Path) {
+				value = builder.copy(value);
+			}
+		}
+		builder.writeVariable(variable, value);
+	}
+
+	// Returns null for expressions of type ().
+	Instruction* lowerExpression(Expression* expr) {
+		switch (expr->kind()) {
+		case ExpressionKind::Literal:
+			return lowerLiteral(static_cast<LiteralExpression*>(expr));
+		case ExpressionKind::Path:
+			return builder.readVariable(*variables.lookup(static_cast<PathExpression*>(expr)->id.name));
+		case ExpressionKind::Binary: {
+			BinaryExpression* node  = static_cast<BinaryExpression*>(expr);
+			Instruction*      left  = lowerExpression(node->left);
+			Instruction*      right = lowerExpression(node->right);
+			Opcode            op    = static_cast<Opcode>(static_cast<uint8_t>(Opcode::Add) + static_cast<uint8_t>(node->op));
+			return builder.binary(op, left, right);
+		}
+		case ExpressionKind::Block: {
+			variables.enterScope();
+			for (Statement* stmt : static_cast<BlockExpession*>(expr)->stmts) {
+				lowerStatement(stmt);
+			}
+			variables.exitScope();
+			return nullptr;
+		}
+		case ExpressionKind::Call:
+			// The checker only accepts calls of a function by name, without
+			// arguments.
+			builder.call(static_cast<PathExpression*>(static_cast<CallExpression*>(expr)->method)->id.name);
+			return nullptr;
+		default:
+			return nullptr;
+		}
+	}
+
+	Instruction* lowerLiteral(LiteralExpression* lit) {
+		switch (lit->typ) {
+		case LiteralExpression::Typ::DPI32:
+			return builder.constant(PrimitiveVariableTypes::I32, static_cast<uint32_t>(lit->i32val));
+		case LiteralExpression::Typ::DPI64:
+			return builder.constant(PrimitiveVariableTypes::I64, static_cast<uint64_t>(lit->i64val));
+		case LiteralExpression::Typ::DPF32: {
+			uint32_t bits;
+			std::memcpy(&bits, &lit->f32val, sizeof(bits));
+			return builder.constant(PrimitiveVariableTypes::F32, bits);
+		}
+		case LiteralExpression::Typ::DPString: {
+			// Stored once however often it is used, and never built at run
+			// time.
+			std::string text    = lit->strval.str();
+			uint32_t    address = strings->intern(text);
+			return builder.constant(PrimitiveVariableTypes::I64,
+			                        StringPool::pack(address, static_cast<uint32_t>(text.size())));
+		}
+		default: {
+			uint64_t bits;
+			std::memcpy(&bits, &lit->f64val, sizeof(bits));
+			return builder.constant(PrimitiveVariableTypes::F64, bits);
+		}
+		}
+	}
+
+	Builder                              builder;
+	StringPool*                          strings;
+	ScopedSymbolTable<Builder::Variable> variables;
+};
+
+} // namespace
+
+std::unique_ptr<Function> lowerFunction(FunctionDeclaration* fun, StringPool* strings) {
+	std::unique_ptr<Function> function(new Function(fun->id.str()));
+	function->isPublic = fun->isPublic;
+	Lowering(function.get(), strings).lowerBody(fun->body);
+	return function;
+}
+
+std::unique_ptr<Module> lowerModule(internal::Module* module) {
+	std::unique_ptr<Module> lowered(new Module());
+	for (Statement* stmt : module->stmts) {
+		if (stmt->kind() == StatementKind::FunctionDeclaration) {
+			lowered->functions.push_back(lowerFunction(static_cast<FunctionDeclaration*>(stmt), &lowered->strings));
+		}
+	}
+	return lowered;
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,79 @@
+#pragma once
+#include "common.h"
+
+#include "ast/ast.h"
+#include "ir/ir.h"
+
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+// Appends instructions to a Function and builds SSA form on the fly, after
+// Braun et al., "Simple and Efficient Construction of Static Single
+// Assignment Form". Source variables are written and read through the
+// builder; a read finds the reaching definition itself and places a phi
+// where control flow merges. A block is sealed once all of its
+// predecessors are known, and phis asked for before that are completed
+// then.
+//
+// Phis with a single distinct operand are left in place for
+// propagateCopies to remove.
+class Builder {
+public:
+	typedef uint32_t Variable;
+
+	explicit Builder(Function* function);
+
+	BasicBlock* createBlock();
+	void        setInsertBlock(BasicBlock* block);
+	BasicBlock* insertBlock() const {
+		return current;
+	}
+
+	Instruction* constant(PrimitiveVariableTypes type, uint64_t bits);
+	Instruction* binary(Opcode op, Instruction* left, Instruction* right);
+	Instruction* copy(Instruction* value);
+	void         call(Symbol callee);
+	void         br(BasicBlock* target);
+	void         brIf(Instruction* condition, BasicBlock* taken, BasicBlock* notTaken);
+	void         ret();
+
+	// Variables start at zero, like wasm locals.
+	Variable     newVariable(PrimitiveVariableTypes type);
+	void         writeVariable(Variable variable, Instruction* value);
+	Instruction* readVariable(Variable variable);
+	void         sealBlock(BasicBlock* block);
+
+private:
+	Instruction* append(BasicBlock* block, std::unique_ptr<Instruction> inst);
+	Instruction* readVariable(Variable variable, BasicBlock* block);
+	Instruction* newPhi(Variable variable, BasicBlock* block);
+	void         addPhiOperands(Variable variable, Instruction* phi);
+	void         addEdge(BasicBlock* from, BasicBlock* to);
+
+	struct PendingPhi {
+		Variable     variable;
+		Instruction* phi;
+	};
+
+	Function*   function;
+	BasicBlock* current = nullptr;
+
+	std::vector<PrimitiveVariableTypes>                              variableTypes;
+	std::vector<std::unordered_map<const BasicBlock*, Instruction*>> definitions; // by variable
+	std::unordered_map<const BasicBlock*, std::vector<PendingPhi>>   incompletePhis;
+	std::unordered_map<const BasicBlock*, bool>                      sealed;
+};
+
+// Lowers every function of a module the TypeChecker accepted. Statements
+// outside functions produce no code. A string literal becomes a constant
+// that StringPool::pack()s where its bytes are in `strings`, the module's
+// own for lowerModule.
+std::unique_ptr<Module>   lowerModule(internal::Module* module);
+std::unique_ptr<Function> lowerFunction(FunctionDeclaration* fun, StringPool* strings);
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,84 @@
+#include "dominators.h"
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+DominatorTree::DominatorTree(const Function& function)
+		: order(function.blocks.size()), idom(function.blocks.size()), children_(function.blocks.size()) {
+	std::vector<BasicBlock*>                    postorder;
+	std::vector<bool>                           visited(function.blocks.size());
+	std::vector<std::pair<BasicBlock*, size_t>> stack;
+	stack.emplace_back(function.entry(), 0);
+	visited[function.entry()->index] = true;
+	while (!stack.empty()) {
+		BasicBlock* block = stack.back().first;
+		size_t&     next  = stack.back().second;
+		if (next < block->succs.size()) {
+			BasicBlock* succ = block->succs[next++];
+			if (!visited[succ->index]) {
+				visited[succ->index] = true;
+				stack.emplace_back(succ, 0);
+			}
+		} else {
+			postorder.push_back(block);
+			stack.pop_back();
+		}
+	}
+	rpo.assign(postorder.rbegin(), postorder.rend());
+	for (size_t i = 0; i < rpo.size(); i++) {
+		order[rpo[i]->index] = i;
+	}
+
+	idom[rpo[0]->index] = rpo[0];
+	bool changed        = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = 1; i < rpo.size(); i++) {
+			BasicBlock* block     = rpo[i];
+			BasicBlock* dominator = nullptr;
+			for (BasicBlock* pred : block->preds) {
+				if (!idom[pred->index]) {
+					continue;
+				}
+				if (!dominator) {
+					dominator = pred;
+					continue;
+				}
+				BasicBlock* other = pred;
+				while (dominator != other) {
+					while (order[dominator->index] > order[other->index]) {
+						dominator = idom[dominator->index];
+					}
+					while (order[other->index] > order[dominator->index]) {
+						other = idom[other->index];
+					}
+				}
+			}
+			if (idom[block->index] != dominator) {
+				idom[block->index] = dominator;
+				changed            = true;
+			}
+		}
+	}
+
+	for (size_t i = 1; i < rpo.size(); i++) {
+		children_[idom[rpo[i]->index]->index].push_back(rpo[i]);
+	}
+}
+
+bool DominatorTree::dominates(const BasicBlock* dominator, const BasicBlock* block) const {
+	if (!idom[block->index] || !idom[dominator->index]) {
+		return false;
+	}
+	// Dominators come first in reverse postorder, so the walk up stops once
+	// it passes `dominator`.
+	while (order[block->index] > order[dominator->index]) {
+		block = idom[block->index];
+	}
+	return block == dominator;
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,42 @@
+#pragma once
+#include "common.h"
+
+#include "ir/ir.h"
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+// The dominator tree of the blocks reachable from the entry, after Cooper,
+// Harvey and Kennedy, "A Simple, Fast Dominance Algorithm". Blocks that
+// cannot be reached have no immediate dominator and dominate nothing.
+class DominatorTree {
+public:
+	explicit DominatorTree(const Function& function);
+
+	// Reachable blocks, each before its successors unless the edge closes a
+	// loop.
+	const std::vector<BasicBlock*>& reversePostorder() const {
+		return rpo;
+	}
+
+	// The entry is its own.
+	BasicBlock* immediateDominator(const BasicBlock* block) const {
+		return idom[block->index];
+	}
+	const std::vector<BasicBlock*>& children(const BasicBlock* block) const {
+		return children_[block->index];
+	}
+
+	bool dominates(const BasicBlock* dominator, const BasicBlock* block) const;
+
+private:
+	std::vector<BasicBlock*>              rpo;
+	std::vector<size_t>                   order; // position in rpo, by block index
+	std::vector<BasicBlock*>              idom;
+	std::vector<std::vector<BasicBlock*>> children_;
+};
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,152 @@
+#include "inliner.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+namespace {
+
+class Inliner {
+public:
+	Inliner(Module* module, const InlineOptions& options)
+			: module(module), options(options) {
+	}
+
+	size_t run() {
+		for (auto& function : module->functions) {
+			functions[Symbol::intern(function->name)] = function.get();
+		}
+		size_t sites = 0;
+		for (Function* function : calleesFirst()) {
+			for (auto& block : function->blocks) {
+				sites += inlineInto(block.get());
+			}
+			finished.insert(function);
+		}
+		return sites;
+	}
+
+private:
+	// Every function after the ones it calls, except where a call closes a
+	// cycle. Counts the calls of each function on the way.
+	std::vector<Function*> calleesFirst() {
+		std::unordered_map<Function*, std::vector<Function*>> callees;
+		for (auto& function : module->functions) {
+			for (auto& block : function->blocks) {
+				for (auto& inst : block->insts) {
+					if (inst->op != Opcode::Call) {
+						continue;
+					}
+					auto found = functions.find(inst->callee);
+					if (found != functions.end()) {
+						callees[function.get()].push_back(found->second);
+						callCounts[found->second]++;
+					}
+				}
+			}
+		}
+
+		std::vector<Function*>                    postorder;
+		std::unordered_set<Function*>             visited;
+		std::vector<std::pair<Function*, size_t>> stack;
+		for (auto& root : module->functions) {
+			if (!visited.insert(root.get()).second) {
+				continue;
+			}
+			stack.emplace_back(root.get(), 0);
+			while (!stack.empty()) {
+				Function*                     function = stack.back().first;
+				size_t&                       next     = stack.back().second;
+				const std::vector<Function*>& calls    = callees[function];
+				if (next < calls.size()) {
+					Function* callee = calls[next++];
+					if (visited.insert(callee).second) {
+						stack.emplace_back(callee, 0);
+					}
+				} else {
+					postorder.push_back(function);
+					stack.pop_back();
+				}
+			}
+		}
+		return postorder;
+	}
+
+	// The function `name` if calls of it should be inlined. Only finished
+	// functions qualify, which rules out calls that close a cycle.
+	Function* inlinable(Symbol name) const {
+		auto found = functions.find(name);
+		if (found == functions.end() || !finished.count(found->second)) {
+			return nullptr;
+		}
+		Function* callee = found->second;
+		if (callee->blocks.size() != 1 || callee->entry()->terminator()->op != Opcode::Return) {
+			return nullptr;
+		}
+		size_t size = callee->entry()->insts.size() - 1;
+		return size * callCounts.at(callee) <= options.budget ? callee : nullptr;
+	}
+
+	size_t inlineInto(BasicBlock* block) {
+		std::vector<std::unique_ptr<Instruction>> insts;
+		insts.reserve(block->insts.size());
+		size_t sites = 0;
+		for (auto& inst : block->insts) {
+			Function* callee = inst->op == Opcode::Call ? inlinable(inst->callee) : nullptr;
+			if (!callee) {
+				insts.push_back(std::move(inst));
+				continue;
+			}
+			inst->dropOperands();
+			cloneBody(*callee, block, &insts);
+			sites++;
+		}
+		block->insts.swap(insts);
+		return sites;
+	}
+
+	// Appends a copy of the single block of `callee`, without its return.
+	static void cloneBody(const Function& callee, BasicBlock* block, std::vector<std::unique_ptr<Instruction>>* insts) {
+		std::unordered_map<const Instruction*, Instruction*> clones;
+		for (auto& inst : callee.entry()->insts) {
+			if (inst->isTerminator()) {
+				break;
+			}
+			std::unique_ptr<Instruction> clone(new Instruction(inst->op, inst->type));
+			clone->bits   = inst->bits;
+			clone->callee = inst->callee;
+			clone->block  = block;
+			for (Instruction* operand : inst->operands()) {
+				clone->addOperand(clones.at(operand));
+			}
+			clones[inst.get()] = clone.get();
+			insts->push_back(std::move(clone));
+		}
+	}
+
+	Module*              module;
+	const InlineOptions& options;
+
+	std::unordered_map<Symbol, Function*, SymbolHash> functions;
+	std::unordered_map<const Function*, size_t>       callCounts;
+	std::unordered_set<const Function*>               finished; // nothing more is inlined into them
+};
+
+} // namespace
+
+void inlineCalls(Module* module, const InlineOptions& options, InlineStats* stats) {
+	stats->sites += Inliner(module, options).run();
+	stats->instructions = module->instructionCount();
+}
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const InlineStats& stats) {
+	sink << "inline: " << stats.sites << " call sites inlined, " << stats.instructions << " instructions\n";
+	return sink;
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,34 @@
+#pragma once
+#include "common.h"
+
+#include "ir/ir.h"
+#include "utils/diagnostics.h"
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+struct InlineOptions {
+	// How many instructions inlining one function may add to the module: its
+	// size times the number of calls to it. 0 still inlines functions whose
+	// body is empty.
+	size_t budget = 64;
+};
+
+struct InlineStats {
+	size_t sites        = 0; // calls replaced by the body of the function
+	size_t instructions = 0; // in the module afterwards
+};
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const InlineStats& stats);
+
+// Replaces calls by the body of the function called where that fits in the
+// budget. Functions are visited callees first, so a body is inlined with
+// what was already inlined into it; calls that close a cycle are kept, as
+// are calls of functions with more than one block. The callee stays in the
+// module, as every function is exported.
+void inlineCalls(Module* module, const InlineOptions& options, InlineStats* stats);
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
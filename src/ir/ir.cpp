@@ -0,0 +1,220 @@
+#include "ir.h"
+
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+const char* opcodeName(Opcode op) {
+	switch (op) {
+	case Opcode::Const:
+		return "const";
+	case Opcode::Add:
+		return "add";
+	case Opcode::Sub:
+		return "sub";
+	case Opcode::Mul:
+		return "mul";
+	case Opcode::Div:
+		return "div";
+	case Opcode::And:
+		return "and";
+	case Opcode::Or:
+		return "or";
+	case Opcode::Shl:
+		return "shl";
+	case Opcode::Copy:
+		return "copy";
+	case Opcode::Phi:
+		return "phi";
+	case Opcode::Call:
+		return "call";
+	case Opcode::Br:
+		return "br";
+	case Opcode::BrIf:
+		return "br_if";
+	case Opcode::Return:
+		return "return";
+	}
+	return "?";
+}
+
+bool Instruction::hasSideEffects() const {
+	if (isTerminator() || op == Opcode::Call) {
+		return true;
+	}
+	if (op != Opcode::Div || type == PrimitiveVariableTypes::F32 || type == PrimitiveVariableTypes::F64) {
+		return false;
+	}
+	Instruction* divisor = operand(1);
+	if (divisor->op != Opcode::Const) {
+		return true;
+	}
+	uint64_t minusOne = type == PrimitiveVariableTypes::I32 ? 0xffffffffu : ~uint64_t(0);
+	return divisor->bits == 0 || divisor->bits == minusOne;
+}
+
+void Instruction::addOperand(Instruction* value) {
+	operands_.push_back(value);
+	value->users_.push_back(this);
+}
+
+void Instruction::setOperand(size_t i, Instruction* value) {
+	operands_[i]->removeUser(this);
+	operands_[i] = value;
+	value->users_.push_back(this);
+}
+
+void Instruction::dropOperands() {
+	for (Instruction* operand : operands_) {
+		operand->removeUser(this);
+	}
+	operands_.clear();
+}
+
+void Instruction::removeUser(Instruction* user) {
+	auto found = std::find(users_.begin(), users_.end(), user);
+	users_.erase(found);
+}
+
+void Instruction::replaceAllUsesWith(Instruction* value) {
+	std::vector<Instruction*> users;
+	users.swap(users_);
+	for (Instruction* user : users) {
+		// A user listed twice is rewritten completely the first time.
+		for (Instruction*& operand : user->operands_) {
+			if (operand == this) {
+				operand = value;
+				value->users_.push_back(user);
+			}
+		}
+	}
+}
+
+size_t Function::instructionCount() const {
+	size_t count = 0;
+	for (auto& block : blocks) {
+		count += block->insts.size();
+	}
+	return count;
+}
+
+static std::string constantText(const Instruction* inst) {
+	std::ostringstream text;
+	switch (inst->type) {
+	case PrimitiveVariableTypes::I32:
+		text << static_cast<int32_t>(inst->bits);
+		break;
+	case PrimitiveVariableTypes::I64:
+		text << static_cast<int64_t>(inst->bits);
+		break;
+	case PrimitiveVariableTypes::F32: {
+		uint32_t bits = static_cast<uint32_t>(inst->bits);
+		float    value;
+		std::memcpy(&value, &bits, sizeof(value));
+		text.precision(9);
+		text << value;
+		break;
+	}
+	case PrimitiveVariableTypes::F64: {
+		double value;
+		std::memcpy(&value, &inst->bits, sizeof(value));
+		text.precision(17);
+		text << value;
+		break;
+	}
+	case PrimitiveVariableTypes::Unit:
+	case PrimitiveVariableTypes::Str:
+		break;
+	}
+	return text.str();
+}
+
+// Values are numbered in order of definition each time the function is
+// printed, so the text does not depend on what passes ran before.
+void Function::print(std::ostream& out) const {
+	std::unordered_map<const Instruction*, size_t> numbers;
+	for (auto& block : blocks) {
+		for (auto& inst : block->insts) {
+			if (inst->hasResult()) {
+				size_t number = numbers.size();
+				numbers[inst.get()] = number;
+			}
+		}
+	}
+
+	out << (isPublic ? "export function " : "function ") << name << "() {\n";
+	for (auto& block : blocks) {
+		out << "bb" << block->index << ":";
+		for (size_t i = 0; i < block->preds.size(); i++) {
+			out << (i ? ", bb" : "  ; preds bb") << block->preds[i]->index;
+		}
+		out << "\n";
+		for (auto& inst : block->insts) {
+			out << "  ";
+			if (inst->hasResult()) {
+				out << "%" << numbers[inst.get()] << " = ";
+			}
+			out << opcodeName(inst->op);
+			if (inst->hasResult()) {
+				out << " " << typeName(inst->type);
+			}
+			if (inst->op == Opcode::Const) {
+				out << " " << constantText(inst.get());
+			} else if (inst->op == Opcode::Call) {
+				out << " " << inst->callee.str();
+			}
+			for (size_t i = 0; i < inst->operands().size(); i++) {
+				out << (i ? ", " : " ");
+				if (inst->op == Opcode::Phi) {
+					out << "[%" << numbers[inst->operand(i)] << ", bb" << block->preds[i]->index << "]";
+				} else {
+					out << "%" << numbers[inst->operand(i)];
+				}
+			}
+			for (size_t i = 0; i < inst->targets.size(); i++) {
+				out << (i || inst->operands().size() ? ", bb" : " bb") << inst->targets[i]->index;
+			}
+			out << "\n";
+		}
+	}
+	out << "}\n";
+}
+
+size_t Module::instructionCount() const {
+	size_t count = 0;
+	for (auto& function : functions) {
+		count += function->instructionCount();
+	}
+	return count;
+}
+
+uint32_t StringPool::intern(const std::string& text) {
+	auto found = offsets.find(text);
+	if (found != offsets.end()) {
+		return found->second;
+	}
+	uint32_t offset = static_cast<uint32_t>(data_.size());
+	data_ += text;
+	offsets.emplace(text, offset);
+	return offset;
+}
+
+void Module::print(std::ostream& out) const {
+	if (!strings.data().empty()) {
+		out << "data \"" << strings.data() << "\"\n\n";
+	}
+	for (size_t i = 0; i < functions.size(); i++) {
+		if (i) {
+			out << "\n";
+		}
+		functions[i]->print(out);
+	}
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,214 @@
+#pragma once
+#include "common.h"
+
+#include "ast/type.h"
+#include "utils/symbol.h"
+
+#include <algorithm>
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+// SSA-form IR that sits between the AST and wabt. The AST is lowered into it
+// (builder.h), the passes in passes.h rewrite it, and codegen emits wasm
+// from it. Every value is the result of exactly one instruction, and every
+// instruction knows both the values it uses and the instructions that use
+// it, so a pass can replace a value everywhere in one step.
+
+enum class Opcode : uint8_t {
+	Const,
+	// Binary operators, in the order of BinaryOperator.
+	Add,
+	Sub,
+	Mul,
+	Div,
+	And,
+	Or,
+	Shl,
+	Copy,
+	Phi,
+	Call,
+	// Terminators, exactly one at the end of every block.
+	Br,
+	BrIf,
+	Return,
+};
+
+const char* opcodeName(Opcode op);
+
+class BasicBlock;
+
+class Instruction {
+public:
+	Instruction(Opcode op, PrimitiveVariableTypes type)
+			: op(op), type(type) {
+	}
+	Instruction(const Instruction&) = delete;
+	Instruction& operator=(const Instruction&) = delete;
+
+	bool isBinary() const {
+		return op >= Opcode::Add && op <= Opcode::Shl;
+	}
+	bool isTerminator() const {
+		return op >= Opcode::Br;
+	}
+	bool hasResult() const {
+		return type != PrimitiveVariableTypes::Unit;
+	}
+
+	// Whether removing the instruction could change what the program does.
+	// Integer division traps on a zero divisor and on INT_MIN / -1, so it
+	// counts unless the divisor is a constant that rules both out. Calls
+	// always count.
+	bool hasSideEffects() const;
+
+	const std::vector<Instruction*>& operands() const {
+		return operands_;
+	}
+	Instruction* operand(size_t i) const {
+		return operands_[i];
+	}
+	void addOperand(Instruction* value);
+	void setOperand(size_t i, Instruction* value);
+	void dropOperands();
+
+	// One entry per use, so an instruction that uses a value twice is listed
+	// twice.
+	const std::vector<Instruction*>& users() const {
+		return users_;
+	}
+
+	// Makes every user of this instruction use `value` instead.
+	void replaceAllUsesWith(Instruction* value);
+
+	Opcode                 op;
+	PrimitiveVariableTypes type;  // Unit for instructions without a result
+	uint64_t               bits  = 0;  // Const: the value, as wasm stores it
+	BasicBlock*            block = nullptr;
+	Symbol                 callee; // Call: the function called, by name
+
+	// Br: the target. BrIf: taken, then not taken; the condition is the
+	// operand. Phi: unused, its operands follow the block's predecessors.
+	std::vector<BasicBlock*> targets;
+
+private:
+	void removeUser(Instruction* user);
+
+	std::vector<Instruction*> operands_;
+	std::vector<Instruction*> users_;
+};
+
+class Function;
+
+class BasicBlock {
+public:
+	explicit BasicBlock(Function* function, size_t index)
+			: function(function), index(index) {
+	}
+
+	BasicBlock(const BasicBlock&) = delete;
+	BasicBlock& operator=(const BasicBlock&) = delete;
+
+	Instruction* terminator() const {
+		return insts.empty() || !insts.back()->isTerminator() ? nullptr : insts.back().get();
+	}
+
+	Function*                                 function;
+	size_t                                    index;
+	std::vector<std::unique_ptr<Instruction>> insts;
+	std::vector<BasicBlock*>                  preds;
+	std::vector<BasicBlock*>                  succs;
+};
+
+class Function {
+public:
+	explicit Function(const std::string& name)
+			: name(name) {
+	}
+
+	BasicBlock* entry() const {
+		return blocks.front().get();
+	}
+
+	// Removes every instruction `dead` selects. Nothing else may still use
+	// them. Returns how many were removed.
+	template <typename Predicate>
+	size_t removeIf(Predicate dead);
+
+	size_t instructionCount() const;
+	void   print(std::ostream& out) const;
+
+	std::string                              name;
+	bool                                     isPublic = false;
+	std::vector<std::unique_ptr<BasicBlock>> blocks;
+};
+
+// The read-only data of a module: the bytes of its string literals, each
+// distinct literal stored once, in the order they were first lowered. The
+// data is placed at address 0 of linear memory, so an offset is also an
+// address.
+class StringPool {
+public:
+	// The offset of `text`, which is added if it is new.
+	uint32_t intern(const std::string& text);
+
+	const std::string& data() const {
+		return data_;
+	}
+	// Distinct literals.
+	size_t size() const {
+		return offsets.size();
+	}
+
+	// A string value: the address in the low half, the length in the high
+	// half.
+	static uint64_t pack(uint32_t address, uint32_t length) {
+		return static_cast<uint64_t>(length) << 32 | address;
+	}
+
+private:
+	std::string                               data_;
+	std::unordered_map<std::string, uint32_t> offsets;
+};
+
+class Module {
+public:
+	size_t instructionCount() const;
+	void   print(std::ostream& out) const;
+
+	std::vector<std::unique_ptr<Function>> functions;
+	StringPool                             strings;
+};
+
+template <typename Predicate>
+size_t Function::removeIf(Predicate dead) {
+	// Operands are dropped first everywhere, as the selection may use itself
+	// across blocks.
+	std::unordered_set<Instruction*> removed;
+	for (auto& block : blocks) {
+		for (auto& inst : block->insts) {
+			if (dead(inst.get())) {
+				removed.insert(inst.get());
+			}
+		}
+	}
+	for (Instruction* inst : removed) {
+		inst->dropOperands();
+	}
+	for (auto& block : blocks) {
+		auto end = std::remove_if(block->insts.begin(), block->insts.end(),
+		                          [&](const std::unique_ptr<Instruction>& inst) {
+			                          return removed.count(inst.get()) != 0;
+		                          });
+		block->insts.erase(end, block->insts.end());
+	}
+	return removed.size();
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
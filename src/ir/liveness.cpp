@@ -0,0 +1,70 @@
+#include "liveness.h"
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+Liveness::Liveness(const Function& function)
+		: in(function.blocks.size()), out(function.blocks.size()) {
+	size_t count = function.blocks.size();
+
+	// Per block: phi results, every result, the values used before being
+	// defined in the block, and the operands its successors' phis take
+	// from it.
+	std::vector<ValueSet> phiDefs(count);
+	std::vector<ValueSet> defs(count);
+	std::vector<ValueSet> upward(count);
+	std::vector<ValueSet> phiUses(count);
+	for (auto& block : function.blocks) {
+		size_t index = block->index;
+		for (auto& inst : block->insts) {
+			if (inst->op == Opcode::Phi) {
+				phiDefs[index].insert(inst.get());
+				for (size_t i = 0; i < inst->operands().size(); i++) {
+					phiUses[block->preds[i]->index].insert(inst->operand(i));
+				}
+			} else {
+				for (Instruction* operand : inst->operands()) {
+					if (!defs[index].count(operand)) {
+						upward[index].insert(operand);
+					}
+				}
+			}
+			defs[index].insert(inst.get());
+		}
+	}
+
+	// Iterated backwards to a fixed point; blocks are mostly numbered in
+	// control-flow order, so this settles in a few rounds.
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (size_t i = count; i-- > 0;) {
+			const BasicBlock* block   = function.blocks[i].get();
+			ValueSet          liveOut = phiUses[i];
+			for (const BasicBlock* succ : block->succs) {
+				for (const Instruction* value : in[succ->index]) {
+					if (!phiDefs[succ->index].count(value)) {
+						liveOut.insert(value);
+					}
+				}
+			}
+			ValueSet liveIn = phiDefs[i];
+			liveIn.insert(upward[i].begin(), upward[i].end());
+			for (const Instruction* value : liveOut) {
+				if (!defs[i].count(value)) {
+					liveIn.insert(value);
+				}
+			}
+			if (liveIn.size() != in[i].size() || liveOut.size() != out[i].size()) {
+				in[i].swap(liveIn);
+				out[i].swap(liveOut);
+				changed = true;
+			}
+		}
+	}
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
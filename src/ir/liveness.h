@@ -0,0 +1,36 @@
+#pragma once
+#include "common.h"
+
+#include "ir/ir.h"
+
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+// The values live on entry to and on exit from each block. A phi's result
+// is live on entry to its block, and the operand it takes from a
+// predecessor is live on exit from that predecessor, not on entry to the
+// phi's block.
+class Liveness {
+public:
+	typedef std::unordered_set<const Instruction*> ValueSet;
+
+	explicit Liveness(const Function& function);
+
+	const ValueSet& liveIn(const BasicBlock* block) const {
+		return in[block->index];
+	}
+	const ValueSet& liveOut(const BasicBlock* block) const {
+		return out[block->index];
+	}
+
+private:
+	std::vector<ValueSet> in;
+	std::vector<ValueSet> out;
+};
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
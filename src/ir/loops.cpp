@@ -0,0 +1,228 @@
+#include "loops.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+std::vector<Loop> findLoops(const DominatorTree& dominators) {
+	std::vector<Loop>                             loops;
+	std::unordered_map<const BasicBlock*, size_t> byHeader;
+	std::vector<BasicBlock*>                      worklist;
+	for (BasicBlock* block : dominators.reversePostorder()) {
+		for (BasicBlock* header : block->succs) {
+			if (!dominators.dominates(header, block)) {
+				continue;
+			}
+			auto found = byHeader.find(header);
+			if (found == byHeader.end()) {
+				found = byHeader.emplace(header, loops.size()).first;
+				loops.emplace_back();
+				loops.back().header = header;
+				loops.back().blocks.insert(header);
+			}
+			Loop& loop = loops[found->second];
+			if (std::find(loop.latches.begin(), loop.latches.end(), block) != loop.latches.end()) {
+				continue;
+			}
+			loop.latches.push_back(block);
+
+			// Everything that reaches the latch without passing through the
+			// header, which is already in the loop.
+			worklist.push_back(block);
+			while (!worklist.empty()) {
+				BasicBlock* member = worklist.back();
+				worklist.pop_back();
+				if (!loop.blocks.insert(member).second) {
+					continue;
+				}
+				for (BasicBlock* pred : member->preds) {
+					if (dominators.immediateDominator(pred)) {
+						worklist.push_back(pred);
+					}
+				}
+			}
+		}
+	}
+
+	for (Loop& loop : loops) {
+		BasicBlock* outside = nullptr;
+		size_t      entries = 0;
+		for (BasicBlock* pred : loop.header->preds) {
+			if (!loop.contains(pred)) {
+				outside = pred;
+				entries++;
+			}
+		}
+		if (entries == 1 && outside->succs.size() == 1) {
+			loop.preheader = outside;
+		}
+	}
+	// A loop nested in another has fewer blocks.
+	std::stable_sort(loops.begin(), loops.end(),
+	                 [](const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+	return loops;
+}
+
+static Instruction* insertBeforeTerminator(BasicBlock* block, std::unique_ptr<Instruction> inst) {
+	inst->block = block;
+	return block->insts.insert(block->insts.end() - 1, std::move(inst))->get();
+}
+
+static bool isInvariant(const Instruction* inst, const Loop& loop) {
+	if (inst->op == Opcode::Phi || inst->isTerminator() || inst->hasSideEffects()) {
+		return false;
+	}
+	for (const Instruction* operand : inst->operands()) {
+		if (loop.contains(operand->block)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t hoistLoopInvariants(Function* function) {
+	DominatorTree dominators(*function);
+	size_t        hoisted = 0;
+	for (const Loop& loop : findLoops(dominators)) {
+		if (!loop.preheader) {
+			continue;
+		}
+		// Definitions before uses, so an instruction is seen after the
+		// operands that were moved before it.
+		std::vector<std::unique_ptr<Instruction>> moved;
+		for (BasicBlock* block : dominators.reversePostorder()) {
+			if (!loop.contains(block)) {
+				continue;
+			}
+			auto&  insts = block->insts;
+			size_t kept  = 0;
+			for (size_t i = 0; i < insts.size(); i++) {
+				if (isInvariant(insts[i].get(), loop)) {
+					insts[i]->block = loop.preheader;
+					moved.push_back(std::move(insts[i]));
+				} else {
+					insts[kept++] = std::move(insts[i]);
+				}
+			}
+			insts.resize(kept);
+		}
+		for (auto& inst : moved) {
+			// Constants go along for the instructions that use them, but
+			// codegen computes a constant again at each use anyway.
+			if (inst->op != Opcode::Const) {
+				hoisted++;
+			}
+			insertBeforeTerminator(loop.preheader, std::move(inst));
+		}
+	}
+	return hoisted;
+}
+
+namespace {
+
+// i = phi [init, preheader], [i + step, latch], with a constant step.
+struct Induction {
+	Instruction* init;
+	Instruction* step;
+};
+
+} // namespace
+
+static bool isBasicInduction(Instruction* phi, const Loop& loop, BasicBlock* latch, Induction* induction) {
+	if (phi->type != PrimitiveVariableTypes::I32 && phi->type != PrimitiveVariableTypes::I64) {
+		return false;
+	}
+	const std::vector<BasicBlock*>& preds = loop.header->preds;
+	if (preds.size() != 2) {
+		return false;
+	}
+	size_t       fromLatch = preds[0] == latch ? 0 : 1;
+	Instruction* next      = phi->operand(fromLatch);
+	if (next->op != Opcode::Add || !loop.contains(next->block)) {
+		return false;
+	}
+	Instruction* step = next->operand(0) == phi ? next->operand(1) : next->operand(1) == phi ? next->operand(0) : nullptr;
+	if (!step || step->op != Opcode::Const) {
+		return false;
+	}
+	induction->init = phi->operand(1 - fromLatch);
+	induction->step = step;
+	return true;
+}
+
+size_t reduceStrength(Function* function) {
+	DominatorTree dominators(*function);
+	size_t        reduced = 0;
+	for (const Loop& loop : findLoops(dominators)) {
+		if (!loop.preheader || loop.latches.size() != 1) {
+			continue;
+		}
+		BasicBlock*               latch = loop.latches[0];
+		std::vector<Instruction*> phis;
+		for (auto& inst : loop.header->insts) {
+			if (inst->op == Opcode::Phi) {
+				phis.push_back(inst.get());
+			}
+		}
+		for (Instruction* phi : phis) {
+			Induction induction;
+			if (!isBasicInduction(phi, loop, latch, &induction)) {
+				continue;
+			}
+			std::vector<Instruction*> products;
+			for (Instruction* user : phi->users()) {
+				if (user->op == Opcode::Mul && loop.contains(user->block) &&
+				    (user->operand(0) == phi ? user->operand(1) : user->operand(0))->op == Opcode::Const &&
+				    std::find(products.begin(), products.end(), user) == products.end()) {
+					products.push_back(user);
+				}
+			}
+			for (Instruction* product : products) {
+				Instruction* factor = product->operand(0) == phi ? product->operand(1) : product->operand(0);
+
+				// The factor is defined inside the loop, so the preheader gets
+				// a constant of its own.
+				std::unique_ptr<Instruction> factorConst(new Instruction(Opcode::Const, phi->type));
+				factorConst->bits = factor->bits;
+				Instruction* factorValue = insertBeforeTerminator(loop.preheader, std::move(factorConst));
+
+				std::unique_ptr<Instruction> start(new Instruction(Opcode::Mul, phi->type));
+				start->addOperand(induction.init);
+				start->addOperand(factorValue);
+				Instruction* first = insertBeforeTerminator(loop.preheader, std::move(start));
+
+				uint64_t stride = induction.step->bits * factor->bits;
+				if (phi->type == PrimitiveVariableTypes::I32) {
+					stride &= 0xffffffffu;
+				}
+				std::unique_ptr<Instruction> strideConst(new Instruction(Opcode::Const, phi->type));
+				strideConst->bits = stride;
+				Instruction* strideValue = insertBeforeTerminator(latch, std::move(strideConst));
+
+				std::unique_ptr<Instruction> derived(new Instruction(Opcode::Phi, phi->type));
+				derived->block         = loop.header;
+				Instruction* scaled    = derived.get();
+				loop.header->insts.insert(loop.header->insts.begin(), std::move(derived));
+
+				std::unique_ptr<Instruction> step(new Instruction(Opcode::Add, phi->type));
+				step->addOperand(scaled);
+				step->addOperand(strideValue);
+				Instruction* next = insertBeforeTerminator(latch, std::move(step));
+
+				for (BasicBlock* pred : loop.header->preds) {
+					scaled->addOperand(pred == latch ? next : first);
+				}
+				product->replaceAllUsesWith(scaled);
+				reduced++;
+			}
+		}
+	}
+	return reduced;
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
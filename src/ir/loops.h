@@ -0,0 +1,50 @@
+#pragma once
+#include "common.h"
+
+#include "ir/dominators.h"
+#include "ir/ir.h"
+
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+// A natural loop: the header, which dominates the whole loop, and every
+// block that reaches one of the branches back to it without passing
+// through it.
+struct Loop {
+	BasicBlock*                           header = nullptr;
+	std::vector<BasicBlock*>              latches; // the blocks branching back to the header
+	std::unordered_set<const BasicBlock*> blocks;
+
+	// The only block outside the loop that branches to the header, if there
+	// is one and the header is its only successor. Code hoisted out of the
+	// loop goes there.
+	BasicBlock* preheader = nullptr;
+
+	bool contains(const BasicBlock* block) const {
+		return blocks.count(block) != 0;
+	}
+};
+
+// The natural loops of the function `dominators` was built for, inner
+// loops before the loops around them. Back edges to the same header make
+// one loop.
+std::vector<Loop> findLoops(const DominatorTree& dominators);
+
+// Moves instructions that compute the same value on every iteration, and
+// cannot trap, to the preheader. Returns how many were moved.
+size_t hoistLoopInvariants(Function* function);
+
+// Gives each product of a basic induction variable and a constant, in a
+// loop with one latch, an induction variable of its own that steps by the
+// product of the step and the constant, so the loop adds instead of
+// multiplying. The products are left for eliminateDeadCode, and so is the
+// original variable if nothing else needs it. Returns how many products
+// were replaced.
+size_t reduceStrength(Function* function);
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
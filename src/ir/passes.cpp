@@ -0,0 +1,246 @@
+#include "passes.h"
+#include "ir/dominators.h"
+#include "ir/loops.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+size_t loopSelfTailCalls(Function* function) {
+	Symbol                   self = Symbol::intern(function->name);
+	std::vector<BasicBlock*> tails;
+	for (auto& block : function->blocks) {
+		auto& insts = block->insts;
+		if (insts.size() >= 2 && insts.back()->op == Opcode::Return && insts[insts.size() - 2]->op == Opcode::Call &&
+		    insts[insts.size() - 2]->callee == self) {
+			tails.push_back(block.get());
+		}
+	}
+	if (tails.empty()) {
+		return 0;
+	}
+
+	// The new block takes the place of the entry in the CFG, so the entry
+	// keeps no predecessors. Functions have no parameters, so nothing
+	// differs between iterations and the loop needs no phis.
+	BasicBlock* entry = function->entry();
+	function->blocks.emplace(function->blocks.begin() + 1, new BasicBlock(function, 1));
+	BasicBlock* loop = function->blocks[1].get();
+	for (size_t i = 2; i < function->blocks.size(); i++) {
+		function->blocks[i]->index = i;
+	}
+	loop->insts.swap(entry->insts);
+	for (auto& inst : loop->insts) {
+		inst->block = loop;
+	}
+	loop->succs.swap(entry->succs);
+	for (BasicBlock* succ : loop->succs) {
+		std::replace(succ->preds.begin(), succ->preds.end(), entry, loop);
+	}
+	for (BasicBlock*& tail : tails) {
+		if (tail == entry) {
+			tail = loop;
+		}
+	}
+
+	std::unique_ptr<Instruction> enter(new Instruction(Opcode::Br, PrimitiveVariableTypes::Unit));
+	enter->block = entry;
+	enter->targets.push_back(loop);
+	entry->insts.push_back(std::move(enter));
+	entry->succs.push_back(loop);
+	loop->preds.push_back(entry);
+
+	for (BasicBlock* tail : tails) {
+		// Drops the call and the return; neither has operands.
+		tail->insts.resize(tail->insts.size() - 2);
+		std::unique_ptr<Instruction> back(new Instruction(Opcode::Br, PrimitiveVariableTypes::Unit));
+		back->block = tail;
+		back->targets.push_back(loop);
+		tail->insts.push_back(std::move(back));
+		tail->succs.push_back(loop);
+		loop->preds.push_back(tail);
+	}
+	return tails.size();
+}
+
+size_t propagateCopies(Function* function) {
+	std::unordered_set<Instruction*> removed;
+	bool                             changed = true;
+	// Replacing one phi can make another one trivial.
+	while (changed) {
+		changed = false;
+		for (auto& block : function->blocks) {
+			for (auto& inst : block->insts) {
+				if (removed.count(inst.get())) {
+					continue;
+				}
+				Instruction* same = nullptr;
+				if (inst->op == Opcode::Copy) {
+					same = inst->operand(0);
+				} else if (inst->op == Opcode::Phi) {
+					for (Instruction* operand : inst->operands()) {
+						if (operand == inst.get() || operand == same) {
+							continue;
+						}
+						if (same) {
+							same = nullptr;
+							break;
+						}
+						same = operand;
+					}
+				}
+				if (same) {
+					inst->replaceAllUsesWith(same);
+					removed.insert(inst.get());
+					changed = true;
+				}
+			}
+		}
+	}
+	return function->removeIf([&](Instruction* inst) { return removed.count(inst) != 0; });
+}
+
+namespace {
+
+struct ExpressionKey {
+	Opcode                 op;
+	PrimitiveVariableTypes type;
+	uint64_t               bits;
+	Instruction*           left;
+	Instruction*           right;
+
+	bool operator==(const ExpressionKey& other) const {
+		return op == other.op && type == other.type && bits == other.bits && left == other.left &&
+		       right == other.right;
+	}
+};
+
+struct ExpressionKeyHash {
+	size_t operator()(const ExpressionKey& key) const {
+		size_t hash = std::hash<uint64_t>()(key.bits);
+		hash        = hash * 31 + static_cast<size_t>(key.op);
+		hash        = hash * 31 + static_cast<size_t>(key.type);
+		hash        = hash * 31 + std::hash<Instruction*>()(key.left);
+		hash        = hash * 31 + std::hash<Instruction*>()(key.right);
+		return hash;
+	}
+};
+
+// Walks the dominator tree, so what is available in a block is exactly what
+// its dominators computed.
+class ValueNumbering {
+public:
+	explicit ValueNumbering(Function* function)
+			: function(function), dominators(*function) {
+	}
+
+	size_t run() {
+		visit(function->entry());
+		return function->removeIf([&](Instruction* inst) { return removed.count(inst) != 0; });
+	}
+
+private:
+	void visit(BasicBlock* block) {
+		std::vector<ExpressionKey> added;
+		for (auto& inst : block->insts) {
+			if (inst->op != Opcode::Const && !inst->isBinary()) {
+				continue;
+			}
+			ExpressionKey key   = keyOf(inst.get());
+			auto          found = available.find(key);
+			if (found != available.end()) {
+				inst->replaceAllUsesWith(found->second);
+				removed.insert(inst.get());
+			} else {
+				available.emplace(key, inst.get());
+				added.push_back(key);
+			}
+		}
+		for (BasicBlock* child : dominators.children(block)) {
+			visit(child);
+		}
+		for (const ExpressionKey& key : added) {
+			available.erase(key);
+		}
+	}
+
+	static ExpressionKey keyOf(Instruction* inst) {
+		ExpressionKey key = { inst->op, inst->type, inst->bits, nullptr, nullptr };
+		if (inst->isBinary()) {
+			key.left         = inst->operand(0);
+			key.right        = inst->operand(1);
+			bool integer     = inst->type == PrimitiveVariableTypes::I32 || inst->type == PrimitiveVariableTypes::I64;
+			bool commutative = inst->op == Opcode::Add || inst->op == Opcode::Mul || inst->op == Opcode::And ||
+			                   inst->op == Opcode::Or;
+			if (integer && commutative && std::less<Instruction*>()(key.right, key.left)) {
+				std::swap(key.left, key.right);
+			}
+		}
+		return key;
+	}
+
+	Function*                                                          function;
+	DominatorTree                                                      dominators;
+	std::unordered_map<ExpressionKey, Instruction*, ExpressionKeyHash> available;
+	std::unordered_set<Instruction*>                                   removed;
+};
+
+} // namespace
+
+size_t eliminateCommonSubexpressions(Function* function) {
+	return ValueNumbering(function).run();
+}
+
+size_t eliminateDeadCode(Function* function) {
+	std::unordered_set<Instruction*> live;
+	std::vector<Instruction*>        worklist;
+	for (auto& block : function->blocks) {
+		for (auto& inst : block->insts) {
+			if (inst->hasSideEffects()) {
+				live.insert(inst.get());
+				worklist.push_back(inst.get());
+			}
+		}
+	}
+	while (!worklist.empty()) {
+		Instruction* inst = worklist.back();
+		worklist.pop_back();
+		for (Instruction* operand : inst->operands()) {
+			if (live.insert(operand).second) {
+				worklist.push_back(operand);
+			}
+		}
+	}
+	return function->removeIf([&](Instruction* inst) { return live.count(inst) == 0; });
+}
+
+void optimize(Function* function, PassStats* stats) {
+	stats->loops += loopSelfTailCalls(function);
+	stats->copies += propagateCopies(function);
+	stats->common += eliminateCommonSubexpressions(function);
+	stats->hoisted += hoistLoopInvariants(function);
+	stats->reduced += reduceStrength(function);
+	stats->dead += eliminateDeadCode(function);
+}
+
+void optimize(Module* module, PassStats* stats) {
+	for (auto& function : module->functions) {
+		optimize(function.get(), stats);
+	}
+}
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const PassStats& stats) {
+	sink << "ir: " << stats.copies + stats.common + stats.dead << " instructions removed (" << stats.copies
+	     << " copies, " << stats.common << " common subexpressions, " << stats.dead << " dead), " << stats.loops
+	     << " tail calls turned into loops, " << stats.hoisted << " hoisted out of loops, " << stats.reduced
+	     << " multiplications reduced\n";
+	return sink;
+}
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,48 @@
+#pragma once
+#include "common.h"
+
+#include "ir/ir.h"
+#include "utils/diagnostics.h"
+
+namespace dp {
+namespace internal {
+namespace ir {
+
+struct PassStats {
+	size_t loops   = 0; // self tail calls turned into branches
+	size_t copies  = 0; // copies and trivial phis replaced by their operand
+	size_t common  = 0; // instructions replaced by an equal one that dominates them
+	size_t dead    = 0; // instructions whose result is never used
+	size_t hoisted = 0; // instructions moved out of loops
+	size_t reduced = 0; // multiplications in loops replaced by additions
+};
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const PassStats& stats);
+
+// Turns each call of the function itself that is directly followed by its
+// return into a branch back to the start, so the recursion runs in a loop
+// instead of a stack frame per level. The body moves into a block of its
+// own that the entry branches to. Returns how many calls were turned.
+size_t loopSelfTailCalls(Function* function);
+
+// Replaces every copy, and every phi whose operands are all the same value
+// or the phi itself, with that value. Returns how many were removed.
+size_t propagateCopies(Function* function);
+
+// Replaces a constant or arithmetic instruction with an equal one in a
+// dominating position, integer operands of commutative operators in either
+// order. Returns how many were removed.
+size_t eliminateCommonSubexpressions(Function* function);
+
+// Removes every instruction that neither has side effects nor feeds one
+// that does. Returns how many were removed.
+size_t eliminateDeadCode(Function* function);
+
+// The passes above and the loop passes in ir/loops.h: tail calls, copies,
+// common subexpressions, hoisting, strength reduction, dead code.
+void optimize(Function* function, PassStats* stats);
+void optimize(Module* module, PassStats* stats);
+
+} // namespace ir
+} // namespace internal
+} // namespace dp
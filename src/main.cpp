@@ -1,17 +1,29 @@
-#include "codegen/codegen.h"
-#include "parsing/parsing.h"
+#include "driver/driver.h"
+#include "driver/server.h"
+#include "parsing/fast_lexer.h"
+#include "parsing/mapped_stream.h"
+#include "repl/repl.h"
+#include "utils/diagnostics.h"
+#include "utils/thread_pool.h"
 
 #include "antlr_runtime/antlr4-runtime.h"
 #include "wabt/src/option-parser.h"
-#include <fstream>
+#include <cstdlib>
 #include <iostream>
 
 // using namespace antlr4;
 using namespace wabt;
 
-static std::string s_infile;
-static std::string s_outfile;
+static std::vector<std::string> s_infiles;
+static std::string              s_outfile;
+static size_t                   s_jobs = 1;
 static bool        s_interactive_mode = false;
+static bool        s_verify_lexer     = false;
+static std::string s_serve_socket;
+static std::string s_connect_socket;
+static bool        s_shutdown_server = false;
+
+static dp::internal::CompileOptions s_options;
 
 static const char s_description[] =
 		R"(  Deeplang compiler
@@ -31,51 +43,164 @@ static void parseOptions(int argc, char** argv) {
 			});
 	parser.AddOption('i', "interactive", "REPL",
 									 []() { s_interactive_mode = true; });
-	parser.AddArgument("filename", OptionParser::ArgumentCount::One,
+	parser.AddOption("dump-tokens", "Print the token stream of the input",
+									 []() { s_options.diagnostics.dumpTokens = true; });
+	parser.AddOption("dump-parse-tree", "Print the parse tree of the input",
+									 []() { s_options.diagnostics.dumpParseTree = true; });
+	parser.AddOption("dump-ir", "Print the IR of the input as it reaches codegen",
+									 []() { s_options.diagnostics.dumpIR = true; });
+	parser.AddOption("stats", "Print compiler statistics",
+									 []() { s_options.diagnostics.stats = true; });
+	parser.AddOption('O', "optimize", "LEVEL", "Optimization level: 0 turns the optimization passes off, 1 (default) runs them",
+									 [](const char* argument) {
+										 s_options.optimizationLevel = std::atoi(argument);
+									 });
+	parser.AddOption("inline-budget", "N", "Inline a function if its size times its number of calls is at most N (default 64)",
+									 [](const char* argument) {
+										 s_options.inlining.budget = std::strtoul(argument, nullptr, 10);
+									 });
+	parser.AddOption("no-tail-calls", "Do not emit return_call, for engines without the wasm tail-call proposal",
+									 []() { s_options.codegen.tailCalls = false; });
+	parser.AddOption("no-peephole", "Encode function bodies as they are selected, without the peephole rewrites",
+									 []() { s_options.codegen.peephole = false; });
+	parser.AddOption("verify-wasm", "Also build the output with wabt, validate it and check that it has the same bytes",
+									 []() { s_options.codegen.verify = true; });
+	parser.AddOption("codegen-threads", "N", "Encode function bodies on N threads; 0 uses every hardware thread",
+									 [](const char* argument) {
+										 s_options.codegen.threads = std::strtoul(argument, nullptr, 10);
+										 if (s_options.codegen.threads == 0) {
+											 s_options.codegen.threads = dp::internal::ThreadPool::hardwareWorkers();
+										 }
+									 });
+	parser.AddOption("lexer", "KIND", "Lexer to use: 'generated' (default) or 'fast'",
+									 [](const char* argument) {
+										 if (std::string(argument) == "fast") {
+											 s_options.lexer = dp::internal::LexerKind::Fast;
+										 } else if (std::string(argument) == "generated") {
+											 s_options.lexer = dp::internal::LexerKind::Generated;
+										 } else {
+											 std::cerr << "unknown lexer '" << argument << "'\n";
+											 exit(1);
+										 }
+									 });
+	parser.AddOption("verify-lexer", "Check that both lexers produce the same tokens for the input, then exit",
+									 []() { s_verify_lexer = true; });
+	parser.AddOption("serve", "SOCKET", "Run as a compile server listening on the Unix socket SOCKET",
+									 [](const char* argument) { s_serve_socket = argument; });
+	parser.AddOption("connect", "SOCKET", "Compile on the server listening on SOCKET instead of in-process",
+									 [](const char* argument) { s_connect_socket = argument; });
+	parser.AddOption("shutdown", "With --connect, stop the server instead of compiling",
+									 []() { s_shutdown_server = true; });
+	parser.AddOption('j', "jobs", "N", "Compile up to N files in parallel; 0 uses every hardware thread",
+									 [](const char* argument) {
+										 s_jobs = std::strtoul(argument, nullptr, 10);
+										 if (s_jobs == 0) {
+											 s_jobs = dp::internal::ThreadPool::hardwareWorkers();
+										 }
+									 });
+	parser.AddOption("manifest", "FILE", "Also compile the files listed in FILE, one per line",
+									 [](const char* argument) {
+										 if (!dp::internal::readManifest(argument, &s_infiles)) {
+											 std::cerr << "cannot read manifest " << argument << "\n";
+											 exit(1);
+										 }
+									 });
+	parser.AddArgument("filename", OptionParser::ArgumentCount::ZeroOrMore,
 										 [](const char* argument) {
-											 s_infile = argument;
-											 ConvertBackslashToSlash(&s_infile);
+											 s_infiles.push_back(argument);
+											 ConvertBackslashToSlash(&s_infiles.back());
 										 });
 	parser.Parse(argc, argv);
 }
 
+// With several inputs each one is written to `<name>.wasm`, in the -o
+// directory if given and next to the input otherwise.
+static std::string outputPathFor(const std::string& inFile) {
+	std::string name = inFile;
+	size_t      dot  = name.rfind('.');
+	if (dot != std::string::npos && name.find('/', dot) == std::string::npos) {
+		name.erase(dot);
+	}
+	if (s_outfile.size()) {
+		size_t slash = name.rfind('/');
+		name         = s_outfile + "/" + (slash == std::string::npos ? name : name.substr(slash + 1));
+	}
+	return name + ".wasm";
+}
+
+static int compileAll() {
+	if (s_connect_socket.size() || s_verify_lexer) {
+		std::cerr << "--connect and --verify-lexer take a single input file\n";
+		return -1;
+	}
+	std::vector<dp::internal::CompileJob> jobs;
+	for (const std::string& inFile : s_infiles) {
+		jobs.push_back({inFile, outputPathFor(inFile)});
+	}
+	size_t failed = dp::internal::compileFiles(jobs, s_options, s_jobs, std::cout, std::cerr);
+	if (s_options.diagnostics.stats) {
+		std::cout << "peak rss: " << dp::internal::peakResidentKiB() << " KiB\n";
+	}
+	return failed ? 1 : 0;
+}
+
 int main(int argc, char** argv) {
 	parseOptions(argc, argv);
 
 	if (s_interactive_mode) {
-		// repl
+		dp::internal::Repl repl(s_options);
+		repl.run(std::cin, std::cout);
 		return 0;
 	}
 
-	if (!s_infile.size()) {
-		return -1;
+	if (s_serve_socket.size()) {
+		dp::internal::CompileServer server(s_serve_socket, s_options);
+		return server.run(std::cout) ? 0 : -1;
+	}
+
+	if (s_connect_socket.size() && s_shutdown_server) {
+		return dp::internal::requestShutdown(s_connect_socket);
 	}
 
-	std::ifstream infile(s_infile);
-	if (!infile.is_open()) {
+	if (s_infiles.empty()) {
 		return -1;
 	}
 
-	dp::internal::Parser*    parser = new dp::internal::Parser();
-	antlr4::ANTLRInputStream input(infile);
-	auto                     module = parser->parseModule(input);
+	if (s_infiles.size() > 1) {
+		return compileAll();
+	}
 
+	const std::string& inFile = s_infiles[0];
 	if (!s_outfile.size())
 		s_outfile = "a.wasm";
 
-	dp::internal::CodeGen::generateWasm(module, s_outfile);
-	// DLLexer lexer(&input);
-	// CommonTokenStream tokens(&lexer);
+	if (s_connect_socket.size()) {
+		return dp::internal::requestCompile(s_connect_socket, inFile, s_outfile,
+																				s_options.diagnostics.stats, std::cout);
+	}
 
-	// tokens.fill();
-	// for (auto token : tokens.getTokens()) {
-	//   std::cout << token->toString() << std::endl;
-	// }
+	if (s_verify_lexer) {
+		dp::internal::MappedCharStream input(inFile);
+		if (!input.isOpen()) {
+			return -1;
+		}
+		std::string mismatch;
+		if (!dp::internal::compareWithGeneratedLexer(input, &mismatch)) {
+			std::cerr << "lexer mismatch: " << mismatch << "\n";
+			return 1;
+		}
+		return 0;
+	}
 
-	// DLParser parser(&tokens);
-	// tree::ParseTree *tree = parser.program();
+	dp::internal::DiagnosticSink sink(std::cout);
+	dp::internal::CompileResult  result = dp::internal::compileFile(inFile, s_outfile, s_options, sink);
+	if (!result.ok) {
+		return -1;
+	}
 
-	// std::cout << tree->toStringTree(&parser) << std::endl;
+	if (s_options.diagnostics.stats) {
+		sink << "peak rss: " << dp::internal::peakResidentKiB() << " KiB\n";
+	}
 
 	return 0;
 }
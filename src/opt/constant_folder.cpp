@@ -0,0 +1,311 @@
+#include "constant_folder.h"
+
+#include <cmath>
+
+namespace dp {
+namespace internal {
+
+static bool isInteger(const LiteralExpression* lit) {
+	return lit->typ == LiteralExpression::Typ::DPI32 || lit->typ == LiteralExpression::Typ::DPI64;
+}
+
+// The literal's bits as an unsigned integer of its own width.
+static uint64_t integerBits(const LiteralExpression* lit) {
+	if (lit->typ == LiteralExpression::Typ::DPI32) {
+		return static_cast<uint32_t>(lit->i32val);
+	}
+	return static_cast<uint64_t>(lit->i64val);
+}
+
+static double floatValue(const LiteralExpression* lit) {
+	return lit->typ == LiteralExpression::Typ::DPF32 ? lit->f32val : lit->f64val;
+}
+
+static bool isOne(const LiteralExpression* lit) {
+	return isInteger(lit) ? integerBits(lit) == 1 : floatValue(lit) == 1.0;
+}
+
+// +0 only: x - -0.0 is not x when x is -0.0.
+static bool isPositiveZero(const LiteralExpression* lit) {
+	return isInteger(lit) ? integerBits(lit) == 0 : floatValue(lit) == 0.0 && !std::signbit(floatValue(lit));
+}
+
+// log2 of an integer literal that is a power of two greater than one, or 0.
+static unsigned powerOfTwo(const LiteralExpression* lit) {
+	if (!isInteger(lit)) {
+		return 0;
+	}
+	uint64_t bits = integerBits(lit);
+	if (bits < 2 || (bits & (bits - 1)) != 0) {
+		return 0;
+	}
+	unsigned shift = 0;
+	while (bits >>= 1) {
+		shift++;
+	}
+	return shift;
+}
+
+template <typename Unsigned, typename Signed>
+static bool foldInteger(BinaryOperator op, Unsigned a, Unsigned b, Unsigned* result) {
+	const Unsigned signBit = Unsigned(1) << (sizeof(Unsigned) * 8 - 1);
+	switch (op) {
+	case BinaryOperator::Plus:
+		*result = a + b;
+		return true;
+	case BinaryOperator::Minus:
+		*result = a - b;
+		return true;
+	case BinaryOperator::Mult:
+		*result = a * b;
+		return true;
+	case BinaryOperator::Div:
+		// Both trap in wasm.
+		if (b == 0 || (a == signBit && b == Unsigned(-1))) {
+			return false;
+		}
+		*result = static_cast<Unsigned>(static_cast<Signed>(a) / static_cast<Signed>(b));
+		return true;
+	case BinaryOperator::BitwiseAnd:
+		*result = a & b;
+		return true;
+	case BinaryOperator::BitwiseOr:
+		*result = a | b;
+		return true;
+	case BinaryOperator::ShiftLeft:
+		*result = a << (b & (sizeof(Unsigned) * 8 - 1));
+		return true;
+	}
+	return false;
+}
+
+template <typename Float>
+static bool foldFloat(BinaryOperator op, Float a, Float b, Float* result) {
+	switch (op) {
+	case BinaryOperator::Plus:
+		*result = a + b;
+		return true;
+	case BinaryOperator::Minus:
+		*result = a - b;
+		return true;
+	case BinaryOperator::Mult:
+		*result = a * b;
+		return true;
+	case BinaryOperator::Div:
+		*result = a / b;
+		return true;
+	default:
+		return false;
+	}
+}
+
+void ConstantFolder::run(Module* module) {
+	arena = &module->arena;
+	for (Statement* stmt : module->stmts) {
+		if (stmt->kind() == StatementKind::FunctionDeclaration) {
+			FunctionDeclaration* fun = static_cast<FunctionDeclaration*>(stmt);
+			fun->body->expr          = fold(fun->body->expr);
+		}
+	}
+	arena = nullptr;
+}
+
+void ConstantFolder::foldBlock(BlockExpession* block) {
+	constants.enterScope();
+	size_t kept = 0;
+	for (Statement* stmt : block->stmts) {
+		if (foldStatement(stmt)) {
+			block->stmts[kept++] = stmt;
+		}
+	}
+	block->stmts = StatementVector(block->stmts.begin(), kept);
+	constants.exitScope();
+}
+
+// Returns false if the statement is no longer needed.
+bool ConstantFolder::foldStatement(Statement* stmt) {
+	switch (stmt->kind()) {
+	case StatementKind::VariableDeclaration: {
+		VariableDeclaration* var = static_cast<VariableDeclaration*>(stmt);
+		// In scope, but not yet constant, while its own initializer is folded.
+		constants.insert(var->id.name, nullptr);
+		if (!var->init) {
+			return true;
+		}
+		var->init = fold(var->init);
+		if (var->init->kind() != ExpressionKind::Literal) {
+			return true;
+		}
+		// Every later read is replaced by the constant, so the variable
+		// itself goes away.
+		*constants.lookup(var->id.name) = static_cast<LiteralExpression*>(var->init);
+		foldStats.eliminated += 2;
+		return false;
+	}
+	case StatementKind::Expression: {
+		ExpressionStatement* exprStmt = static_cast<ExpressionStatement*>(stmt);
+		exprStmt->expr                = fold(exprStmt->expr);
+		// Nothing is evaluated for effect by a literal or a variable read.
+		if (exprStmt->expr->kind() == ExpressionKind::Literal || exprStmt->expr->kind() == ExpressionKind::Path) {
+			foldStats.eliminated += 2;
+			return false;
+		}
+		return true;
+	}
+	default:
+		return true;
+	}
+}
+
+Expression* ConstantFolder::fold(Expression* expr) {
+	switch (expr->kind()) {
+	case ExpressionKind::Path: {
+		PathExpression*     path  = static_cast<PathExpression*>(expr);
+		LiteralExpression** bound = constants.lookup(path->id.name);
+		if (bound && *bound) {
+			foldStats.propagated++;
+			return copyLiteral(*bound, path->loc);
+		}
+		return expr;
+	}
+	case ExpressionKind::Binary:
+		return foldBinary(static_cast<BinaryExpression*>(expr));
+	case ExpressionKind::Block:
+		foldBlock(static_cast<BlockExpession*>(expr));
+		return expr;
+	default:
+		return expr;
+	}
+}
+
+Expression* ConstantFolder::foldBinary(BinaryExpression* node) {
+	node->left  = fold(node->left);
+	node->right = fold(node->right);
+	if (node->left->kind() == ExpressionKind::Literal && node->right->kind() == ExpressionKind::Literal) {
+		LiteralExpression* result = evaluate(node, static_cast<LiteralExpression*>(node->left),
+		                                     static_cast<LiteralExpression*>(node->right));
+		if (result) {
+			foldStats.folded++;
+			foldStats.eliminated += 2;
+			return result;
+		}
+		return node;
+	}
+	return simplify(node);
+}
+
+Expression* ConstantFolder::simplify(BinaryExpression* node) {
+	LiteralExpression* left  = nullptr;
+	LiteralExpression* right = nullptr;
+	if (node->left->kind() == ExpressionKind::Literal) {
+		left = static_cast<LiteralExpression*>(node->left);
+	} else if (node->right->kind() == ExpressionKind::Literal) {
+		right = static_cast<LiteralExpression*>(node->right);
+	} else {
+		return node;
+	}
+
+	Expression* identity = nullptr;
+	switch (node->op) {
+	case BinaryOperator::Plus:
+		// x + 0 is not x for x = -0.0.
+		if (!node->type->isFloat()) {
+			identity = left && isPositiveZero(left) ? node->right : right && isPositiveZero(right) ? node->left : nullptr;
+		}
+		break;
+	case BinaryOperator::Minus:
+		identity = right && isPositiveZero(right) ? node->left : nullptr;
+		break;
+	case BinaryOperator::Mult:
+		identity = left && isOne(left) ? node->right : right && isOne(right) ? node->left : nullptr;
+		break;
+	case BinaryOperator::Div:
+		identity = right && isOne(right) ? node->left : nullptr;
+		break;
+	default:
+		break;
+	}
+	if (identity) {
+		foldStats.simplified++;
+		foldStats.eliminated += 2;
+		return identity;
+	}
+
+	if (node->op == BinaryOperator::Mult) {
+		unsigned shift = powerOfTwo(left ? left : right);
+		if (shift) {
+			// Multiplication wraps like the shift, so they agree for every x.
+			Expression* operand = left ? node->right : node->left;
+			node->left          = operand;
+			node->right         = left ? left : right;
+			node->op            = BinaryOperator::ShiftLeft;
+			LiteralExpression* amount = static_cast<LiteralExpression*>(node->right);
+			if (amount->typ == LiteralExpression::Typ::DPI32) {
+				amount->i32val = static_cast<int32_t>(shift);
+			} else {
+				amount->i64val = static_cast<int64_t>(shift);
+			}
+			foldStats.simplified++;
+		}
+	}
+	return node;
+}
+
+LiteralExpression* ConstantFolder::evaluate(BinaryExpression* node, LiteralExpression* left,
+                                            LiteralExpression* right) {
+	LiteralExpression* result = nullptr;
+	switch (node->type->typ) {
+	case PrimitiveVariableTypes::I32: {
+		uint32_t value;
+		if (foldInteger<uint32_t, int32_t>(node->op, static_cast<uint32_t>(left->i32val),
+		                                   static_cast<uint32_t>(right->i32val), &value)) {
+			result = arena->make<LiteralExpression>(static_cast<int32_t>(value), node->loc);
+		}
+		break;
+	}
+	case PrimitiveVariableTypes::I64: {
+		uint64_t value;
+		if (foldInteger<uint64_t, int64_t>(node->op, static_cast<uint64_t>(left->i64val),
+		                                   static_cast<uint64_t>(right->i64val), &value)) {
+			result = arena->make<LiteralExpression>(static_cast<int64_t>(value), node->loc);
+		}
+		break;
+	}
+	case PrimitiveVariableTypes::F32: {
+		float value;
+		if (foldFloat(node->op, left->f32val, right->f32val, &value)) {
+			result = arena->make<LiteralExpression>(value, node->loc);
+		}
+		break;
+	}
+	case PrimitiveVariableTypes::F64: {
+		double value;
+		if (foldFloat(node->op, left->f64val, right->f64val, &value)) {
+			result = arena->make<LiteralExpression>(value, node->loc);
+		}
+		break;
+	}
+	case PrimitiveVariableTypes::Unit:
+	case PrimitiveVariableTypes::Str:
+		break;
+	}
+	if (result) {
+		result->type = node->type;
+	}
+	return result;
+}
+
+LiteralExpression* ConstantFolder::copyLiteral(LiteralExpression* lit, const Location& loc) {
+	LiteralExpression* copy = arena->make<LiteralExpression>(*lit);
+	copy->loc               = loc;
+	return copy;
+}
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const FoldStats& stats) {
+	sink << "fold: " << stats.eliminated << " nodes eliminated (" << stats.folded << " folded, "
+	     << stats.propagated << " propagated, " << stats.simplified << " simplified)\n";
+	return sink;
+}
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,55 @@
+#pragma once
+#include "common.h"
+
+#include "ast/ast.h"
+#include "utils/diagnostics.h"
+#include "utils/symbol_table.h"
+
+namespace dp {
+namespace internal {
+
+struct FoldStats {
+	size_t folded     = 0; // constant subtrees replaced by a literal
+	size_t propagated = 0; // variable reads replaced by the constant bound to them
+	size_t simplified = 0; // identities and strength reductions applied
+	size_t eliminated = 0; // AST nodes removed in total
+};
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const FoldStats& stats);
+
+// AST-level optimization run after the TypeChecker and before codegen. It
+// folds constant subtrees, replaces reads of a `let` bound to a constant
+// with that constant and drops the `let`, simplifies `x * 1`, `x + 0`,
+// `x - 0` and `x / 1` to `x` and turns integer multiplication by a power of
+// two into a shift. Folding follows wasm semantics: integers wrap, and a
+// division that would trap is left for run time.
+//
+// There is no assignment in the language yet, so every `let` is bound once.
+class ConstantFolder {
+public:
+	void run(Module* module);
+
+	const FoldStats& stats() const {
+		return foldStats;
+	}
+
+private:
+	void        foldBlock(BlockExpession* block);
+	bool        foldStatement(Statement* stmt);
+	Expression* fold(Expression* expr);
+	Expression* foldBinary(BinaryExpression* node);
+	Expression* simplify(BinaryExpression* node);
+
+	LiteralExpression* evaluate(BinaryExpression* node, LiteralExpression* left, LiteralExpression* right);
+	LiteralExpression* copyLiteral(LiteralExpression* lit, const Location& loc);
+
+	Arena*    arena = nullptr;
+	FoldStats foldStats;
+
+	// The literal each variable in scope is bound to, or null if it is not
+	// a known constant.
+	ScopedSymbolTable<LiteralExpression*> constants;
+};
+
+} // namespace internal
+} // namespace dp
@@ -96,6 +96,8 @@ unblockExpression :
     | QUOTED_STRING
     | unblockExpression OPEN_PAR_SYMBOL expressionList CLOSE_PAR_SYMBOL
     | CONST
+    | DECIMAL_NUMBER
+    | FLOAT_NUMBER
     | IDENTIFIER
 ;
 
@@ -132,8 +134,7 @@ statement :
 ;
 
 statements :
-    statement SEMICOLON_SYMBOL
-    | statement SEMICOLON_SYMBOL statements
+    (statement SEMICOLON_SYMBOL)+
 ;
 
 module :
@@ -0,0 +1,574 @@
+#include "fast_lexer.h"
+#include "mapped_stream.h"
+#include "DLLexer.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dp {
+namespace internal {
+
+namespace {
+
+enum CharClass : uint8_t {
+	kOther,
+	kSpace,      // [ \t\f\r\n]
+	kLetter,     // [a-zA-Z_$], starts an identifier or keyword
+	kDigit,      // [0-9]
+	kDot,        // '.', DOT_SYMBOL or the start of a DECIMAL_NUMBER
+	kSlash,      // '/', DIV_OPERATOR or the start of a comment
+	kQuote,      // '"'
+	kPunctuator, // any other operator or symbol
+};
+
+struct Keyword {
+	const char* text;
+	size_t      type;
+};
+
+struct Pair {
+	char   first;
+	char   second;
+	size_t type;
+};
+
+// Two-character operators; anything else is a single character.
+const Pair s_pairs[] = {
+		{'=', '=', DLLexer::ASSIGN_OPERATOR},
+		{'=', '>', DLLexer::SEPARATOR_SYMBOL},
+		{'>', '=', DLLexer::GREATER_OR_EQUAL_OPERATOR},
+		{'<', '=', DLLexer::LESS_OR_EQUAL_OPERATOR},
+		{'<', '>', DLLexer::NOT_EQUAL_OPERATOR},
+		{'!', '=', DLLexer::NOT_EQUAL_OPERATOR},
+		{'&', '&', DLLexer::LOGICAL_AND_OPERATOR},
+		{'|', '|', DLLexer::LOGICAL_OR_OPERATOR},
+		{':', ':', DLLexer::ALIAS_SYMBOL},
+		{'-', '>', DLLexer::JSON_SEPARATOR_SYMBOL},
+};
+
+const Keyword s_keywords[] = {
+		{"letmut", DLLexer::LETMUT_SYMBOL},
+		{"let", DLLexer::LET_SYMBOL},
+		{"fun", DLLexer::FUN_SYMBOL},
+		{"class", DLLexer::CLASS_SYMBOL},
+		{"interface", DLLexer::INTERFACE_SYMBOL},
+		{"extends", DLLexer::EXTENDS_SYMBOL},
+		{"impl", DLLexer::IMPL_SYMBOL},
+		{"public", DLLexer::PUBLIC_SYMBOL},
+		{"private", DLLexer::PRIVATE_SYMBOL},
+		{"if", DLLexer::IF_SYMBOL},
+		{"then", DLLexer::THEN_SYMBOL},
+		{"else", DLLexer::ELSE_SYMBOL},
+		{"switch", DLLexer::SWITCH_SYMBOL},
+		{"case", DLLexer::CASE_SYMBOL},
+		{"for", DLLexer::FOR_SYMBOL},
+		{"while", DLLexer::WHILE_SYMBOL},
+		{"loop", DLLexer::LOOP_SYMBOL},
+		{"prop", DLLexer::PROP_SYMBOL},
+		{"super", DLLexer::SUPER_SYMBOL},
+		{"this", DLLexer::THIS_SYMBOL},
+		{"new", DLLexer::NEW_SYMBOL},
+		{"break", DLLexer::BREAK_SYMBOL},
+		{"return", DLLexer::RETURN_SYMBOL},
+		{"mut", DLLexer::MUT_SYMBOL},
+		{"sig", DLLexer::SIG_SYMBOL},
+		{"constructor", DLLexer::CONSTRUCTOR_SYMBOL},
+};
+
+const size_t kMaxKeywordLength = 11;
+
+struct Tables {
+	uint8_t  charClass[256];
+	bool     startsPair[256];
+	uint16_t single[256]; // token type of a single-character punctuator
+
+	// Keywords bucketed by length; keywords are case-insensitive.
+	std::vector<Keyword> keywords[kMaxKeywordLength + 1];
+
+	Tables() {
+		std::memset(charClass, kOther, sizeof(charClass));
+		std::memset(startsPair, 0, sizeof(startsPair));
+		std::memset(single, 0, sizeof(single));
+		for (unsigned char c : std::string(" \t\f\r\n")) {
+			charClass[c] = kSpace;
+		}
+		for (int c = 0; c < 256; c++) {
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$') {
+				charClass[c] = kLetter;
+			} else if (c >= '0' && c <= '9') {
+				charClass[c] = kDigit;
+			}
+		}
+		charClass['.']  = kDot;
+		charClass['/']  = kSlash;
+		charClass['"']  = kQuote;
+
+		const struct {
+			char   c;
+			size_t type;
+		} punctuators[] = {
+				{'=', DLLexer::EQUAL_OPERATOR},
+				{'>', DLLexer::GREATER_THAN_OPERATOR},
+				{'<', DLLexer::LESS_THAN_OPERATOR},
+				{'+', DLLexer::PLUS_OPERATOR},
+				{'-', DLLexer::MINUS_OPERATOR},
+				{'*', DLLexer::MULT_OPERATOR},
+				{'%', DLLexer::MOD_OPERATOR},
+				{'^', DLLexer::BITWISE_XOR_OPERATOR},
+				{'!', DLLexer::LOGICAL_NOT_OPERATOR},
+				{'~', DLLexer::BITWISE_NOT_OPERATOR},
+				{'&', DLLexer::BITWISE_AND_OPERATOR},
+				{'|', DLLexer::BITWISE_OR_OPERATOR},
+				{',', DLLexer::COMMA_SYMBOL},
+				{';', DLLexer::SEMICOLON_SYMBOL},
+				{':', DLLexer::COLON_SYMBOL},
+				{'(', DLLexer::OPEN_PAR_SYMBOL},
+				{')', DLLexer::CLOSE_PAR_SYMBOL},
+				{'{', DLLexer::OPEN_CURLY_SYMBOL},
+				{'}', DLLexer::CLOSE_CURLY_SYMBOL},
+				{'[', DLLexer::OPEN_SQUARE_SYMBOL},
+				{']', DLLexer::CLOSE_SQUARE_SYMBOL},
+				{'@', DLLexer::AT_SIGN_SYMBOL},
+				{'?', DLLexer::PARAM_MARKER},
+		};
+		for (const auto& p : punctuators) {
+			charClass[static_cast<unsigned char>(p.c)] = kPunctuator;
+			single[static_cast<unsigned char>(p.c)]    = static_cast<uint16_t>(p.type);
+		}
+		for (const Pair& p : s_pairs) {
+			startsPair[static_cast<unsigned char>(p.first)] = true;
+		}
+		for (const Keyword& k : s_keywords) {
+			keywords[std::strlen(k.text)].push_back(k);
+		}
+	}
+};
+
+const Tables s_tables;
+
+inline uint8_t classOf(char c) {
+	return s_tables.charClass[static_cast<unsigned char>(c)];
+}
+
+inline bool isIdentifierChar(char c) {
+	uint8_t cls = classOf(c);
+	return cls == kLetter || cls == kDigit;
+}
+
+inline bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// Bulk scanners. Each returns the first byte in [p, end) that does not
+// belong to the run (or end). The SSE2 versions classify 16 bytes per step
+// and finish the last partial block with the scalar loop.
+
+#if defined(__SSE2__)
+inline __m128i broadcast(char c) {
+	return _mm_set1_epi8(c);
+}
+
+// Bytes in [lo, hi]; bytes >= 0x80 compare as negative and never match.
+inline __m128i inRange(__m128i v, char lo, char hi) {
+	return _mm_and_si128(_mm_cmpgt_epi8(v, broadcast(lo - 1)), _mm_cmplt_epi8(v, broadcast(hi + 1)));
+}
+#endif
+
+const char* skipIdentifierChars(const char* p, const char* end) {
+#if defined(__SSE2__)
+	for (; p + 16 <= end; p += 16) {
+		__m128i v      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i folded = _mm_or_si128(v, broadcast(0x20));
+		__m128i hit    = _mm_or_si128(inRange(folded, 'a', 'z'), inRange(v, '0', '9'));
+		hit            = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(v, broadcast('_')), _mm_cmpeq_epi8(v, broadcast('$'))));
+		unsigned miss  = ~_mm_movemask_epi8(hit) & 0xFFFF;
+		if (miss) {
+			return p + __builtin_ctz(miss);
+		}
+	}
+#endif
+	while (p < end && isIdentifierChar(*p)) {
+		p++;
+	}
+	return p;
+}
+
+// First '\n' or '\r'.
+const char* findLineBreak(const char* p, const char* end) {
+#if defined(__SSE2__)
+	for (; p + 16 <= end; p += 16) {
+		__m128i  v   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		unsigned hit = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, broadcast('\n')), _mm_cmpeq_epi8(v, broadcast('\r'))));
+		if (hit) {
+			return p + __builtin_ctz(hit);
+		}
+	}
+#endif
+	while (p < end && *p != '\n' && *p != '\r') {
+		p++;
+	}
+	return p;
+}
+
+// First "*/", pointing at the '*'.
+const char* findCommentEnd(const char* p, const char* end) {
+#if defined(__SSE2__)
+	for (; p + 17 <= end; p += 16) {
+		__m128i  star  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i  slash = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+		unsigned hit   = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(star, broadcast('*')), _mm_cmpeq_epi8(slash, broadcast('/'))));
+		if (hit) {
+			return p + __builtin_ctz(hit);
+		}
+	}
+#endif
+	for (; p + 1 < end; p++) {
+		if (p[0] == '*' && p[1] == '/') {
+			return p;
+		}
+	}
+	return end;
+}
+
+// Counts '\n' in [p, end) and remembers the last one.
+size_t countNewlines(const char* p, const char* end, const char** last) {
+	size_t count = 0;
+#if defined(__SSE2__)
+	for (; p + 16 <= end; p += 16) {
+		__m128i  v   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		unsigned hit = _mm_movemask_epi8(_mm_cmpeq_epi8(v, broadcast('\n')));
+		if (hit) {
+			count += __builtin_popcount(hit);
+			*last = p + 31 - __builtin_clz(hit);
+		}
+	}
+#endif
+	for (; p < end; p++) {
+		if (*p == '\n') {
+			count++;
+			*last = p;
+		}
+	}
+	return count;
+}
+
+bool isAsciiRun(const char* p, const char* end) {
+	for (; p < end; p++) {
+		if (static_cast<unsigned char>(*p) & 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Code points in [p, end), decoded the same way the input stream does.
+size_t countCodePoints(const char* p, const char* end) {
+	if (isAsciiRun(p, end)) {
+		return end - p;
+	}
+	size_t count = 0;
+	while (p < end) {
+		p += utf8SequenceLength(p, end);
+		count++;
+	}
+	return count;
+}
+
+} // namespace
+
+FastLexer::FastLexer(antlr4::CharStream* input)
+		: input(input), errorStream(&std::cerr) {
+	if (MappedCharStream* mapped = dynamic_cast<MappedCharStream*>(input)) {
+		begin = mapped->data();
+		end   = begin + mapped->byteLength();
+	} else {
+		if (input->size() > 0) {
+			copy = input->getText(antlr4::misc::Interval(static_cast<size_t>(0), input->size() - 1));
+		}
+		begin = copy.data();
+		end   = begin + copy.size();
+	}
+	cursor = begin;
+}
+
+// Moves the cursor to `to`, keeping the code point index, line and column in
+// step with what the ANTLR lexer would have counted.
+void FastLexer::advance(const char* to) {
+	const char* lastNewline = nullptr;
+	size_t      newlines    = countNewlines(cursor, to, &lastNewline);
+	index += countCodePoints(cursor, to);
+	if (newlines) {
+		line += newlines;
+		column = countCodePoints(lastNewline + 1, to);
+	} else {
+		column += countCodePoints(cursor, to);
+	}
+	cursor = to;
+}
+
+// Reports a token recognition error for the text from the cursor up to and
+// including the character at `failure`, like Lexer::notifyListeners.
+void FastLexer::reportError(const char* failure) {
+	errors++;
+	if (!errorStream) {
+		return;
+	}
+	const char* stop = failure < end ? failure + utf8SequenceLength(failure, end) : end;
+	std::string text;
+	for (const char* p = cursor; p < stop; p++) {
+		switch (*p) {
+		case '\n':
+			text += "\\n";
+			break;
+		case '\t':
+			text += "\\t";
+			break;
+		case '\r':
+			text += "\\r";
+			break;
+		default:
+			text += *p;
+		}
+	}
+	*errorStream << "line " << line << ":" << column << " token recognition error at: '" << text << "'" << std::endl;
+}
+
+// Numbers: CONST ([1-9][0-9]*), INT_NUMBER ([0-9]+), DECIMAL_NUMBER
+// (DIGITS? '.' DIGITS) and FLOAT_NUMBER ((DIGITS? '.')? DIGITS [eE] [+-]?
+// DIGITS). The longest of them wins; on a tie the earlier rule does.
+size_t FastLexer::scanNumber(const char* p, size_t* length) {
+	const char* q = p;
+	while (q < end && isDigit(*q)) {
+		q++;
+	}
+	size_t      type     = DLLexer::DOT_SYMBOL;
+	const char* mantissa = nullptr;
+	if (q > p) {
+		type     = *p != '0' ? DLLexer::CONST : DLLexer::INT_NUMBER;
+		mantissa = q;
+	}
+	if (q + 1 < end && *q == '.' && isDigit(q[1])) {
+		q += 2;
+		while (q < end && isDigit(*q)) {
+			q++;
+		}
+		type     = DLLexer::DECIMAL_NUMBER;
+		mantissa = q;
+	}
+	if (mantissa) {
+		const char* e = mantissa;
+		if (e < end && (*e == 'e' || *e == 'E')) {
+			e++;
+			if (e < end && (*e == '+' || *e == '-')) {
+				e++;
+			}
+			if (e < end && isDigit(*e)) {
+				while (e < end && isDigit(*e)) {
+					e++;
+				}
+				type = DLLexer::FLOAT_NUMBER;
+				q    = e;
+			}
+		}
+	}
+	*length = mantissa ? q - p : 1;
+	return type;
+}
+
+// '/' starts a block comment, a line comment or is DIV_OPERATOR. A comment
+// that does not complete falls back to the operator.
+size_t FastLexer::scanSlash(const char* p, size_t* length) {
+	size_t left = end - p;
+	if (left >= 2 && p[1] == '*') {
+		if (left >= 4 && p[2] == '*' && p[3] == '/') {
+			*length = 4;
+			return DLLexer::BLOCK_COMMENT;
+		}
+		// '/*' ~[!] .*? '*/': the character after '/*' is never part of the
+		// terminator.
+		if (left >= 3 && p[2] != '!') {
+			const char* close = findCommentEnd(p + 3, end);
+			if (close < end) {
+				*length = close + 2 - p;
+				return DLLexer::BLOCK_COMMENT;
+			}
+		}
+	} else if (left >= 2 && p[1] == '/') {
+		// '//' followed by a blank and the rest of the line, by a single line
+		// break, or by the end of input.
+		if (left == 2) {
+			*length = 2;
+			return DLLexer::SLASHSLASH_COMMET;
+		}
+		if (p[2] == ' ' || p[2] == '\t') {
+			*length = findLineBreak(p + 3, end) - p;
+			return DLLexer::SLASHSLASH_COMMET;
+		}
+		if (p[2] == '\n' || p[2] == '\r') {
+			*length = 3;
+			return DLLexer::SLASHSLASH_COMMET;
+		}
+	}
+	*length = 1;
+	return DLLexer::DIV_OPERATOR;
+}
+
+// '"' [a-zA-Z_$0-9]+ '"'. Nothing shorter matches from a quote, so a quote
+// that does not close a string is an error at the first offending character.
+size_t FastLexer::scanQuotedString(const char* p, size_t* length) {
+	const char* q = skipIdentifierChars(p + 1, end);
+	if (q > p + 1 && q < end && *q == '"') {
+		*length = q + 1 - p;
+		return DLLexer::QUOTED_STRING;
+	}
+	*length = q - p;
+	return antlr4::Token::INVALID_TYPE;
+}
+
+// Scans the token at `p`, which is before `end`. Returns its type and byte
+// length, or INVALID_TYPE with `length` bytes before the character at which
+// recognition failed.
+size_t FastLexer::scanToken(const char* p, size_t* length) {
+	char c = *p;
+	switch (classOf(c)) {
+	case kSpace:
+		// WHITESPACE matches a single character, so a run is one hidden token
+		// per character.
+		*length = 1;
+		return DLLexer::WHITESPACE;
+	case kLetter: {
+		size_t n = skipIdentifierChars(p + 1, end) - p;
+		*length  = n;
+		if (n == 1 && c == '$') {
+			return DLLexer::DOLLAR_SYMBOL;
+		}
+		if (n >= 2 && n <= kMaxKeywordLength) {
+			char lower[kMaxKeywordLength];
+			for (size_t i = 0; i < n; i++) {
+				lower[i] = p[i] >= 'A' && p[i] <= 'Z' ? p[i] + ('a' - 'A') : p[i];
+			}
+			for (const Keyword& k : s_tables.keywords[n]) {
+				if (std::memcmp(k.text, lower, n) == 0) {
+					return k.type;
+				}
+			}
+		}
+		return DLLexer::IDENTIFIER;
+	}
+	case kDigit:
+	case kDot:
+		return scanNumber(p, length);
+	case kSlash:
+		return scanSlash(p, length);
+	case kQuote:
+		return scanQuotedString(p, length);
+	case kPunctuator: {
+		unsigned char u = static_cast<unsigned char>(c);
+		if (s_tables.startsPair[u] && p + 1 < end) {
+			for (const Pair& pair : s_pairs) {
+				if (pair.first == c && pair.second == p[1]) {
+					*length = 2;
+					return pair.type;
+				}
+			}
+		}
+		*length = 1;
+		return s_tables.single[u];
+	}
+	default:
+		*length = 0;
+		return antlr4::Token::INVALID_TYPE;
+	}
+}
+
+std::unique_ptr<antlr4::Token> FastLexer::nextToken() {
+	std::pair<antlr4::TokenSource*, antlr4::CharStream*> source(this, input);
+	while (cursor < end) {
+		size_t length;
+		size_t type = scanToken(cursor, &length);
+		if (type == antlr4::Token::INVALID_TYPE) {
+			// Report, then drop everything up to and including the offending
+			// character and start over, as Lexer::recover does.
+			const char* failure = cursor + length;
+			reportError(failure);
+			advance(failure < end ? failure + utf8SequenceLength(failure, end) : end);
+			continue;
+		}
+
+		// Every token but comments is ASCII and on one line, so its start
+		// position is the only thing to record before moving past it.
+		size_t startIndex  = index;
+		size_t startLine   = line;
+		size_t startColumn = column;
+		size_t channel     = antlr4::Token::DEFAULT_CHANNEL;
+		switch (type) {
+		case DLLexer::WHITESPACE:
+		case DLLexer::BLOCK_COMMENT:
+		case DLLexer::SLASHSLASH_COMMET:
+			channel = antlr4::Token::HIDDEN_CHANNEL;
+			advance(cursor + length);
+			break;
+		default:
+			cursor += length;
+			index += length;
+			column += length;
+		}
+		return antlr4::CommonTokenFactory::DEFAULT->create(source, type, "", channel, startIndex, index - 1,
+		                                                   startLine, startColumn);
+	}
+	return antlr4::CommonTokenFactory::DEFAULT->create(source, antlr4::Token::EOF, "", antlr4::Token::DEFAULT_CHANNEL,
+	                                                   index, index - 1, line, column);
+}
+
+static std::string describe(antlr4::Token* token) {
+	return token ? token->toString() : "<none>";
+}
+
+bool compareWithGeneratedLexer(antlr4::CharStream& input, std::string* mismatch) {
+	input.seek(0);
+	DLLexer generated(&input);
+	generated.removeErrorListeners();
+	FastLexer fast(&input);
+	fast.setErrorStream(nullptr);
+
+	bool same = true;
+	for (;;) {
+		std::unique_ptr<antlr4::Token> expected = generated.nextToken();
+		std::unique_ptr<antlr4::Token> actual   = fast.nextToken();
+		if (expected->getType() != actual->getType() || expected->getChannel() != actual->getChannel() ||
+		    expected->getStartIndex() != actual->getStartIndex() ||
+		    expected->getStopIndex() != actual->getStopIndex() || expected->getLine() != actual->getLine() ||
+		    expected->getCharPositionInLine() != actual->getCharPositionInLine() ||
+		    expected->getText() != actual->getText()) {
+			if (mismatch) {
+				std::ostringstream out;
+				out << input.getSourceName() << ": expected " << describe(expected.get()) << ", got "
+				    << describe(actual.get());
+				*mismatch = out.str();
+			}
+			same = false;
+			break;
+		}
+		if (expected->getType() == antlr4::Token::EOF) {
+			break;
+		}
+	}
+	if (same && generated.getNumberOfSyntaxErrors() != fast.syntaxErrors()) {
+		if (mismatch) {
+			std::ostringstream out;
+			out << input.getSourceName() << ": " << generated.getNumberOfSyntaxErrors()
+			    << " token recognition errors expected, got " << fast.syntaxErrors();
+			*mismatch = out.str();
+		}
+		same = false;
+	}
+	input.seek(0);
+	return same;
+}
+
+} // namespace internal
+} // namespace dp
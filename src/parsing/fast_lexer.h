@@ -0,0 +1,90 @@
+#pragma once
+#include "common.h"
+
+#include "antlr4-runtime.h"
+
+namespace dp {
+namespace internal {
+
+// Hand-written lexer for DLLexer.g4. It produces exactly the token stream the
+// generated DLLexer does -- same token types, channels, character indices,
+// lines and columns, and the same longest-match and error recovery rules --
+// but dispatches on a per-byte character class table instead of simulating
+// the lexer ATN, and skips comments and identifier tails 16 bytes at a time
+// where SSE2 is available.
+//
+// Tokens refer back to `input` for their text, so it must outlive them. The
+// input position is never moved.
+class FastLexer : public antlr4::TokenSource {
+public:
+	explicit FastLexer(antlr4::CharStream* input);
+
+	FastLexer(const FastLexer&) = delete;
+	FastLexer& operator=(const FastLexer&) = delete;
+
+	std::unique_ptr<antlr4::Token> nextToken() override;
+
+	size_t getLine() const override {
+		return line;
+	}
+
+	size_t getCharPositionInLine() override {
+		return column;
+	}
+
+	antlr4::CharStream* getInputStream() override {
+		return input;
+	}
+
+	std::string getSourceName() override {
+		return input->getSourceName();
+	}
+
+	Ref<antlr4::TokenFactory<antlr4::CommonToken>> getTokenFactory() override {
+		return antlr4::CommonTokenFactory::DEFAULT;
+	}
+
+	// Number of token recognition errors seen so far.
+	size_t syntaxErrors() const {
+		return errors;
+	}
+
+	// Where token recognition errors are reported; std::cerr, like the
+	// console listener of the generated lexer, by default. nullptr silences
+	// them.
+	void setErrorStream(std::ostream* stream) {
+		errorStream = stream;
+	}
+
+private:
+	size_t scanToken(const char* p, size_t* length);
+	size_t scanNumber(const char* p, size_t* length);
+	size_t scanSlash(const char* p, size_t* length);
+	size_t scanQuotedString(const char* p, size_t* length);
+
+	void advance(const char* to);
+	void reportError(const char* failure);
+
+	antlr4::CharStream* input;
+	std::string         copy; // contents when `input` is not memory-mapped
+
+	const char* begin  = nullptr;
+	const char* end    = nullptr;
+	const char* cursor = nullptr;
+
+	size_t index  = 0; // code point index of `cursor`
+	size_t line   = 1;
+	size_t column = 0;
+	size_t errors = 0;
+
+	std::ostream* errorStream;
+};
+
+// Differential check: lexes `input` with both DLLexer and FastLexer and
+// compares every token field. Returns true if the streams are identical;
+// otherwise describes the first difference in `mismatch`. `input` is rewound
+// before and after.
+bool compareWithGeneratedLexer(antlr4::CharStream& input, std::string* mismatch);
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,241 @@
+#include "mapped_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dp {
+namespace internal {
+
+static bool isContinuationByte(unsigned char c) {
+	return (c & 0xC0) == 0x80;
+}
+
+static bool allAscii(const char* data, size_t size) {
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + i, 8);
+		if (word & 0x8080808080808080ull) {
+			return false;
+		}
+	}
+	for (; i < size; i++) {
+		if (static_cast<unsigned char>(data[i]) & 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Decodes the code point starting at `s`; malformed sequences decode to
+// U+FFFD and consume one byte, like a lenient UTF-8 reader.
+static size_t decodeUtf8(const unsigned char* s, const unsigned char* end, size_t* length) {
+	unsigned char c = s[0];
+	size_t        n;
+	size_t        cp;
+	if (c < 0x80) {
+		*length = 1;
+		return c;
+	} else if ((c & 0xE0) == 0xC0) {
+		n  = 2;
+		cp = c & 0x1F;
+	} else if ((c & 0xF0) == 0xE0) {
+		n  = 3;
+		cp = c & 0x0F;
+	} else if ((c & 0xF8) == 0xF0) {
+		n  = 4;
+		cp = c & 0x07;
+	} else {
+		*length = 1;
+		return 0xFFFD;
+	}
+	if (s + n > end) {
+		*length = 1;
+		return 0xFFFD;
+	}
+	for (size_t i = 1; i < n; i++) {
+		if (!isContinuationByte(s[i])) {
+			*length = 1;
+			return 0xFFFD;
+		}
+		cp = (cp << 6) | (s[i] & 0x3F);
+	}
+	*length = n;
+	return cp;
+}
+
+size_t utf8SequenceLength(const char* s, const char* end) {
+	size_t length;
+	decodeUtf8(reinterpret_cast<const unsigned char*>(s), reinterpret_cast<const unsigned char*>(end), &length);
+	return length;
+}
+
+MappedCharStream::MappedCharStream(const std::string& fileName)
+		: name(fileName) {
+#ifndef _WIN32
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+	struct stat st;
+	if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr != MAP_FAILED) {
+			::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+			mapping   = addr;
+			mappedLen = st.st_size;
+			bytes     = static_cast<const char*>(addr);
+			byteSize  = st.st_size;
+		}
+	}
+	::close(fd);
+#endif
+
+	if (!mapping) {
+		std::ifstream in(fileName, std::ios::binary);
+		if (!in.is_open()) {
+			return;
+		}
+		std::ostringstream contents;
+		contents << in.rdbuf();
+		fallback = contents.str();
+		bytes    = fallback.data();
+		byteSize = fallback.size();
+	}
+
+	opened = true;
+	ascii  = allAscii(bytes, byteSize);
+	if (ascii) {
+		codePoints = byteSize;
+		counted    = true;
+	} else {
+		checkpoints.push_back(0);
+	}
+}
+
+MappedCharStream::~MappedCharStream() {
+#ifndef _WIN32
+	if (mapping) {
+		::munmap(mapping, mappedLen);
+	}
+#endif
+}
+
+// Byte offset of code point `index`, or byteSize if the file has no more
+// code points than that.
+size_t MappedCharStream::byteOffset(size_t index) {
+	if (ascii) {
+		return std::min(index, byteSize);
+	}
+	if (index < cursorIndex) {
+		// The cursor has passed every checkpoint up to where it is.
+		size_t checkpoint = index / kCheckpointInterval;
+		cursorIndex       = checkpoint * kCheckpointInterval;
+		cursorByte        = checkpoints[checkpoint];
+	}
+	const unsigned char* base = reinterpret_cast<const unsigned char*>(bytes);
+	const unsigned char* end  = base + byteSize;
+	while (cursorIndex < index && cursorByte < byteSize) {
+		size_t length;
+		decodeUtf8(base + cursorByte, end, &length);
+		cursorByte += length;
+		cursorIndex++;
+		if (cursorIndex % kCheckpointInterval == 0 && cursorIndex / kCheckpointInterval == checkpoints.size()) {
+			checkpoints.push_back(cursorByte);
+		}
+	}
+	if (cursorByte == byteSize) {
+		codePoints = cursorIndex;
+		counted    = true;
+	}
+	return cursorByte;
+}
+
+void MappedCharStream::consume() {
+	if (byteOffset(p) >= byteSize) {
+		throw antlr4::IllegalStateException("cannot consume EOF");
+	}
+	p++;
+}
+
+size_t MappedCharStream::LA(ssize_t i) {
+	if (i == 0) {
+		return 0; // undefined
+	}
+	ssize_t position = static_cast<ssize_t>(p) + (i < 0 ? i : i - 1);
+	if (position < 0) {
+		return antlr4::IntStream::EOF;
+	}
+	size_t offset = byteOffset(position);
+	if (offset >= byteSize) {
+		return antlr4::IntStream::EOF;
+	}
+	const unsigned char* base = reinterpret_cast<const unsigned char*>(bytes);
+	if (ascii) {
+		return base[offset];
+	}
+	size_t length;
+	return decodeUtf8(base + offset, base + byteSize, &length);
+}
+
+ssize_t MappedCharStream::mark() {
+	return -1;
+}
+
+void MappedCharStream::release(ssize_t) {
+}
+
+size_t MappedCharStream::index() {
+	return p;
+}
+
+void MappedCharStream::seek(size_t index) {
+	p = byteOffset(index) < byteSize ? index : codePoints;
+}
+
+// Counting decodes up to the end of the file, once, when first asked for.
+size_t MappedCharStream::size() {
+	if (!counted) {
+		byteOffset(SIZE_MAX);
+	}
+	return codePoints;
+}
+
+std::string MappedCharStream::getSourceName() const {
+	if (name.empty()) {
+		return antlr4::IntStream::UNKNOWN_SOURCE_NAME;
+	}
+	return name;
+}
+
+std::string MappedCharStream::getText(const antlr4::misc::Interval& interval) {
+	if (interval.a < 0 || interval.b < 0) {
+		return "";
+	}
+	size_t start = static_cast<size_t>(interval.a);
+	size_t stop  = static_cast<size_t>(interval.b);
+	if (stop < start) {
+		return "";
+	}
+	size_t first = byteOffset(start);
+	if (first >= byteSize) {
+		return "";
+	}
+	size_t last = byteOffset(stop + 1);
+	return std::string(bytes + first, last - first);
+}
+
+std::string MappedCharStream::toString() const {
+	return std::string(bytes, byteSize);
+}
+
+} // namespace internal
+} // namespace dp
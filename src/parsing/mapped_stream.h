@@ -0,0 +1,83 @@
+#pragma once
+#include "common.h"
+
+#include "antlr4-runtime.h"
+
+namespace dp {
+namespace internal {
+
+// Length in bytes of the code point starting at `s`, decoding the way
+// MappedCharStream does: a malformed or truncated sequence is a single byte.
+size_t utf8SequenceLength(const char* s, const char* end);
+
+// CharStream over a memory-mapped UTF-8 source file. ASCII-only files are
+// served straight from the mapping; otherwise code points are decoded on
+// demand by a cursor that moves through the file, and a byte offset is kept
+// only for every kCheckpointInterval-th code point it passes. Either way the
+// file contents are never copied.
+class MappedCharStream : public antlr4::CharStream {
+public:
+	explicit MappedCharStream(const std::string& fileName);
+	~MappedCharStream();
+
+	MappedCharStream(const MappedCharStream&) = delete;
+	MappedCharStream& operator=(const MappedCharStream&) = delete;
+
+	bool isOpen() const {
+		return opened;
+	}
+
+	bool isAscii() const {
+		return ascii;
+	}
+
+	// The raw UTF-8 contents, for consumers that scan bytes directly.
+	const char* data() const {
+		return bytes;
+	}
+
+	size_t byteLength() const {
+		return byteSize;
+	}
+
+	void        consume() override;
+	size_t      LA(ssize_t i) override;
+	ssize_t     mark() override;
+	void        release(ssize_t marker) override;
+	size_t      index() override;
+	void        seek(size_t index) override;
+	size_t      size() override;
+	std::string getSourceName() const override;
+	std::string getText(const antlr4::misc::Interval& interval) override;
+	std::string toString() const override;
+
+private:
+	size_t byteOffset(size_t index);
+
+	std::string name;
+	bool        opened = false;
+	bool        ascii  = true;
+
+	const char* bytes     = nullptr;
+	size_t      byteSize  = 0;
+	void*       mapping   = nullptr;
+	size_t      mappedLen = 0;
+	std::string fallback; // contents when the file could not be mapped
+
+	size_t p          = 0; // current code point index
+	size_t codePoints = 0; // known once the cursor has reached the end
+	bool   counted    = false;
+
+	// Code point index and byte offset where the last lookup ended, and the
+	// byte offset of every kCheckpointInterval-th code point before the
+	// furthest one looked up (non-ASCII files only). A lookup decodes forward
+	// from the cursor, or from the checkpoint before it when going back.
+	static const size_t kCheckpointInterval = 64;
+
+	size_t              cursorIndex = 0;
+	size_t              cursorByte  = 0;
+	std::vector<size_t> checkpoints;
+};
+
+} // namespace internal
+} // namespace dp
@@ -1,11 +1,15 @@
 #include "parsing.h"
+#include "fast_lexer.h"
 #include "ast/ast.h"
 #include "antlr4-runtime.h"
 #include "DLLexer.h"
 #include "DLParser.h"
 #include "DLParserVisitor.h"
 #include "utils/error.h"
+#include <cerrno>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <typeinfo>
 
 
@@ -18,68 +22,89 @@ antlrcpp::Any Parser::visitAryOp(DLParser::AryOpContext *context) {
     UNREACHABLE("op");
 }
 
-antlrcpp::Any Parser::visitExpressionStatement(DLParser::ExpressionStatementContext *context) {
+Location Parser::locationOf(antlr4::ParserRuleContext *context) {
+    Location loc;
+    antlr4::Token* start = context->getStart();
+    antlr4::Token* stop = context->getStop();
+    loc.file = file;
+    loc.line = start->getLine();
+    loc.firstColumn = start->getCharPositionInLine();
+    loc.lastColumn = loc.firstColumn;
+    if (stop && stop->getLine() == start->getLine()) {
+        loc.lastColumn = stop->getCharPositionInLine() + stop->getStopIndex() - stop->getStartIndex();
+    }
+    return loc;
+}
+
+Expression* Parser::expressionOf(DLParser::ExpressionStatementContext *context) {
     if (context->blockExpression()) {
         return visit(context->blockExpression());
     } else if (context->unblockExpression()) {
-        ExpressionStatement* stmt = new ExpressionStatement();
-        stmt->expr = std::unique_ptr<Expression>(
-            static_cast<Expression*>(visit(context->unblockExpression())));
-        return stmt;
+        return visit(context->unblockExpression());
     } else {
-        UNREACHABLE("visitExpressionStatement");
+        UNREACHABLE("expressionOf");
     }
 }
 
+antlrcpp::Any Parser::visitExpressionStatement(DLParser::ExpressionStatementContext *context) {
+    ExpressionStatement* stmt = arena->make<ExpressionStatement>(locationOf(context));
+    stmt->expr = expressionOf(context);
+    return stmt;
+}
+
 
 antlrcpp::Any Parser::visitExpressionList(DLParser::ExpressionListContext *context) {
-    std::vector<Expression*>* exps = new std::vector<Expression*>();
     std::vector<DLParser::ExpressionStatementContext*> expStmtCtxs = context->expressionStatement();
-    for (auto expStmtCtx : expStmtCtxs) {
-        ExpressionStatement* es = visit(expStmtCtx);
-        Expression* e = es->expr.get();
-        exps->push_back(e);
-        delete es;
+    ExpressionVector exps = arena->makeArray<Expression*>(expStmtCtxs.size());
+    for (size_t i = 0; i < expStmtCtxs.size(); i++) {
+        exps[i] = expressionOf(expStmtCtxs[i]);
     }
     return exps;
 }
 
 
 antlrcpp::Any Parser::visitBlockExpression(DLParser::BlockExpressionContext *context) {
-    ExpressionStatement* be = new ExpressionStatement();
-    BlockExpession* e = new BlockExpession();
-
-    std::vector<Statement*>* stmts = visit(context->statements());
-    for (auto stm : *stmts) {
-        e->stmts.emplace_back(stm);
+    BlockExpession* e = arena->make<BlockExpession>(locationOf(context));
+    if (context->statements()) {
+        e->stmts = visit(context->statements()).as<StatementVector>();
     }
-    delete stmts;
-    be->expr = std::unique_ptr<Expression>(static_cast<Expression*>(e));
-    return be;
+    return static_cast<Expression*>(e);
 }
 
 antlrcpp::Any Parser::visitUnblockExpression(DLParser::UnblockExpressionContext *context) {
+    Location loc = locationOf(context);
     if (context->CONST()) {
-        int v = stoi(context->CONST()->getText());
-        return static_cast<Expression*>(new LiteralExpression(v));
+        // Typed as i32 when it fits; the TypeChecker widens it as needed.
+        std::string text = context->CONST()->getText();
+        errno = 0;
+        unsigned long long v = std::strtoull(text.c_str(), nullptr, 10);
+        if (errno == ERANGE || v > INT64_MAX) {
+            *errorStream << "line " << loc.line << ":" << loc.firstColumn << " integer literal out of range: " << text << std::endl;
+            parseStats.syntaxErrors++;
+            v = 0;
+        }
+        if (v <= INT32_MAX) {
+            return static_cast<Expression*>(arena->make<LiteralExpression>(static_cast<int32_t>(v), loc));
+        }
+        return static_cast<Expression*>(arena->make<LiteralExpression>(static_cast<int64_t>(v), loc));
+    } else if (context->DECIMAL_NUMBER() || context->FLOAT_NUMBER()) {
+        antlr4::tree::TerminalNode* number = context->DECIMAL_NUMBER() ? context->DECIMAL_NUMBER() : context->FLOAT_NUMBER();
+        return static_cast<Expression*>(arena->make<LiteralExpression>(std::stod(number->getText()), loc));
     } else if (context->IDENTIFIER()) {
-        Expression* e = static_cast<Expression*>(new PathExpression(context->IDENTIFIER()->getText()));
+        Identifier id(Symbol::intern(context->IDENTIFIER()->getText()));
+        Expression* e = static_cast<Expression*>(arena->make<PathExpression>(id, loc));
         return e;
     } else if (context->QUOTED_STRING()) {
         std::string s = context->QUOTED_STRING()->getText();
         s.pop_back();
         s.erase(s.begin());
-        Expression* e = static_cast<Expression*>(new LiteralExpression(s));
+        Expression* e = static_cast<Expression*>(arena->make<LiteralExpression>(arena->copyString(s), loc));
         return e;
     } else if (context->expressionList()) {
-        CallExpression* ce = new CallExpression();
-        Expression* method = static_cast<Expression*>(visit(context->unblockExpression(0)));
-        ce->method = std::unique_ptr<Expression>(method);
-        std::vector<Expression*>* ev = visit(context->expressionList());
-        for (auto e : *ev) {
-            ce->params.push_back(std::unique_ptr<Expression>(e));
-        }
-        return ce;
+        CallExpression* ce = arena->make<CallExpression>(loc);
+        ce->method = visit(context->unblockExpression(0));
+        ce->params = visit(context->expressionList()).as<ExpressionVector>();
+        return static_cast<Expression*>(ce);
     } else {
         // std::vector<UnblockExpressionContext*> rest = context->unblockExpression();
         if (context->unblockExpression(0) && context->unblockExpression(1)) {
@@ -95,12 +120,10 @@ antlrcpp::Any Parser::visitUnblockExpression(DLParser::UnblockExpressionContext
             } else {
                 UNREACHABLE("unsupport operator");
             }
-            BinaryExpression* be = new BinaryExpression(op);
-            Expression* left = static_cast<Expression*>(visit(context->unblockExpression(0)));
-            Expression* right = static_cast<Expression*>(visit(context->unblockExpression(1)));
-            be->left = std::unique_ptr<Expression>(left);
-            be->right = std::unique_ptr<Expression>(right);
-            
+            BinaryExpression* be = arena->make<BinaryExpression>(op, loc);
+            be->left = visit(context->unblockExpression(0));
+            be->right = visit(context->unblockExpression(1));
+
             return static_cast<Expression*>(be);
         } else {
             UNREACHABLE("visitUnblockExpression");
@@ -110,28 +133,35 @@ antlrcpp::Any Parser::visitUnblockExpression(DLParser::UnblockExpressionContext
 }
 
 
+// `()` is the only tuple type so far.
 antlrcpp::Any Parser::visitTupleType(DLParser::TupleTypeContext *context) {
-    UNREACHABLE("visitTupleType");
+    return static_cast<Type*>(arena->make<VariableType>(PrimitiveVariableTypes::Unit));
 }
 
 antlrcpp::Any Parser::visitType(DLParser::TypeContext *context) {
-    return new FunctionType();
+    if (context->tupleType()) {
+        return visit(context->tupleType());
+    }
+    return static_cast<Type*>(arena->make<NamedType>(Symbol::intern(context->IDENTIFIER()->getText())));
 }
 
 antlrcpp::Any Parser::visitVariableDecl(DLParser::VariableDeclContext *context) {
-    VariableDeclaration* v = new VariableDeclaration(context->IDENTIFIER()->getText());
-    ExpressionStatement* estmt = static_cast<ExpressionStatement*>(visit(context->expressionStatement()));
-    v->init = std::move(estmt->expr);
-    delete estmt;
+    Identifier id(Symbol::intern(context->IDENTIFIER()->getText()));
+    VariableDeclaration* v = arena->make<VariableDeclaration>(id, locationOf(context));
+    v->vartype = visit(context->type()).as<Type*>();
+    if (context->expressionStatement()) {
+        v->init = expressionOf(context->expressionStatement());
+    }
     return static_cast<Statement*>(v);
 }
 
 antlrcpp::Any Parser::visitFunctionDecl(DLParser::FunctionDeclContext *context) {
-    FunctionDeclaration* decl = new FunctionDeclaration(context->IDENTIFIER()->getText());
-    decl->signature = std::unique_ptr<FunctionType>(
-        static_cast<FunctionType*>(visit(context->type())));
-    decl->body = std::unique_ptr<ExpressionStatement>(
-        static_cast<ExpressionStatement*>(visit(context->blockExpression())));
+    Identifier id(Symbol::intern(context->IDENTIFIER()->getText()));
+    FunctionDeclaration* decl = arena->make<FunctionDeclaration>(id, locationOf(context));
+    decl->signature = arena->make<FunctionType>();
+    decl->signature->Result = visit(context->type()).as<Type*>();
+    decl->body = arena->make<ExpressionStatement>(locationOf(context->blockExpression()));
+    decl->body->expr = visit(context->blockExpression());
     decl->isPublic = true;
     return static_cast<Statement*>(decl);
 }
@@ -150,81 +180,234 @@ antlrcpp::Any Parser::visitStatement(DLParser::StatementContext *context) {
     if (context->decl()) {
         return static_cast<Statement*>(visit(context->decl()));
     } else if (context->expressionStatement()) {
-        return static_cast<Statement*>(visit(context->expressionStatement()));
+        ExpressionStatement* stmt = visit(context->expressionStatement());
+        return static_cast<Statement*>(stmt);
     } else {
         UNREACHABLE("visitStatement");
     }
 }
 
+// `statements` is a flat `(statement ';')+` loop, so the whole list is
+// collected here in one pass without recursing per statement.
 antlrcpp::Any Parser::visitStatements(DLParser::StatementsContext *context) {
-    std::vector<Statement*>* stmts = new std::vector<Statement*>();
-    Statement* stm = static_cast<Statement*>(visit(context->statement()));
-    stmts->push_back(stm);
-    if (context->statements()) {
-        std::vector<Statement*>* tails = visit(context->statements());
-        stmts->insert(stmts->end(), tails->begin(), tails->end());
+    std::vector<DLParser::StatementContext*> stmtCtxs = context->statement();
+    StatementVector stmts = arena->makeArray<Statement*>(stmtCtxs.size());
+    for (size_t i = 0; i < stmtCtxs.size(); i++) {
+        stmts[i] = visit(stmtCtxs[i]);
     }
-    return static_cast<std::vector<Statement*>*>(stmts);
+    return stmts;
 }
 
 antlrcpp::Any Parser::visitModule(DLParser::ModuleContext *context) {
-    Module* m = new Module("anonymous");
-    m->id = Identifier("anonymous");
-    std::vector<Statement*>* stmts = visit(context->statements()).as<std::vector<Statement*>*>();
-    for (auto stm : *stmts) {
-        m->stmts.emplace_back(stm);
-    }
-    delete stmts;
+    Module* m = new Module("anonymous", locationOf(context));
+    arena = &m->arena;
+    m->stmts = visit(context->statements()).as<StatementVector>();
+    arena = nullptr;
     return m;
 }
 
 
 
 
-Module* Parser::parseModule(antlr4::ANTLRInputStream sourceStream) {
-    antlr4::ANTLRInputStream input = sourceStream;
-    DLLexer lexer(&input);
-    antlr4::CommonTokenStream tokens(&lexer);
+DiagnosticSink& operator<<(DiagnosticSink& sink, const ParseStats& stats) {
+    sink << "parse: sll " << stats.sllParses
+         << " (" << stats.sllSeconds * 1000 << " ms)"
+         << ", ll fallback " << stats.llFallbacks
+         << " (" << stats.llSeconds * 1000 << " ms)\n";
+    if (stats.dfaHits + stats.dfaMisses) {
+        sink << "parse: dfa hit rate " << stats.dfaHitRate() * 100 << "% ("
+             << stats.dfaHits << " hits, " << stats.dfaMisses << " misses), "
+             << stats.dfaStates << " dfa states\n";
+    }
+    return sink;
+}
 
-    tokens.fill();
-    for (auto token : tokens.getTokens()) {
-        std::cout << token->toString() << std::endl;
+static void makeDFA(const antlr4::atn::ATN& atn, std::vector<antlr4::dfa::DFA>* dfa) {
+    if (dfa->empty()) {
+        for (size_t i = 0; i < atn.getNumberOfDecisions(); i++) {
+            dfa->emplace_back(atn.getDecisionState(i), i);
+        }
+    }
+}
+
+void PredictionCache::install(DLLexer& lexer) {
+    makeDFA(lexer.getATN(), &lexerDFA);
+    lexer.setInterpreter(new antlr4::atn::LexerATNSimulator(&lexer, lexer.getATN(), lexerDFA, lexerContexts));
+}
+
+void PredictionCache::install(DLParser& parser) {
+    makeDFA(parser.getATN(), &parserDFA);
+    parser.setInterpreter(new antlr4::atn::ParserATNSimulator(&parser, parser.getATN(), parserDFA, parserContexts));
+}
+
+namespace {
+
+// Reports errors like antlr4::ConsoleErrorListener, to any stream, and
+// counts them.
+class StreamErrorListener : public antlr4::BaseErrorListener {
+public:
+    explicit StreamErrorListener(std::ostream& out) : out(out) {
+    }
+
+    void syntaxError(antlr4::Recognizer*, antlr4::Token*, size_t line, size_t charPositionInLine,
+                     const std::string& msg, std::exception_ptr) override {
+        out << "line " << line << ":" << charPositionInLine << " " << msg << std::endl;
+        errors++;
+    }
+
+    size_t errors = 0;
+
+private:
+    std::ostream& out;
+};
+
+} // namespace
+
+Parser::Parser(const DiagnosticOptions& options, DiagnosticSink* sink)
+    : options(options), sink(sink) {
+}
+
+Module* Parser::parseModule(antlr4::CharStream& input) {
+    file = Symbol::intern(input.getSourceName());
+    StreamErrorListener errorListener(*errorStream);
+    std::unique_ptr<antlr4::TokenSource> lexer;
+    FastLexer* fast = nullptr;
+    if (lexerKind == LexerKind::Fast) {
+        fast = new FastLexer(&input);
+        fast->setErrorStream(errorStream);
+        lexer.reset(fast);
+    } else {
+        DLLexer* generated = new DLLexer(&input);
+        generated->removeErrorListeners();
+        generated->addErrorListener(&errorListener);
+        if (predictionCache) {
+            predictionCache->install(*generated);
+        }
+        lexer.reset(generated);
+    }
+    antlr4::CommonTokenStream tokens(lexer.get());
+
+    if (options.dumpTokens && sink) {
+        dumpTokens(tokens);
     }
 
     DLParser parser(&tokens);
-    antlr4::tree::ParseTree *tree = parser.module();
+    antlr4::tree::ParseTree *tree = nullptr;
+    if (predictionCache) {
+        predictionCache->install(parser);
+    }
+    if (options.profilePrediction) {
+        parser.setProfile(true);
+    }
+
+    // Stage 1: SLL prediction is enough for almost every input and much
+    // cheaper, but may reject valid input; bail out on the first error.
+    auto start = std::chrono::steady_clock::now();
+    parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(
+        antlr4::atn::PredictionMode::SLL);
+    parser.removeErrorListeners();
+    parser.setErrorHandler(std::make_shared<antlr4::BailErrorStrategy>());
+    try {
+        tree = parser.module();
+    } catch (antlr4::ParseCancellationException&) {
+        tree = nullptr;
+    }
+    auto end = std::chrono::steady_clock::now();
+    parseStats.sllParses++;
+    parseStats.sllSeconds += std::chrono::duration<double>(end - start).count();
+
+    // Stage 2: reparse with full LL prediction and the default error
+    // strategy, so genuine syntax errors are reported as usual.
+    if (!tree) {
+        start = std::chrono::steady_clock::now();
+        parser.reset();
+        parser.addErrorListener(&errorListener);
+        parser.setErrorHandler(std::make_shared<antlr4::DefaultErrorStrategy>());
+        parser.getInterpreter<antlr4::atn::ParserATNSimulator>()->setPredictionMode(
+            antlr4::atn::PredictionMode::LL);
+        tree = parser.module();
+        end = std::chrono::steady_clock::now();
+        parseStats.llFallbacks++;
+        parseStats.llSeconds += std::chrono::duration<double>(end - start).count();
+    }
 
+    if (options.profilePrediction) {
+        collectPredictionStats(parser);
+    }
+
+    if (options.dumpParseTree && sink) {
+        dumpParseTree(tree, parser.getRuleNames());
+    }
 
-    std::cout << prettyPrint(tree->toStringTree(&parser)) << std::endl;
+    // The tree of an input with errors can be missing any node the AST
+    // builder expects, so it is not visited.
+    size_t errors = errorListener.errors + (fast ? fast->syntaxErrors() : 0);
+    parseStats.syntaxErrors += errors;
+    if (errors) {
+        Location loc;
+        loc.file = file;
+        return new Module("anonymous", loc);
+    }
     Module* module = visit(tree);
 
     return module;
 }
 
-std::string Parser::prettyPrint (std::string treeString) {
-    int indentSize = 3;
-    int currIndex = 0;
-    std::string outString = std::string(1,treeString[0]);
-    std::string indent = "";
-    for (int i = 1; i < treeString.size(); i++) {
-        if(treeString[i] == '(' && treeString[i+1] != ' '){
-           currIndex += indentSize;
-           std::string indentSpace = "";
-           for(int i = 0; i < currIndex; i++) {
-               indentSpace += " ";
-           }
-           outString += '\n' + indentSpace + '(';
+// The DFA is static in DLParser and shared by every parse in the process, so
+// a warm process mostly predicts from it; misses are steps that had to be
+// simulated on the ATN and added new DFA states.
+void Parser::collectPredictionStats(DLParser& parser) {
+    antlr4::atn::ParseInfo info = parser.getParseInfo();
+    for (const antlr4::atn::DecisionInfo& decision : info.getDecisionInfo()) {
+        parseStats.dfaHits += decision.SLL_DFATransitions + decision.LL_DFATransitions;
+        parseStats.dfaMisses += decision.SLL_ATNTransitions + decision.LL_ATNTransitions;
+    }
+    parseStats.dfaStates = info.getDFASize();
+}
+
+void Parser::dumpTokens(antlr4::CommonTokenStream& tokens) {
+    tokens.fill();
+    for (auto token : tokens.getTokens()) {
+        *sink << token->toString() << '\n';
+    }
+    sink->flush();
+}
+
+// Writes the tree in `toStringTree` form, one rule node per line indented by
+// depth, walking it with an explicit stack instead of building the string.
+void Parser::dumpParseTree(antlr4::tree::ParseTree* tree, const std::vector<std::string>& ruleNames) {
+    const size_t indentSize = 3;
+    std::vector<std::pair<antlr4::tree::ParseTree*, size_t>> stack;
+    stack.emplace_back(tree, 0);
+
+    while (!stack.empty()) {
+        antlr4::tree::ParseTree* node = stack.back().first;
+        size_t child = stack.back().second++;
+
+        if (child == 0) {
+            if (stack.size() > 1) {
+                *sink << '\n';
+                sink->indent((stack.size() - 1) * indentSize);
+            }
+            auto ctx = static_cast<antlr4::RuleContext*>(node);
+            *sink << '(' << ruleNames[ctx->getRuleIndex()];
         }
-        else if(treeString[i] == ')'){
-          outString += ')';
-          if(currIndex > indentSize)
-            currIndex -= indentSize;
+
+        if (child == node->children.size()) {
+            *sink << ')';
+            stack.pop_back();
+            continue;
         }
-        else {
-          outString += treeString[i];
+
+        antlr4::tree::ParseTree* next = node->children[child];
+        if (antlrcpp::is<antlr4::tree::TerminalNode*>(next)) {
+            *sink << ' ' << antlrcpp::escapeWhitespace(next->getText(), false);
+        } else {
+            stack.emplace_back(next, 0);
         }
     }
-    return outString;
+    *sink << '\n';
+    sink->flush();
 }
 
 } // internal namespace
@@ -1,16 +1,117 @@
 #pragma once
 #include "ast/ast.h"
+#include "utils/diagnostics.h"
 #include "antlr4-runtime.h"
 #include "DLParserVisitor.h"
+#include <iostream>
+
+class DLLexer;
 
 namespace dp {
 namespace internal {
 
+// Counters for the two-stage parse: every module is first parsed with pure
+// SLL prediction and a bail-out error strategy, and only reparsed with full LL
+// prediction and error reporting when that fails.
+//
+// With DiagnosticOptions::profilePrediction set, the parser also runs on a
+// profiling ATN simulator and counts how many prediction steps were served by
+// the shared DFA cache versus simulated on the ATN.
+struct ParseStats {
+    size_t sllParses   = 0;
+    size_t llFallbacks = 0;
+    double sllSeconds  = 0;
+    double llSeconds   = 0;
+
+    // Lexer and syntax errors reported, and integer literals too large for
+    // an i64. A module with lexer or syntax errors has no statements; the
+    // parse tree is not turned into an AST.
+    size_t syntaxErrors = 0;
+
+    size_t dfaHits   = 0;
+    size_t dfaMisses = 0;
+    size_t dfaStates = 0; // states in the parser DFA after the parse
+
+    double dfaHitRate() const {
+        size_t total = dfaHits + dfaMisses;
+        return total ? static_cast<double>(dfaHits) / total : 0;
+    }
+};
+
+DiagnosticSink& operator<<(DiagnosticSink& sink, const ParseStats& stats);
+
+// Which lexer feeds the parser: the ATN-simulated DLLexer generated from
+// DLLexer.g4, or the hand-written FastLexer. Both produce the same tokens.
+enum class LexerKind : uint8_t {
+    Generated,
+    Fast
+};
+
+// Private prediction state for the generated lexer and parser. Normally every
+// DLLexer and DLParser in the process predicts from the DFA and context cache
+// held in their static members; a thread that owns one of these predicts from
+// its own instead, so parses on different threads share nothing mutable but
+// the runtime's internal locks. It warms up like the static DFA does.
+class PredictionCache {
+public:
+    PredictionCache() = default;
+    PredictionCache(const PredictionCache&) = delete;
+    PredictionCache& operator=(const PredictionCache&) = delete;
+
+    void install(DLLexer& lexer);
+    void install(DLParser& parser);
+
+private:
+    std::vector<antlr4::dfa::DFA>       lexerDFA;
+    std::vector<antlr4::dfa::DFA>       parserDFA;
+    antlr4::atn::PredictionContextCache lexerContexts;
+    antlr4::atn::PredictionContextCache parserContexts;
+};
+
 class Parser : public DLParserVisitor {
 public:
-    Module* parseModule(antlr4::ANTLRInputStream);
+    Parser() = default;
+    Parser(const DiagnosticOptions& options, DiagnosticSink* sink);
+
+    Module* parseModule(antlr4::CharStream& input);
+
+    void setLexer(LexerKind kind) {
+        lexerKind = kind;
+    }
+
+    // Predict from `cache` rather than the process-wide DFA; see
+    // PredictionCache. The cache must outlive the parse.
+    void setPredictionCache(PredictionCache* cache) {
+        predictionCache = cache;
+    }
+
+    // Where lexer and syntax errors are reported; std::cerr by default.
+    void setErrorStream(std::ostream* stream) {
+        errorStream = stream;
+    }
+
+    const ParseStats& stats() const {
+        return parseStats;
+    }
 private:
-    std::string prettyPrint(std::string);
+    void collectPredictionStats(DLParser& parser);
+    void dumpTokens(antlr4::CommonTokenStream& tokens);
+    void dumpParseTree(antlr4::tree::ParseTree* tree, const std::vector<std::string>& ruleNames);
+
+    Location    locationOf(antlr4::ParserRuleContext* context);
+    Expression* expressionOf(DLParser::ExpressionStatementContext* context);
+
+    DiagnosticOptions options;
+    DiagnosticSink*   sink = nullptr;
+    ParseStats        parseStats;
+    LexerKind         lexerKind = LexerKind::Generated;
+    PredictionCache*  predictionCache = nullptr;
+    std::ostream*     errorStream = &std::cerr;
+
+    // Arena of the module under construction; every node is placed in it.
+    Arena* arena = nullptr;
+    Symbol file;
+
 	antlrcpp::Any visitAryOp(DLParser::AryOpContext *context);
 
 	antlrcpp::Any visitExpressionList(DLParser::ExpressionListContext *context);
@@ -0,0 +1,205 @@
+#include "repl.h"
+#include "ir/builder.h"
+#include "opt/constant_folder.h"
+#include "sema/type_checker.h"
+
+#include <chrono>
+
+namespace dp {
+namespace internal {
+
+static std::string trim(const std::string& text) {
+	size_t begin = text.find_first_not_of(" \t\f\r\n");
+	if (begin == std::string::npos) {
+		return std::string();
+	}
+	size_t end = text.find_last_not_of(" \t\f\r\n");
+	return text.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string> splitStatements(const std::string& source, std::string* rest) {
+	std::vector<std::string> statements;
+	size_t                   start = 0;
+	int                      depth = 0;
+	size_t                   i     = 0;
+	while (i < source.size()) {
+		char c = source[i];
+		if (c == '"') {
+			size_t close = source.find('"', i + 1);
+			i            = close == std::string::npos ? source.size() : close + 1;
+		} else if (c == '/' && i + 1 < source.size() && source[i + 1] == '/') {
+			size_t eol = source.find('\n', i);
+			i          = eol == std::string::npos ? source.size() : eol + 1;
+		} else if (c == '/' && i + 1 < source.size() && source[i + 1] == '*') {
+			size_t close = source.find("*/", i + 2);
+			i            = close == std::string::npos ? source.size() : close + 2;
+		} else {
+			if (c == '(' || c == '[' || c == '{') {
+				depth++;
+			} else if ((c == ')' || c == ']' || c == '}') && depth > 0) {
+				depth--;
+			} else if (c == ';' && depth == 0) {
+				std::string statement = trim(source.substr(start, i + 1 - start));
+				if (statement != ";") {
+					statements.push_back(statement);
+				}
+				start = i + 1;
+			}
+			i++;
+		}
+	}
+	*rest = source.substr(start);
+	return statements;
+}
+
+Repl::Repl(const CompileOptions& options)
+		: options(options), builder(options.codegen) {
+}
+
+void Repl::run(std::istream& in, std::ostream& out) {
+	std::string pending;
+	std::string line;
+	while (!quit) {
+		out << (trim(pending).empty() ? "dp> " : "... ") << std::flush;
+		if (!std::getline(in, line)) {
+			break;
+		}
+		if (trim(pending).empty() && trim(line)[0] == ':') {
+			eval(line, out);
+			pending.clear();
+			continue;
+		}
+		pending += line;
+		pending += '\n';
+
+		std::string rest;
+		if (!splitStatements(pending, &rest).empty()) {
+			eval(pending.substr(0, pending.size() - rest.size()), out);
+			pending = rest;
+		}
+	}
+}
+
+bool Repl::eval(const std::string& input, std::ostream& out) {
+	std::string text = trim(input);
+	if (!text.empty() && text[0] == ':') {
+		return command(text, out);
+	}
+
+	Stats before = stats_;
+	auto  start  = std::chrono::steady_clock::now();
+
+	std::string              rest;
+	std::vector<std::string> statements = splitStatements(text, &rest);
+	if (!trim(rest).empty()) {
+		// Incomplete input still gets parsed, for its syntax error.
+		statements.push_back(trim(rest));
+	}
+	bool ok = true;
+	for (const std::string& statement : statements) {
+		ok = define(statement, out) && ok;
+	}
+
+	if (options.diagnostics.stats) {
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		out << "repl: parsed " << stats_.parsed - before.parsed << ", unchanged "
+		    << stats_.unchanged - before.unchanged << ", compiled " << stats_.compiled - before.compiled << " in "
+		    << seconds * 1000 << " ms, " << definitions.size() << " definitions\n";
+	}
+	return ok;
+}
+
+bool Repl::define(const std::string& text, std::ostream& out) {
+	auto known = definedTexts.find(text);
+	if (known != definedTexts.end()) {
+		stats_.unchanged++;
+		out << "unchanged " << known->second.str() << "\n";
+		return true;
+	}
+
+	antlr4::ANTLRInputStream input(text);
+	input.name = "<repl>";
+	ModulePtr module;
+	{
+		DiagnosticSink sink(out);
+		Parser         parser(options.diagnostics, &sink);
+		parser.setLexer(options.lexer);
+		parser.setPredictionCache(&predictionCache);
+		parser.setErrorStream(&out);
+		module.reset(parser.parseModule(input));
+		stats_.parsed++;
+		if (parser.stats().syntaxErrors) {
+			return false;
+		}
+	}
+	if (module->stmts.size() != 1) {
+		return module->stmts.size() == 0;
+	}
+
+	// Each definition is checked on its own; calls may name the functions
+	// defined before.
+	TypeChecker checker(out);
+	checker.setExternalFunctions(&functions);
+	if (!checker.check(module.get())) {
+		return false;
+	}
+	if (options.optimizationLevel > 0) {
+		ConstantFolder folder;
+		folder.run(module.get());
+	}
+	FunctionDeclaration*          fun      = static_cast<FunctionDeclaration*>(module->stmts[0]);
+	Symbol                        name     = fun->id.name;
+	std::unique_ptr<ir::Function> function = ir::lowerFunction(fun, builder.strings());
+	// Calls are not inlined, so redefining a function changes what every
+	// caller runs.
+	if (options.optimizationLevel > 0) {
+		ir::PassStats passes;
+		ir::optimize(function.get(), &passes);
+	}
+	if (!builder.define(*function, out)) {
+		return false;
+	}
+	stats_.compiled++;
+
+	auto found     = definitions.find(name);
+	bool redefined = found != definitions.end();
+	if (redefined) {
+		definedTexts.erase(found->second.text);
+	} else {
+		order.push_back(name);
+		functions.insert(name);
+	}
+	Definition& definition = definitions[name];
+	definition.text        = text;
+	definition.module      = std::move(module);
+	definedTexts[text]     = name;
+
+	out << (redefined ? "redefined " : "defined ") << name.str() << "\n";
+	return true;
+}
+
+bool Repl::command(const std::string& line, std::ostream& out) {
+	size_t      space    = line.find_first_of(" \t");
+	std::string name     = line.substr(0, space);
+	std::string argument = space == std::string::npos ? std::string() : trim(line.substr(space));
+
+	if (name == ":quit" || name == ":q") {
+		quit = true;
+		return true;
+	}
+	if (name == ":list") {
+		for (Symbol symbol : order) {
+			out << symbol.str() << "\n";
+		}
+		return true;
+	}
+	if (name == ":emit" && argument.size()) {
+		// The only step that touches the whole module.
+		return builder.write(argument, out);
+	}
+	out << "commands: :list, :emit FILE, :quit\n";
+	return name == ":help";
+}
+
+} // namespace internal
+} // namespace dp
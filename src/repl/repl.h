@@ -0,0 +1,77 @@
+#pragma once
+#include "common.h"
+
+#include "codegen/codegen.h"
+#include "driver/driver.h"
+#include "parsing/parsing.h"
+
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+
+// Interactive session. Input is cut into top-level declarations, and each one
+// is parsed on its own and kept, AST and all, under the name it declares. A
+// declaration whose text is the same as the current definition of its name
+// is not parsed again, and only added or changed functions are compiled into
+// the session's ModuleBuilder, so the cost of a line depends on the line and
+// not on how many definitions the session already holds.
+class Repl {
+public:
+	struct Stats {
+		size_t parsed    = 0; // declarations parsed
+		size_t unchanged = 0; // declarations skipped as already defined
+		size_t compiled  = 0; // functions compiled
+	};
+
+	explicit Repl(const CompileOptions& options);
+
+	// Reads input from `in` until it ends or a `:quit` command, writing
+	// prompts, results and errors to `out`.
+	void run(std::istream& in, std::ostream& out);
+
+	// Evaluates a command, or complete top-level declarations. Returns false
+	// if anything in it failed; the session keeps every definition that
+	// succeeded.
+	bool eval(const std::string& input, std::ostream& out);
+
+	size_t definitionCount() const {
+		return definitions.size();
+	}
+
+	const Stats& stats() const {
+		return stats_;
+	}
+
+private:
+	struct Definition {
+		std::string text;
+		ModulePtr   module; // owns the declaration's AST
+	};
+
+	bool define(const std::string& text, std::ostream& out);
+	bool command(const std::string& line, std::ostream& out);
+
+	CompileOptions  options;
+	PredictionCache predictionCache;
+	ModuleBuilder   builder;
+	bool            quit = false;
+	Stats           stats_;
+
+	std::unordered_map<Symbol, Definition, SymbolHash> definitions;
+	std::unordered_set<Symbol, SymbolHash>             functions;    // names of the definitions, for calls
+	std::unordered_map<std::string, Symbol>            definedTexts; // current text of each definition
+	std::vector<Symbol>                                order;        // names in definition order
+};
+
+// Cuts `source` after each `;` that ends a top-level statement, skipping
+// those inside brackets, string literals and comments, and returns the
+// statements with surrounding whitespace trimmed. Whatever follows the last
+// one is left in `rest`.
+std::vector<std::string> splitStatements(const std::string& source, std::string* rest);
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,310 @@
+#include "type_checker.h"
+
+namespace dp {
+namespace internal {
+
+// A tree of literals has no type of its own, only the one its context asks
+// for.
+static bool isConstant(Expression* expr) {
+	switch (expr->kind()) {
+	case ExpressionKind::Literal:
+		return true;
+	case ExpressionKind::Binary: {
+		BinaryExpression* node = static_cast<BinaryExpression*>(expr);
+		return isConstant(node->left) && isConstant(node->right);
+	}
+	default:
+		return false;
+	}
+}
+
+static bool isIntegerLiteral(LiteralExpression* lit) {
+	return lit->typ == LiteralExpression::Typ::DPI32 || lit->typ == LiteralExpression::Typ::DPI64;
+}
+
+TypeChecker::TypeChecker(std::ostream& errors)
+		: out(errors) {
+}
+
+bool TypeChecker::check(Module* module) {
+	size_t before = errors;
+	arena         = &module->arena;
+	for (VariableType*& type : primitives) {
+		type = nullptr;
+	}
+	// Functions are declared up front, so a call may come before the
+	// function it names.
+	functions.clear();
+	for (Statement* stmt : module->stmts) {
+		if (stmt->kind() == StatementKind::FunctionDeclaration) {
+			FunctionDeclaration* fun = static_cast<FunctionDeclaration*>(stmt);
+			if (!functions.insert(fun->id.name).second) {
+				error(fun->loc, "function '" + fun->id.str() + "' is already declared");
+			}
+		}
+	}
+	variables.enterScope();
+	for (Statement* stmt : module->stmts) {
+		checkStatement(stmt, true);
+	}
+	variables.exitScope();
+	arena = nullptr;
+	return errors == before;
+}
+
+// Codegen emits code only inside functions, so that is the only place for
+// variables and expressions, and functions do not nest.
+void TypeChecker::checkStatement(Statement* stmt, bool topLevel) {
+	switch (stmt->kind()) {
+	case StatementKind::FunctionDeclaration:
+		if (!topLevel) {
+			error(stmt->loc, "functions must be declared at the top level");
+			return;
+		}
+		checkFunction(static_cast<FunctionDeclaration*>(stmt));
+		return;
+	case StatementKind::VariableDeclaration:
+		if (topLevel) {
+			error(stmt->loc, "variables must be declared inside a function");
+			return;
+		}
+		checkVariable(static_cast<VariableDeclaration*>(stmt));
+		return;
+	case StatementKind::Expression:
+		if (topLevel) {
+			error(stmt->loc, "expressions must be inside a function");
+			return;
+		}
+		checkExpression(static_cast<ExpressionStatement*>(stmt)->expr, nullptr);
+		return;
+	}
+}
+
+void TypeChecker::checkFunction(FunctionDeclaration* fun) {
+	FunctionType* signature = fun->signature;
+	if (signature->Result) {
+		VariableType* result = resolve(signature->Result, fun->loc);
+		if (result && !result->isUnit()) {
+			error(fun->loc, "function '" + fun->id.str() + "' cannot return " + result->name() +
+			                        ": function results are not supported yet");
+		}
+		signature->Result = result;
+	}
+	checkExpression(fun->body->expr, primitive(PrimitiveVariableTypes::Unit));
+}
+
+void TypeChecker::checkVariable(VariableDeclaration* var) {
+	VariableType* type = var->vartype ? resolve(var->vartype, var->loc) : nullptr;
+	if (!var->vartype) {
+		error(var->loc, "variable '" + var->id.str() + "' needs a type");
+	} else if (type && type->isUnit()) {
+		error(var->loc, "variable '" + var->id.str() + "' cannot have type ()");
+		type = nullptr;
+	}
+	var->vartype = type;
+
+	// Bound before its initializer is checked, as codegen binds it.
+	if (!variables.insert(var->id.name, type)) {
+		error(var->loc, "variable '" + var->id.str() + "' is already declared in this scope");
+	}
+	if (var->init) {
+		checkExpression(var->init, type);
+	}
+}
+
+VariableType* TypeChecker::checkExpression(Expression* expr, VariableType* expected) {
+	VariableType* type = inferExpression(expr, expected);
+	if (type && expected && type->typ != expected->typ) {
+		error(expr->loc, std::string("expected ") + expected->name() + ", found " + type->name());
+		return nullptr;
+	}
+	return type;
+}
+
+VariableType* TypeChecker::inferExpression(Expression* expr, VariableType* expected) {
+	VariableType* type = nullptr;
+	switch (expr->kind()) {
+	case ExpressionKind::Literal:
+		type = checkLiteral(static_cast<LiteralExpression*>(expr), expected);
+		break;
+	case ExpressionKind::Path: {
+		PathExpression* path  = static_cast<PathExpression*>(expr);
+		VariableType* const* bound = variables.lookup(path->id.name);
+		if (!bound) {
+			error(expr->loc, "variable '" + path->id.str() + "' is not declared");
+		} else {
+			// Null if its declaration had an error, which is already reported.
+			type = *bound;
+		}
+		break;
+	}
+	case ExpressionKind::Binary:
+		type = checkBinary(static_cast<BinaryExpression*>(expr), expected);
+		break;
+	case ExpressionKind::Block:
+		type = checkBlock(static_cast<BlockExpession*>(expr));
+		break;
+	case ExpressionKind::Call:
+		type = checkCall(static_cast<CallExpression*>(expr));
+		break;
+	default:
+		error(expr->loc, "expression is not supported yet");
+		break;
+	}
+	expr->type = type;
+	return type;
+}
+
+VariableType* TypeChecker::checkLiteral(LiteralExpression* lit, VariableType* expected) {
+	typedef LiteralExpression::Typ Typ;
+	if (lit->typ == Typ::DPString) {
+		return primitive(PrimitiveVariableTypes::Str);
+	}
+
+	PrimitiveVariableTypes want = expected ? expected->typ : PrimitiveVariableTypes::Unit;
+	if (isIntegerLiteral(lit)) {
+		int64_t value = lit->typ == Typ::DPI32 ? lit->i32val : lit->i64val;
+		switch (want) {
+		case PrimitiveVariableTypes::I32:
+			if (lit->typ != Typ::DPI32) {
+				error(lit->loc, "literal " + std::to_string(value) + " does not fit in i32");
+				return nullptr;
+			}
+			break;
+		case PrimitiveVariableTypes::I64:
+			lit->typ    = Typ::DPI64;
+			lit->i64val = value;
+			break;
+		case PrimitiveVariableTypes::F32:
+			lit->typ    = Typ::DPF32;
+			lit->f32val = static_cast<float>(value);
+			break;
+		case PrimitiveVariableTypes::F64:
+			lit->typ    = Typ::DPF64;
+			lit->f64val = static_cast<double>(value);
+			break;
+		case PrimitiveVariableTypes::Unit:
+		case PrimitiveVariableTypes::Str:
+			break;
+		}
+	} else if (want == PrimitiveVariableTypes::F32 && lit->typ == Typ::DPF64) {
+		lit->f32val = static_cast<float>(lit->f64val);
+		lit->typ    = Typ::DPF32;
+	} else if (want == PrimitiveVariableTypes::F64 && lit->typ == Typ::DPF32) {
+		lit->f64val = lit->f32val;
+		lit->typ    = Typ::DPF64;
+	}
+
+	switch (lit->typ) {
+	case Typ::DPI32:
+		return primitive(PrimitiveVariableTypes::I32);
+	case Typ::DPI64:
+		return primitive(PrimitiveVariableTypes::I64);
+	case Typ::DPF32:
+		return primitive(PrimitiveVariableTypes::F32);
+	default:
+		return primitive(PrimitiveVariableTypes::F64);
+	}
+}
+
+VariableType* TypeChecker::checkBinary(BinaryExpression* node, VariableType* expected) {
+	// Without an expected type the operand that has a type of its own sets
+	// it for the other, whichever side it is on.
+	Expression* first  = node->left;
+	Expression* second = node->right;
+	if (!expected && isConstant(first) && !isConstant(second)) {
+		std::swap(first, second);
+	}
+	VariableType* type = checkExpression(first, expected);
+	if (!type) {
+		checkExpression(second, nullptr);
+		return nullptr;
+	}
+	if (!checkExpression(second, type)) {
+		return nullptr;
+	}
+
+	if (type->isUnit() || type->isStr()) {
+		error(node->loc, std::string("operands must be numbers, found ") + type->name());
+		return nullptr;
+	}
+	if (type->isFloat() && (node->op == BinaryOperator::BitwiseAnd || node->op == BinaryOperator::BitwiseOr ||
+	                        node->op == BinaryOperator::ShiftLeft)) {
+		error(node->loc, std::string("bitwise operators need integer operands, found ") + type->name());
+		return nullptr;
+	}
+	return type;
+}
+
+VariableType* TypeChecker::checkBlock(BlockExpession* block) {
+	variables.enterScope();
+	for (Statement* stmt : block->stmts) {
+		checkStatement(stmt, false);
+	}
+	variables.exitScope();
+	return primitive(PrimitiveVariableTypes::Unit);
+}
+
+// Functions take no arguments and return (), so a call is only checked for
+// naming one.
+VariableType* TypeChecker::checkCall(CallExpression* call) {
+	if (call->receiver || call->method->kind() != ExpressionKind::Path) {
+		error(call->loc, "only functions can be called, by name");
+		return nullptr;
+	}
+	PathExpression* path = static_cast<PathExpression*>(call->method);
+	if (!functions.count(path->id.name) && !(externalFunctions && externalFunctions->count(path->id.name))) {
+		error(call->loc, "function '" + path->id.str() + "' is not declared");
+		return nullptr;
+	}
+	if (!call->params.empty()) {
+		error(call->loc, "function '" + path->id.str() + "' takes no arguments");
+		return nullptr;
+	}
+	return primitive(PrimitiveVariableTypes::Unit);
+}
+
+VariableType* TypeChecker::resolve(Type* type, const Location& loc) {
+	switch (type->kind()) {
+	case TypeKind::Variable:
+		return primitive(static_cast<VariableType*>(type)->typ);
+	case TypeKind::Named: {
+		const std::string& name = static_cast<NamedType*>(type)->name.str();
+		if (name == "i32") {
+			return primitive(PrimitiveVariableTypes::I32);
+		} else if (name == "i64") {
+			return primitive(PrimitiveVariableTypes::I64);
+		} else if (name == "f32") {
+			return primitive(PrimitiveVariableTypes::F32);
+		} else if (name == "f64") {
+			return primitive(PrimitiveVariableTypes::F64);
+		} else if (name == "str") {
+			return primitive(PrimitiveVariableTypes::Str);
+		}
+		error(loc, "unknown type '" + name + "'");
+		return nullptr;
+	}
+	case TypeKind::Function:
+		error(loc, "function types are not supported here");
+		return nullptr;
+	}
+	return nullptr;
+}
+
+// One instance per primitive and module, so types compare by `typ` or by
+// pointer alike.
+VariableType* TypeChecker::primitive(PrimitiveVariableTypes typ) {
+	VariableType*& type = primitives[static_cast<size_t>(typ)];
+	if (!type) {
+		type = arena->make<VariableType>(typ);
+	}
+	return type;
+}
+
+void TypeChecker::error(const Location& loc, const std::string& message) {
+	out << "line " << loc.line << ":" << loc.firstColumn << " " << message << std::endl;
+	errors++;
+}
+
+} // namespace internal
+} // namespace dp
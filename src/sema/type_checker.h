@@ -0,0 +1,68 @@
+#pragma once
+#include "common.h"
+
+#include "ast/ast.h"
+#include "utils/symbol_table.h"
+
+#include <ostream>
+#include <unordered_set>
+
+namespace dp {
+namespace internal {
+
+// Resolves a concrete type for every declaration and expression of a module
+// and checks that they agree. Type names written in the source are replaced
+// by the VariableType they denote, and every Expression gets its `type`.
+// Literals take the type their context expects, so the literal in
+// `let a : i64 = 1` becomes an i64. Codegen relies on these types and must
+// only be given modules that checked cleanly.
+class TypeChecker {
+public:
+	typedef std::unordered_set<Symbol, SymbolHash> FunctionSet;
+
+	explicit TypeChecker(std::ostream& errors);
+
+	// Functions declared outside the module that its calls may name, such as
+	// those the REPL compiled before. Not owned.
+	void setExternalFunctions(const FunctionSet* functions) {
+		externalFunctions = functions;
+	}
+
+	// Reports every error to the stream given at construction. Returns false
+	// if there were any.
+	bool check(Module* module);
+
+	size_t errorCount() const {
+		return errors;
+	}
+
+private:
+	void checkStatement(Statement* stmt, bool topLevel);
+	void checkFunction(FunctionDeclaration* fun);
+	void checkVariable(VariableDeclaration* var);
+
+	// Each returns the expression's type, or null after reporting an error.
+	// `expected`, if given, is the type the context needs.
+	VariableType* checkExpression(Expression* expr, VariableType* expected);
+	VariableType* inferExpression(Expression* expr, VariableType* expected);
+	VariableType* checkLiteral(LiteralExpression* lit, VariableType* expected);
+	VariableType* checkBinary(BinaryExpression* node, VariableType* expected);
+	VariableType* checkBlock(BlockExpession* block);
+	VariableType* checkCall(CallExpression* call);
+
+	VariableType* resolve(Type* type, const Location& loc);
+	VariableType* primitive(PrimitiveVariableTypes typ);
+
+	void error(const Location& loc, const std::string& message);
+
+	std::ostream&                    out;
+	size_t                           errors = 0;
+	Arena*                           arena  = nullptr;
+	VariableType*                    primitives[6];
+	ScopedSymbolTable<VariableType*> variables;
+	FunctionSet                      functions; // declared by the module
+	const FunctionSet*               externalFunctions = nullptr;
+};
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,57 @@
+#include "arena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace dp {
+namespace internal {
+
+Arena::~Arena() {
+	while (head) {
+		Chunk* prev = head->prev;
+		std::free(head);
+		head = prev;
+	}
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+	// Oversized requests get a chunk of their own; the current chunk stays
+	// the bump target so its free tail is not wasted.
+	size_t header    = (sizeof(Chunk) + align - 1) & ~(align - 1);
+	bool   dedicated = size > kChunkSize / 4;
+	size_t bytes     = dedicated ? header + size : kChunkSize;
+
+	Chunk* chunk = static_cast<Chunk*>(std::malloc(bytes));
+	if (!chunk) {
+		throw std::bad_alloc();
+	}
+	reserved += bytes;
+	chunks++;
+	allocations++;
+	allocated += size;
+
+	char* start = reinterpret_cast<char*>(chunk) + header;
+	if (dedicated && head) {
+		chunk->prev = head->prev;
+		head->prev  = chunk;
+		return start;
+	}
+
+	chunk->prev = head;
+	head        = chunk;
+	cursor      = start + size;
+	limit       = reinterpret_cast<char*>(chunk) + bytes;
+	return start;
+}
+
+StringRef Arena::copyString(const std::string& str) {
+	if (str.empty()) {
+		return StringRef{ "", 0 };
+	}
+	char* data = static_cast<char*>(allocate(str.size(), 1));
+	std::memcpy(data, str.data(), str.size());
+	return StringRef{ data, static_cast<uint32_t>(str.size()) };
+}
+
+} // namespace internal
+} // namespace dp
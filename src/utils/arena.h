@@ -0,0 +1,134 @@
+#pragma once
+#include "common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace dp {
+namespace internal {
+
+// Non-owning view of characters that live in an Arena (or in static storage).
+struct StringRef {
+	const char* data;
+	uint32_t    size;
+
+	std::string str() const {
+		return std::string(data, size);
+	}
+
+	bool operator==(const StringRef& other) const {
+		return size == other.size && std::char_traits<char>::compare(data, other.data, size) == 0;
+	}
+};
+
+// Fixed-size array placed in an Arena.
+template <typename T>
+class ArenaArray {
+public:
+	ArenaArray()
+			: data_(nullptr), size_(0) {
+	}
+	ArenaArray(T* data, size_t size)
+			: data_(data), size_(static_cast<uint32_t>(size)) {
+	}
+
+	T* begin() const {
+		return data_;
+	}
+	T* end() const {
+		return data_ + size_;
+	}
+	size_t size() const {
+		return size_;
+	}
+	bool empty() const {
+		return size_ == 0;
+	}
+	T& operator[](size_t i) const {
+		return data_[i];
+	}
+
+private:
+	T*       data_;
+	uint32_t size_;
+};
+
+// Bump allocator that owns every node of one Module. Objects placed in the
+// arena are never destroyed one by one, so they must be trivially
+// destructible; releasing the arena frees all of them at once.
+class Arena {
+public:
+	Arena() = default;
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* allocate(size_t size, size_t align) {
+		uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+		if (p + size > reinterpret_cast<uintptr_t>(limit)) {
+			return allocateSlow(size, align);
+		}
+		cursor = reinterpret_cast<char*>(p + size);
+		allocations++;
+		allocated += size;
+		return reinterpret_cast<void*>(p);
+	}
+
+	template <typename T, typename... Args>
+	T* make(Args&&... args) {
+		static_assert(std::is_trivially_destructible<T>::value,
+									"arena objects are released without running destructors");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	template <typename T>
+	ArenaArray<T> makeArray(size_t size) {
+		static_assert(std::is_trivially_destructible<T>::value,
+									"arena objects are released without running destructors");
+		T* data = static_cast<T*>(allocate(sizeof(T) * size, alignof(T)));
+		for (size_t i = 0; i < size; i++) {
+			new (data + i) T();
+		}
+		return ArenaArray<T>(data, size);
+	}
+
+	StringRef copyString(const std::string& str);
+
+	size_t allocationCount() const {
+		return allocations;
+	}
+	// Bytes handed out, not counting alignment padding and free chunk tails.
+	size_t bytesAllocated() const {
+		return allocated;
+	}
+	size_t bytesReserved() const {
+		return reserved;
+	}
+	size_t chunkCount() const {
+		return chunks;
+	}
+
+private:
+	static const size_t kChunkSize = 64 * 1024;
+
+	struct Chunk {
+		Chunk* prev;
+	};
+
+	void* allocateSlow(size_t size, size_t align);
+
+	Chunk* head        = nullptr;
+	char*  cursor      = nullptr;
+	char*  limit       = nullptr;
+	size_t allocations = 0;
+	size_t allocated   = 0;
+	size_t reserved    = 0;
+	size_t chunks      = 0;
+};
+
+} // namespace internal
+} // namespace dp
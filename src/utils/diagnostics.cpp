@@ -0,0 +1,84 @@
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace dp {
+namespace internal {
+
+DiagnosticSink::DiagnosticSink(std::ostream& out)
+		: out(out), buffer(kBufferSize), used(0) {
+}
+
+DiagnosticSink::~DiagnosticSink() {
+	flush();
+}
+
+DiagnosticSink& DiagnosticSink::write(const char* data, size_t size) {
+	if (used + size > buffer.size()) {
+		flush();
+		if (size > buffer.size()) {
+			out.write(data, size);
+			return *this;
+		}
+	}
+	std::memcpy(buffer.data() + used, data, size);
+	used += size;
+	return *this;
+}
+
+DiagnosticSink& DiagnosticSink::indent(size_t width) {
+	static const char spaces[] = "                                ";
+	while (width > 0) {
+		size_t n = std::min(width, sizeof(spaces) - 1);
+		write(spaces, n);
+		width -= n;
+	}
+	return *this;
+}
+
+void DiagnosticSink::flush() {
+	if (used) {
+		out.write(buffer.data(), used);
+		used = 0;
+	}
+	out.flush();
+}
+
+DiagnosticSink& DiagnosticSink::operator<<(char c) {
+	if (used == buffer.size()) {
+		flush();
+	}
+	buffer[used++] = c;
+	return *this;
+}
+
+DiagnosticSink& DiagnosticSink::operator<<(const char* str) {
+	return write(str, std::strlen(str));
+}
+
+DiagnosticSink& DiagnosticSink::operator<<(const std::string& str) {
+	return write(str.data(), str.size());
+}
+
+size_t peakResidentKiB() {
+#ifdef _WIN32
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,58 @@
+#pragma once
+#include "common.h"
+
+#include <ostream>
+#include <type_traits>
+
+namespace dp {
+namespace internal {
+
+struct DiagnosticOptions {
+	bool dumpTokens    = false;
+	bool dumpParseTree = false;
+	bool dumpIR        = false;
+	bool stats         = false;
+
+	// Profile ANTLR prediction to report the DFA cache hit rate. Costs a
+	// clock read per decision, so it is off unless asked for.
+	bool profilePrediction = false;
+};
+
+// Buffered writer for diagnostic dumps. Output is collected in a fixed-size
+// buffer and handed to the underlying stream in large chunks, so a dump never
+// flushes per line and never has to be materialized as one string.
+class DiagnosticSink {
+public:
+	explicit DiagnosticSink(std::ostream& out);
+	~DiagnosticSink();
+
+	DiagnosticSink(const DiagnosticSink&) = delete;
+	DiagnosticSink& operator=(const DiagnosticSink&) = delete;
+
+	DiagnosticSink& write(const char* data, size_t size);
+	DiagnosticSink& indent(size_t width);
+	void            flush();
+
+	DiagnosticSink& operator<<(char c);
+	DiagnosticSink& operator<<(const char* str);
+	DiagnosticSink& operator<<(const std::string& str);
+
+	template <typename T>
+	typename std::enable_if<std::is_arithmetic<T>::value, DiagnosticSink&>::type
+	operator<<(T value) {
+		return *this << std::to_string(value);
+	}
+
+private:
+	static const size_t kBufferSize = 64 * 1024;
+
+	std::ostream&     out;
+	std::vector<char> buffer;
+	size_t            used;
+};
+
+// Peak resident set size of the process in KiB, or 0 where unsupported.
+size_t peakResidentKiB();
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,99 @@
+#include "symbol.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+
+namespace {
+
+struct Key {
+	const char* data;
+	size_t      size;
+
+	bool operator==(const Key& other) const {
+		return size == other.size && std::memcmp(data, other.data, size) == 0;
+	}
+};
+
+struct KeyHash {
+	size_t operator()(const Key& key) const {
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < key.size; i++) {
+			hash = (hash ^ static_cast<unsigned char>(key.data[i])) * 1099511628211ull;
+		}
+		return static_cast<size_t>(hash);
+	}
+};
+
+// Strings live in fixed-size blocks that never move, so a symbol's string can
+// be read without locking: the block pointer is published before any id in
+// it is handed out, and ids are only handed out under the mutex.
+struct SymbolTable {
+	static const uint32_t kBlockBits = 16;
+	static const uint32_t kBlockSize = 1u << kBlockBits;
+	static const uint32_t kMaxBlocks = 1u << (32 - kBlockBits);
+
+	std::mutex                                 mutex;
+	std::unordered_map<Key, uint32_t, KeyHash> ids;   // keys point into the blocks
+	uint32_t                                   count = 0;
+
+	// Zero-initialized, as the table has static storage duration.
+	std::atomic<std::string*> blocks[kMaxBlocks];
+
+	SymbolTable() {
+		add("", 0); // id 0 is the empty symbol
+	}
+
+	~SymbolTable() {
+		for (uint32_t i = 0; i < kMaxBlocks && blocks[i].load(); i++) {
+			delete[] blocks[i].load();
+		}
+	}
+
+	// Caller holds `mutex`.
+	uint32_t add(const char* data, size_t size) {
+		uint32_t     id    = count++;
+		std::string* block = blocks[id >> kBlockBits].load(std::memory_order_relaxed);
+		if (!block) {
+			block = new std::string[kBlockSize];
+			blocks[id >> kBlockBits].store(block, std::memory_order_release);
+		}
+		std::string& stored = block[id & (kBlockSize - 1)];
+		stored.assign(data, size);
+		ids.emplace(Key{ stored.data(), stored.size() }, id);
+		return id;
+	}
+
+	const std::string& get(uint32_t id) const {
+		return blocks[id >> kBlockBits].load(std::memory_order_acquire)[id & (kBlockSize - 1)];
+	}
+};
+
+SymbolTable& symbols() {
+	static SymbolTable table;
+	return table;
+}
+
+} // namespace
+
+Symbol Symbol::intern(const char* data, size_t size) {
+	SymbolTable&                table = symbols();
+	std::lock_guard<std::mutex> lock(table.mutex);
+	auto                        it = table.ids.find(Key{ data, size });
+	if (it != table.ids.end()) {
+		return Symbol(it->second);
+	}
+	return Symbol(table.add(data, size));
+}
+
+const std::string& Symbol::str() const {
+	return symbols().get(id_);
+}
+
+} // namespace internal
+} // namespace dp
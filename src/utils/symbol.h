@@ -0,0 +1,57 @@
+#pragma once
+#include "common.h"
+
+#include <cstdint>
+
+namespace dp {
+namespace internal {
+
+// A name interned in the process-wide string table. Symbols compare and hash
+// by their integer id; the characters are only touched when interning and
+// when printing. Interning and str() are safe to call from any thread.
+class Symbol {
+public:
+	Symbol()
+			: id_(0) {
+	}
+
+	static Symbol intern(const char* data, size_t size);
+	static Symbol intern(const std::string& str) {
+		return intern(str.data(), str.size());
+	}
+
+	const std::string& str() const;
+
+	uint32_t id() const {
+		return id_;
+	}
+	bool empty() const {
+		return id_ == 0;
+	}
+
+	bool operator==(Symbol other) const {
+		return id_ == other.id_;
+	}
+	bool operator!=(Symbol other) const {
+		return id_ != other.id_;
+	}
+	bool operator<(Symbol other) const {
+		return id_ < other.id_;
+	}
+
+private:
+	explicit Symbol(uint32_t id)
+			: id_(id) {
+	}
+
+	uint32_t id_;
+};
+
+struct SymbolHash {
+	size_t operator()(Symbol symbol) const {
+		return symbol.id();
+	}
+};
+
+} // namespace internal
+} // namespace dp
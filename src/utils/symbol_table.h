@@ -0,0 +1,75 @@
+#pragma once
+#include "common.h"
+#include "utils/symbol.h"
+
+#include <unordered_map>
+
+namespace dp {
+namespace internal {
+
+// Lexically scoped map from symbols to values. Inner bindings shadow outer
+// ones and are dropped when their scope exits; lookups are a single integer
+// hash probe regardless of nesting depth.
+template <typename T>
+class ScopedSymbolTable {
+public:
+	void enterScope() {
+		scopes.push_back(bindings.size());
+	}
+
+	void exitScope() {
+		size_t start = scopes.back();
+		scopes.pop_back();
+		while (bindings.size() > start) {
+			Binding& binding = bindings.back();
+			if (binding.shadowed) {
+				innermost[binding.name] = binding.shadowed;
+			} else {
+				innermost.erase(binding.name);
+			}
+			bindings.pop_back();
+		}
+	}
+
+	// Binds `name` in the current scope. Returns false if it is already bound
+	// in this very scope.
+	bool insert(Symbol name, const T& value) {
+		uint32_t& slot = innermost[name];
+		if (slot && (scopes.empty() || slot > scopes.back())) {
+			return false;
+		}
+		bindings.push_back(Binding{ name, value, slot });
+		slot = static_cast<uint32_t>(bindings.size());
+		return true;
+	}
+
+	const T* lookup(Symbol name) const {
+		auto it = innermost.find(name);
+		if (it == innermost.end()) {
+			return nullptr;
+		}
+		return &bindings[it->second - 1].value;
+	}
+
+	T* lookup(Symbol name) {
+		return const_cast<T*>(static_cast<const ScopedSymbolTable*>(this)->lookup(name));
+	}
+
+	size_t depth() const {
+		return scopes.size();
+	}
+
+private:
+	struct Binding {
+		Symbol   name;
+		T        value;
+		uint32_t shadowed; // 1-based index of the binding this one hides, or 0
+	};
+
+	std::vector<Binding>                           bindings;
+	std::vector<size_t>                            scopes;
+	std::unordered_map<Symbol, uint32_t, SymbolHash> innermost; // 1-based
+};
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,97 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace dp {
+namespace internal {
+
+ThreadPool::ThreadPool(size_t workers) {
+	workers = std::max<size_t>(workers, 1);
+	for (size_t i = 0; i < workers; i++) {
+		queues.emplace_back(new Queue());
+	}
+	for (size_t i = 0; i < workers; i++) {
+		threads.emplace_back([this, i]() { run(i); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+size_t ThreadPool::hardwareWorkers() {
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+void ThreadPool::submit(Task task) {
+	{
+		// Queued under the pool mutex, so a worker about to sleep either sees
+		// the count or is woken by the notification. Workers never take the
+		// pool mutex while holding a deque's.
+		std::lock_guard<std::mutex> lock(mutex);
+		Queue&                      queue = *queues[next++ % queues.size()];
+		{
+			std::lock_guard<std::mutex> queueLock(queue.mutex);
+			queue.tasks.push_back(std::move(task));
+		}
+		unfinished++;
+		queued++;
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this]() { return unfinished == 0; });
+}
+
+// Own deque first, newest task first; then the other deques, oldest first.
+bool ThreadPool::take(size_t self, Task* task) {
+	for (size_t i = 0; i < queues.size(); i++) {
+		Queue&                      queue = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty()) {
+			continue;
+		}
+		if (i == 0) {
+			*task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			*task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		queued--;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::run(size_t self) {
+	for (;;) {
+		Task task;
+		if (take(self, &task)) {
+			task(self);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--unfinished == 0) {
+				idle.notify_all();
+			}
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [this]() { return stopping || queued > 0; });
+		if (stopping && queued == 0) {
+			return;
+		}
+	}
+}
+
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,64 @@
+#pragma once
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace dp {
+namespace internal {
+
+// Fixed set of worker threads with one task deque each. A worker runs tasks
+// from the back of its own deque and, once that is empty, steals from the
+// front of the others', so a few expensive tasks do not leave the other
+// workers idle behind a static split. Tasks receive the index of the worker
+// running them, for per-worker state.
+class ThreadPool {
+public:
+	typedef std::function<void(size_t worker)> Task;
+
+	explicit ThreadPool(size_t workers);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const {
+		return queues.size();
+	}
+
+	// Queues `task` on the next worker in round-robin order.
+	void submit(Task task);
+
+	// Blocks until every submitted task has finished.
+	void wait();
+
+	// Number of workers the hardware supports, at least 1.
+	static size_t hardwareWorkers();
+
+private:
+	struct Queue {
+		std::mutex       mutex;
+		std::deque<Task> tasks;
+	};
+
+	void run(size_t self);
+	bool take(size_t self, Task* task);
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread>            threads;
+
+	std::mutex              mutex; // guards the counters below for waiting
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::atomic<size_t>     queued{ 0 };
+	size_t                  unfinished = 0;
+	size_t                  next       = 0;
+	bool                    stopping   = false;
+};
+
+} // namespace internal
+} // namespace dp
@@ -1,40 +1,163 @@
 #include "codegen/codegen.h"
 
 #include "ast/ast.h"
+#include "ir/builder.h"
 
+#include "codegen.h"
 #include "gtest/gtest.h"
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <unistd.h>
 
 using namespace dp;
 using namespace dp::internal;
+using namespace dp::internal::test;
 
 TEST(testCase, codegen) {
-	auto mod = std::make_unique<Module>("Test");
+	auto   mod   = std::make_unique<Module>("Test");
+	Arena& arena = mod->arena;
 
-	auto mainFunc = std::make_unique<FunctionDeclaration>("main");
+	auto mainFunc = arena.make<FunctionDeclaration>("main");
 
-	auto sig            = std::make_unique<FunctionType>();
-	mainFunc->signature = std::move(sig);
+	auto sig            = arena.make<FunctionType>();
+	mainFunc->signature = sig;
 
-	auto mainFuncBody = std::make_unique<BlockExpession>();
+	auto mainFuncBody = arena.make<BlockExpession>();
 
-	auto var1Decl     = std::make_unique<VariableDeclaration>("var");
-	var1Decl->vartype = std::make_unique<VariableType>(PrimitiveVariableTypes::I32);
+	auto var1Decl     = arena.make<VariableDeclaration>("var");
+	var1Decl->vartype = arena.make<VariableType>(PrimitiveVariableTypes::I32);
 
-	auto addExp   = std::make_unique<BinaryExpression>(BinaryOperator::Plus);
-	addExp->left  = std::make_unique<LiteralExpression>(1);
-	addExp->right = std::make_unique<LiteralExpression>(2);
+	auto addExp   = arena.make<BinaryExpression>(BinaryOperator::Plus);
+	addExp->left  = arena.make<LiteralExpression>(1);
+	addExp->right = arena.make<LiteralExpression>(2);
 
-	var1Decl->init = std::move(addExp);
+	var1Decl->init = addExp;
 
-	mainFuncBody->stmts.push_back(std::move(var1Decl));
-	// mainFunc->body = std::move(mainFuncBody);
-	// mod->stmts.push_back(std::move(mainFunc));
+	mainFuncBody->stmts    = arena.makeArray<Statement*>(1);
+	mainFuncBody->stmts[0] = var1Decl;
+	// mainFunc->body = mainFuncBody;
+	// mod->stmts = ...;
 
 	// CodeGen::generateWasm(mod.get());
 
 	//ASSERT_STREQ(gen.genarate(addexp), source);
 }
 
+static uint32_t readLEB128(const std::string& bytes, size_t* pos) {
+	uint32_t value = 0;
+	for (int shift = 0;; shift += 7) {
+		uint8_t byte = static_cast<uint8_t>(bytes[(*pos)++]);
+		value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+}
+
+// The entry count of each section of a wasm binary, by section id.
+static std::map<uint8_t, uint32_t> sectionCounts(const std::string& bytes) {
+	std::map<uint8_t, uint32_t> counts;
+	size_t                      pos = 8; // magic and version
+	while (pos < bytes.size()) {
+		uint8_t  id   = static_cast<uint8_t>(bytes[pos++]);
+		uint32_t size = readLEB128(bytes, &pos);
+		size_t   end  = pos + size;
+		if (id != 0) {
+			counts[id] = readLEB128(bytes, &pos);
+		}
+		pos = end;
+	}
+	return counts;
+}
+
+TEST(testCase, functionsShareOneTypePerSignature) {
+	const uint32_t kFunctions = 500;
+	std::string    source;
+	for (uint32_t i = 0; i < kFunctions; i++) {
+		source += "fun f" + std::to_string(i) + "() -> () {\n    let a : i32 = " + std::to_string(i) + ";\n};\n";
+	}
+	ModulePtr module = checkSource(source);
+
+	std::string        wasm = "/tmp/dp_codegen_test_" + std::to_string(::getpid()) + ".wasm";
+	std::ostringstream errors;
+	CodegenStats       stats;
+	EXPECT_TRUE(CodeGen::generateWasm(*ir::lowerModule(module.get()), wasm, errors, &stats));
+	std::ifstream file(wasm, std::ios::binary);
+	std::string   bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	::unlink(wasm.c_str());
+	ASSERT_GT(bytes.size(), 8u) << errors.str();
+
+	std::map<uint8_t, uint32_t> counts = sectionCounts(bytes);
+	EXPECT_EQ(counts[1], 1u);          // type
+	EXPECT_EQ(counts[3], kFunctions); // function
+	EXPECT_EQ(stats.types, 1u);
+	EXPECT_EQ(stats.bytes, bytes.size());
+}
+
+TEST(testCase, tailCallsCanBeTurnedOff) {
+	std::unique_ptr<ir::Module> lowered = ir::lowerModule(checkSource("fun f() -> () {};\nfun g() -> () {\n    f();\n};").get());
+	std::ostringstream          errors;
+
+	std::string wasm = "/tmp/dp_codegen_test_" + std::to_string(::getpid()) + ".wasm";
+	for (bool tailCalls : { true, false }) {
+		CodegenOptions options;
+		options.tailCalls = tailCalls;
+		CodegenStats stats;
+		EXPECT_TRUE(CodeGen::generateWasm(*lowered, wasm, errors, &stats, options));
+		EXPECT_EQ(stats.tailCalls, tailCalls ? 1u : 0u);
+		EXPECT_NE(stats.bytes, 0u);
+	}
+	::unlink(wasm.c_str());
+	EXPECT_EQ(errors.str(), "");
+}
+
+TEST(testCase, failuresAreReturned) {
+	ir::Module module;
+	module.functions.emplace_back(new ir::Function("f"));
+	ir::Builder builder(module.functions.back().get());
+	builder.setInsertBlock(builder.createBlock());
+	builder.call(Symbol::intern("missing"));
+	builder.ret();
+
+	std::string        wasm = "/tmp/dp_codegen_test_" + std::to_string(::getpid()) + ".wasm";
+	std::ostringstream errors;
+	::unlink(wasm.c_str());
+	EXPECT_FALSE(CodeGen::generateWasm(module, wasm, errors));
+	EXPECT_NE(::access(wasm.c_str(), F_OK), 0);
+	EXPECT_FALSE(CodeGen::generateWasm(ir::Module(), "/nonexistent/dir/out.wasm", errors));
+	EXPECT_NE(errors.str().find("cannot write '/nonexistent/dir/out.wasm'"), std::string::npos) << errors.str();
+}
+
+TEST(testCase, encoderMatchesWabt) {
+	const char* sources[] = {
+		"fun main() -> () {};",
+		"fun main() -> () {\n    main();\n};",
+		"fun f() -> () {\n    let x : i32;\n    let a : i32 = 7 / x;\n    a / a;\n};\n"
+		"fun g() -> () {\n    let y : i64 = 300;\n    let z : f32 = 1.5;\n    let w : f64 = 2.5;\n"
+		"    y * y;\n    z + z;\n    w - w;\n    f();\n};",
+		"fun main() -> () {\n    let s : str = \"hello\";\n    let t : str = \"world\";\n    let u : str = s;\n};",
+	};
+	std::string wasm = "/tmp/dp_codegen_test_" + std::to_string(::getpid()) + ".wasm";
+	for (const char* source : sources) {
+		std::unique_ptr<ir::Module> lowered = ir::lowerModule(checkSource(source).get());
+		std::ostringstream          errors;
+
+		// Built and written by both, which must agree byte for byte.
+		for (bool tailCalls : { true, false }) {
+			CodegenOptions options;
+			options.tailCalls = tailCalls;
+			options.verify    = true;
+			CodegenStats stats;
+			EXPECT_TRUE(CodeGen::generateWasm(*lowered, wasm, errors, &stats, options)) << source;
+			EXPECT_EQ(errors.str(), "") << source;
+			EXPECT_NE(stats.bytes, 0u) << source;
+		}
+	}
+	::unlink(wasm.c_str());
+}
+
 int main(int argc, char** argv) {
 	testing::InitGoogleTest(&argc, argv);
 	return RUN_ALL_TESTS();
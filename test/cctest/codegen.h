@@ -0,0 +1,51 @@
+#pragma once
+#include "ir/builder.h"
+#include "ir/passes.h"
+#include "parsing/parsing.h"
+#include "sema/type_checker.h"
+
+#include "gtest/gtest.h"
+#include <sstream>
+
+namespace dp {
+namespace internal {
+namespace test {
+
+// Parses and checks `source`, failing the test on any type error.
+inline ModulePtr checkSource(const std::string& source) {
+	antlr4::ANTLRInputStream input(source);
+	Parser                   parser;
+	ModulePtr                module(parser.parseModule(input));
+	std::ostringstream       errors;
+	TypeChecker              checker(errors);
+	EXPECT_TRUE(checker.check(module.get())) << errors.str();
+	return module;
+}
+
+// Checks `body` as the body of `fun main() -> ()` and lowers it without
+// running the IR passes, so every `let` is still there.
+inline std::unique_ptr<ir::Function> lowerBody(const std::string& body) {
+	ModulePtr      module = checkSource("fun main() -> () {\n" + body + "\n};");
+	ir::StringPool strings;
+	return ir::lowerFunction(static_cast<FunctionDeclaration*>(module->stmts[0]), &strings);
+}
+
+// Checks, lowers and optimizes `source`, as the driver does before
+// inlining.
+inline std::unique_ptr<ir::Module> lowerSource(const std::string& source) {
+	ModulePtr                   module  = checkSource(source);
+	std::unique_ptr<ir::Module> lowered = ir::lowerModule(module.get());
+	ir::PassStats               passes;
+	ir::optimize(lowered.get(), &passes);
+	return lowered;
+}
+
+inline std::string print(const ir::Function& function) {
+	std::ostringstream text;
+	function.print(text);
+	return text.str();
+}
+
+} // namespace test
+} // namespace internal
+} // namespace dp
@@ -0,0 +1,137 @@
+#include "opt/constant_folder.h"
+#include "parsing/parsing.h"
+#include "sema/type_checker.h"
+
+#include "gtest/gtest.h"
+#include <climits>
+#include <sstream>
+
+using namespace dp;
+using namespace dp::internal;
+
+// Parses, checks and folds `body` as the body of `fun main() -> ()`.
+static ModulePtr foldBody(const std::string& body, FoldStats* stats) {
+	antlr4::ANTLRInputStream input("fun main() -> () {\n" + body + "\n};");
+	Parser                   parser;
+	ModulePtr                module(parser.parseModule(input));
+	std::ostringstream       errors;
+	TypeChecker              checker(errors);
+	EXPECT_TRUE(checker.check(module.get())) << errors.str();
+
+	ConstantFolder folder;
+	folder.run(module.get());
+	*stats = folder.stats();
+	return module;
+}
+
+static StatementVector& statementsOf(Module* module) {
+	FunctionDeclaration* main = static_cast<FunctionDeclaration*>(module->stmts[0]);
+	return static_cast<BlockExpession*>(main->body->expr)->stmts;
+}
+
+static Expression* initOf(Module* module, size_t i) {
+	return static_cast<VariableDeclaration*>(statementsOf(module)[i])->init;
+}
+
+static LiteralExpression* literalOf(Expression* expr) {
+	EXPECT_EQ(expr->kind(), ExpressionKind::Literal);
+	return static_cast<LiteralExpression*>(expr);
+}
+
+TEST(testCase, constantBindingsFoldAway) {
+	FoldStats stats;
+	ModulePtr module = foldBody("let a : i32 = 1;\n"
+	                            "let b : i32 = 2;\n"
+	                            "let c : i32 = a + b;\n"
+	                            "let r : i32 = a + b * c + a;\n"
+	                            "let x : i32;\n"
+	                            "let y : i32 = r + x;",
+	                            &stats);
+
+	// Only the variable that is never given a constant is left, and what
+	// reads it.
+	ASSERT_EQ(statementsOf(module.get()).size(), 2u);
+	BinaryExpression* y = static_cast<BinaryExpression*>(initOf(module.get(), 1));
+	EXPECT_EQ(literalOf(y->left)->i32val, 8);
+	EXPECT_EQ(stats.propagated, 7u);
+	EXPECT_EQ(stats.folded, 4u);
+	EXPECT_EQ(stats.eliminated, 16u);
+}
+
+TEST(testCase, foldingFollowsWasmSemantics) {
+	FoldStats stats;
+	ModulePtr module = foldBody("let x : i32;\n"
+	                            "let wrap : i32 = 2147483647 + 1;\n"
+	                            "let min : i32 = 0 - 2147483647 - 1;\n"
+	                            "let minusOne : i32 = 0 - 1;\n"
+	                            "let a : i32 = x + min / minusOne;\n"
+	                            "let b : i32 = x + 7 / 0;\n"
+	                            "let c : i32 = x + wrap;\n"
+	                            "let h : f32 = 1.5 * 3;\n"
+	                            "let d : i64 = 4294967296 * 4294967296 + 5;",
+	                            &stats);
+
+	ASSERT_EQ(statementsOf(module.get()).size(), 4u);
+	// Division overflow and division by zero trap, so they are left alone.
+	BinaryExpression* a = static_cast<BinaryExpression*>(initOf(module.get(), 1));
+	ASSERT_EQ(a->right->kind(), ExpressionKind::Binary);
+	EXPECT_EQ(literalOf(static_cast<BinaryExpression*>(a->right)->left)->i32val, INT_MIN);
+	EXPECT_EQ(literalOf(static_cast<BinaryExpression*>(a->right)->right)->i32val, -1);
+	BinaryExpression* b = static_cast<BinaryExpression*>(initOf(module.get(), 2));
+	EXPECT_EQ(b->right->kind(), ExpressionKind::Binary);
+	BinaryExpression* c = static_cast<BinaryExpression*>(initOf(module.get(), 3));
+	EXPECT_EQ(literalOf(c->right)->i32val, INT_MIN);
+	EXPECT_EQ(stats.folded, 7u);
+}
+
+TEST(testCase, identitiesAndShifts) {
+	FoldStats stats;
+	ModulePtr module = foldBody("let x : i32;\n"
+	                            "let y : i64;\n"
+	                            "let z : f64;\n"
+	                            "let a : i32 = 1 * x + 0 - 0;\n"
+	                            "let b : i32 = x * 8;\n"
+	                            "let c : i64 = 4 * y;\n"
+	                            "let d : f64 = z * 1 / 1;\n"
+	                            "let e : f64 = z + 0;\n"
+	                            "let f : i32 = x / 1 * 3;",
+	                            &stats);
+
+	EXPECT_EQ(initOf(module.get(), 3)->kind(), ExpressionKind::Path);
+
+	BinaryExpression* b = static_cast<BinaryExpression*>(initOf(module.get(), 4));
+	EXPECT_EQ(b->op, BinaryOperator::ShiftLeft);
+	EXPECT_EQ(literalOf(b->right)->i32val, 3);
+
+	BinaryExpression* c = static_cast<BinaryExpression*>(initOf(module.get(), 5));
+	EXPECT_EQ(c->op, BinaryOperator::ShiftLeft);
+	EXPECT_EQ(c->left->kind(), ExpressionKind::Path);
+	EXPECT_EQ(literalOf(c->right)->i64val, 2);
+
+	EXPECT_EQ(initOf(module.get(), 6)->kind(), ExpressionKind::Path);
+	// z + 0 is -0 + 0 = +0 for z = -0, not z.
+	EXPECT_EQ(initOf(module.get(), 7)->kind(), ExpressionKind::Binary);
+
+	BinaryExpression* f = static_cast<BinaryExpression*>(initOf(module.get(), 8));
+	EXPECT_EQ(f->op, BinaryOperator::Mult);
+	EXPECT_EQ(f->left->kind(), ExpressionKind::Path);
+
+	EXPECT_EQ(stats.simplified, 8u);
+}
+
+TEST(testCase, stringsArePropagated) {
+	FoldStats stats;
+	ModulePtr module = foldBody("let s : str = \"ab\";\n"
+	                            "let t : str = s;",
+	                            &stats);
+
+	// Each is a constant; the address is only known once it is lowered.
+	EXPECT_EQ(statementsOf(module.get()).size(), 0u);
+	EXPECT_EQ(stats.propagated, 1u);
+	EXPECT_EQ(stats.folded, 0u);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,117 @@
+#include "driver/driver.h"
+#include "utils/thread_pool.h"
+
+#include "gtest/gtest.h"
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace dp;
+using namespace dp::internal;
+
+static std::string temporaryPath(const std::string& name) {
+	return "/tmp/dp_driver_test_" + std::to_string(::getpid()) + "_" + name;
+}
+
+TEST(testCase, threadPoolRunsEveryTask) {
+	ThreadPool          pool(4);
+	std::atomic<size_t> sum{ 0 };
+	std::atomic<bool>   badWorker{ false };
+	for (size_t i = 1; i <= 1000; i++) {
+		pool.submit([&, i](size_t worker) {
+			sum += i;
+			if (worker >= pool.size()) {
+				badWorker = true;
+			}
+		});
+	}
+	pool.wait();
+	EXPECT_EQ(sum.load(), 500500u);
+	EXPECT_FALSE(badWorker.load());
+}
+
+// Files of very different sizes finish out of order on several threads; the
+// combined output must still be that of compiling them one by one.
+TEST(testCase, parallelOutputFollowsInputOrder) {
+	std::vector<CompileJob> jobs;
+	for (int i = 0; i < 16; i++) {
+		std::string source = temporaryPath(std::to_string(i) + ".dp");
+		std::ofstream out(source);
+		out << "let first" << i << " : i32 = " << i << ";\n";
+		for (int j = 0; j < (i % 4) * 200; j++) {
+			out << "let v" << j << " : i32 = " << j << " + first" << i << ";\n";
+		}
+		out << "let $ = ;\n";
+		jobs.push_back({ source, temporaryPath(std::to_string(i) + ".wasm") });
+	}
+	jobs.insert(jobs.begin() + 5, CompileJob{ temporaryPath("missing.dp"), temporaryPath("missing.wasm") });
+
+	CompileOptions options;
+	options.diagnostics.dumpTokens = true;
+
+	// Every file ends in a syntax error, and one is missing.
+	std::ostringstream serialOut, serialErrors;
+	EXPECT_EQ(compileFiles(jobs, options, 1, serialOut, serialErrors), 17u);
+	for (int round = 0; round < 3; round++) {
+		std::ostringstream parallelOut, parallelErrors;
+		EXPECT_EQ(compileFiles(jobs, options, 4, parallelOut, parallelErrors), 17u);
+		EXPECT_EQ(parallelOut.str(), serialOut.str());
+		EXPECT_EQ(parallelErrors.str(), serialErrors.str());
+	}
+	EXPECT_NE(serialErrors.str().find("cannot read " + temporaryPath("missing.dp")), std::string::npos);
+
+	for (const CompileJob& job : jobs) {
+		::unlink(job.inFile.c_str());
+		::unlink(job.outFile.c_str());
+	}
+}
+
+TEST(testCase, filesWithErrorsAreFailures) {
+	std::vector<CompileJob> jobs;
+	const char*             sources[] = { "fun main() -> () {\n    let a : i32 = 1;\n};\n",
+		                                  "fun main() -> () {\n    let a : i32 = ;\n};\n",
+		                                  "fun main() -> () {\n    let a : i32 = 1.5;\n};\n" };
+	for (size_t i = 0; i < 3; i++) {
+		std::string source = temporaryPath("errors" + std::to_string(i) + ".dp");
+		std::ofstream(source) << sources[i];
+		jobs.push_back({ source, temporaryPath("errors" + std::to_string(i) + ".wasm") });
+	}
+
+	// The syntax error and the type error, but neither is unreadable.
+	std::ostringstream out, errors;
+	EXPECT_EQ(compileFiles(jobs, CompileOptions(), 2, out, errors), 2u);
+	EXPECT_EQ(errors.str().find("cannot read"), std::string::npos) << errors.str();
+
+	DiagnosticSink sink(out);
+	CompileResult  result = compileFile(jobs[1].inFile, jobs[1].outFile, CompileOptions(), sink, errors);
+	EXPECT_TRUE(result.read);
+	EXPECT_FALSE(result.ok);
+	EXPECT_TRUE(compileFile(jobs[0].inFile, jobs[0].outFile, CompileOptions(), sink, errors).ok);
+
+	for (const CompileJob& job : jobs) {
+		::unlink(job.inFile.c_str());
+		::unlink(job.outFile.c_str());
+	}
+}
+
+TEST(testCase, manifestPathsAreRelativeToIt) {
+	std::string manifest = temporaryPath("manifest");
+	{
+		std::ofstream out(manifest);
+		out << "# sources\n\na.dp\n  /abs/b.dp  \r\nsub/c.dp\n";
+	}
+	std::vector<std::string> files;
+	ASSERT_TRUE(readManifest(manifest, &files));
+	ASSERT_EQ(files.size(), 3u);
+	EXPECT_EQ(files[0], "/tmp/a.dp");
+	EXPECT_EQ(files[1], "/abs/b.dp");
+	EXPECT_EQ(files[2], "/tmp/sub/c.dp");
+	EXPECT_FALSE(readManifest(temporaryPath("nothing"), &files));
+	::unlink(manifest.c_str());
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
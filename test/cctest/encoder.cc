@@ -0,0 +1,202 @@
+#include "codegen/encoder.h"
+#include "ir/builder.h"
+
+#include "codegen.h"
+#include "gtest/gtest.h"
+#include <sstream>
+
+using namespace dp;
+using namespace dp::internal;
+using namespace dp::internal::test;
+
+static const std::vector<uint8_t> kHeader = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 };
+
+static std::vector<uint8_t> concat(std::initializer_list<std::vector<uint8_t>> parts) {
+	std::vector<uint8_t> bytes;
+	for (const std::vector<uint8_t>& part : parts) {
+		bytes.insert(bytes.end(), part.begin(), part.end());
+	}
+	return bytes;
+}
+
+TEST(testCase, exportedFunctionsAndLoops) {
+	std::vector<uint8_t> bytes;
+	std::ostringstream   errors;
+	CodegenStats         stats;
+	EXPECT_TRUE(encodeWasm(*lowerSource("fun main() -> () {};"), &bytes, errors, &stats));
+	EXPECT_EQ(bytes, concat({ kHeader,
+	                          { 0x01, 0x04, 0x01, 0x60, 0x00, 0x00 },                         // type () -> ()
+	                          { 0x03, 0x02, 0x01, 0x00 },                                     // function 0: type 0
+	                          { 0x07, 0x08, 0x01, 0x04, 'm', 'a', 'i', 'n', 0x00, 0x00 },     // export "main"
+	                          { 0x0a, 0x04, 0x01, 0x02, 0x00, 0x0b } }));                     // no locals, end
+	EXPECT_EQ(stats.types, 1u);
+
+	// The self tail call becomes a loop that branches back to its start.
+	EXPECT_TRUE(encodeWasm(*lowerSource("fun main() -> () {\n    main();\n};"), &bytes, errors));
+	EXPECT_EQ(bytes, concat({ kHeader,
+	                          { 0x01, 0x04, 0x01, 0x60, 0x00, 0x00 },
+	                          { 0x03, 0x02, 0x01, 0x00 },
+	                          { 0x07, 0x08, 0x01, 0x04, 'm', 'a', 'i', 'n', 0x00, 0x00 },
+	                          { 0x0a, 0x09, 0x01, 0x07, 0x00, 0x03, 0x40, 0x0c, 0x00, 0x0b, 0x0b } }));
+	EXPECT_EQ(errors.str(), "");
+}
+
+TEST(testCase, localsConstantsAndTailCalls) {
+	ir::Module module;
+
+	// k: q = 64 / -1; q / q
+	module.functions.emplace_back(new ir::Function("k"));
+	{
+		ir::Builder builder(module.functions.back().get());
+		builder.setInsertBlock(builder.createBlock());
+		ir::Instruction* q = builder.binary(ir::Opcode::Div, builder.constant(PrimitiveVariableTypes::I32, 64),
+		                                    builder.constant(PrimitiveVariableTypes::I32, 0xffffffffu));
+		builder.binary(ir::Opcode::Div, q, q);
+		builder.ret();
+	}
+	// l: -65 / -65; k()
+	module.functions.emplace_back(new ir::Function("l"));
+	{
+		ir::Builder builder(module.functions.back().get());
+		builder.setInsertBlock(builder.createBlock());
+		ir::Instruction* e = builder.constant(PrimitiveVariableTypes::I64, static_cast<uint64_t>(-65));
+		builder.binary(ir::Opcode::Div, e, e);
+		builder.call(Symbol::intern("k"));
+		builder.ret();
+	}
+
+	std::vector<uint8_t> bytes;
+	std::ostringstream   errors;
+	CodegenStats         stats;
+	EXPECT_TRUE(encodeWasm(module, &bytes, errors, &stats));
+	EXPECT_EQ(bytes, concat({ kHeader,
+	                          { 0x01, 0x04, 0x01, 0x60, 0x00, 0x00 },
+	                          { 0x03, 0x03, 0x02, 0x00, 0x00 },
+	                          // Neither is exported.
+	                          { 0x0a, 0x1f, 0x02 },
+	                          { 0x10, 0x01, 0x01, 0x7f,                         // one i32 local
+	                            0x41, 0xc0, 0x00, 0x41, 0x7f, 0x6d, 0x22, 0x00, // 64 / -1 teed into local 0
+	                            0x20, 0x00, 0x6d, 0x1a, 0x0b },
+	                          { 0x0c, 0x00,                                     // constants are not kept
+	                            0x42, 0xbf, 0x7f, 0x42, 0xbf, 0x7f, 0x7f, 0x1a, // -65 / -65
+	                            0x12, 0x00, 0x0b } }));                         // return_call k
+	EXPECT_EQ(stats.values, 1u);
+	EXPECT_EQ(stats.tailCalls, 1u);
+	EXPECT_EQ(stats.peephole.hits[0], 1u);
+	EXPECT_EQ(stats.peephole.removed, 1u);
+
+	// As selected, the value is set and then got again.
+	CodegenOptions unrewritten;
+	unrewritten.peephole = false;
+	std::vector<uint8_t> selected;
+	EXPECT_TRUE(encodeWasm(module, &selected, errors, nullptr, unrewritten));
+	EXPECT_EQ(selected.size(), bytes.size() + 2);
+	EXPECT_EQ(std::vector<uint8_t>(selected.begin() + 32, selected.begin() + 38),
+	          (std::vector<uint8_t>{ 0x21, 0x00, 0x20, 0x00, 0x20, 0x00 }));
+
+	// Without the tail-call proposal it is a call and a fall through to the
+	// end.
+	CodegenOptions options;
+	options.tailCalls = false;
+	std::vector<uint8_t> plain;
+	EXPECT_TRUE(encodeWasm(module, &plain, errors, nullptr, options));
+	EXPECT_EQ(plain.size(), bytes.size());
+	EXPECT_EQ(plain[plain.size() - 3], 0x10);
+	EXPECT_EQ(errors.str(), "");
+}
+
+TEST(testCase, nothingIsEncodedForUndefinedCalls) {
+	ir::Module module;
+	module.functions.emplace_back(new ir::Function("f"));
+	ir::Builder builder(module.functions.back().get());
+	builder.setInsertBlock(builder.createBlock());
+	builder.call(Symbol::intern("missing"));
+	builder.binary(ir::Opcode::Div, builder.constant(PrimitiveVariableTypes::I32, 1),
+	               builder.constant(PrimitiveVariableTypes::I32, 0));
+	builder.ret();
+
+	std::vector<uint8_t> bytes = kHeader;
+	std::ostringstream   errors;
+	EXPECT_FALSE(encodeWasm(module, &bytes, errors));
+	EXPECT_TRUE(bytes.empty());
+	EXPECT_EQ(errors.str(), "function 'f': calls undefined function 'missing'\n");
+}
+
+TEST(testCase, threadsDoNotChangeTheOutput) {
+	std::string source;
+	for (int i = 0; i < 300; i++) {
+		std::string n = std::to_string(i);
+		source += "fun f" + n + "() -> () {\n    let x : i32;\n    let a : i32 = " + n + " / x;\n    a / a;\n";
+		source += i % 3 ? "    f" + std::to_string(i / 2) + "();\n};\n" : "};\n";
+	}
+	std::unique_ptr<ir::Module> module = lowerSource(source);
+
+	std::vector<uint8_t> serial;
+	std::ostringstream   errors;
+	CodegenStats         serialStats;
+	EXPECT_TRUE(encodeWasm(*module, &serial, errors, &serialStats));
+	EXPECT_EQ(serialStats.tailCalls, 200u);
+	for (size_t threads : { 2, 4, 16 }) {
+		CodegenOptions options;
+		options.threads = threads;
+		std::vector<uint8_t> parallel;
+		CodegenStats         stats;
+		EXPECT_TRUE(encodeWasm(*module, &parallel, errors, &stats, options));
+		EXPECT_EQ(parallel, serial) << threads << " threads";
+		EXPECT_EQ(stats.values, serialStats.values);
+		EXPECT_EQ(stats.tailCalls, serialStats.tailCalls);
+	}
+	EXPECT_EQ(errors.str(), "");
+
+	// Errors come in the order of the functions.
+	ir::Module broken;
+	for (const char* name : { "a", "b", "c", "d" }) {
+		broken.functions.emplace_back(new ir::Function(name));
+		ir::Builder builder(broken.functions.back().get());
+		builder.setInsertBlock(builder.createBlock());
+		builder.call(Symbol::intern(std::string("missing_") + name));
+		builder.ret();
+	}
+	CodegenOptions options;
+	options.threads = 4;
+	EXPECT_FALSE(encodeWasm(broken, &serial, errors, nullptr, options));
+	EXPECT_EQ(errors.str(), "function 'a': calls undefined function 'missing_a'\n"
+	                        "function 'b': calls undefined function 'missing_b'\n"
+	                        "function 'c': calls undefined function 'missing_c'\n"
+	                        "function 'd': calls undefined function 'missing_d'\n");
+}
+
+TEST(testCase, stringsAreStoredOnceInMemory) {
+	ModulePtr source = checkSource("fun f() -> () {\n    let s : str = \"hi\";\n};\n"
+	                               "fun main() -> () {\n    let t : str = \"there\";\n    let u : str = \"hi\";\n};");
+	std::unique_ptr<ir::Module> module = ir::lowerModule(source.get());
+	std::ostringstream          errors;
+	EXPECT_EQ(module->strings.data(), "hithere");
+	EXPECT_EQ(module->strings.size(), 2u);
+
+	// Unoptimized and as selected, so the unused values are still there.
+	CodegenOptions options;
+	options.peephole = false;
+	std::vector<uint8_t> bytes;
+	EXPECT_TRUE(encodeWasm(*module, &bytes, errors, nullptr, options));
+	EXPECT_EQ(bytes, concat({ kHeader,
+	                          { 0x01, 0x04, 0x01, 0x60, 0x00, 0x00 },
+	                          { 0x03, 0x03, 0x02, 0x00, 0x00 },
+	                          { 0x05, 0x03, 0x01, 0x00, 0x01 },                           // one page
+	                          { 0x07, 0x15, 0x03, 0x01, 'f', 0x00, 0x00,                   // export both functions
+	                            0x04, 'm', 'a', 'i', 'n', 0x00, 0x01,
+	                            0x06, 'm', 'e', 'm', 'o', 'r', 'y', 0x02, 0x00 },           // and the memory
+	                          { 0x0a, 0x1d, 0x02 },
+	                          { 0x09, 0x00, 0x42, 0x80, 0x80, 0x80, 0x80, 0x20, 0x1a,      // "hi": 2 << 32 | 0
+	                            0x0b },
+	                          { 0x11, 0x00, 0x42, 0x82, 0x80, 0x80, 0x80, 0xd0, 0x00, 0x1a, // "there": 5 << 32 | 2
+	                            0x42, 0x80, 0x80, 0x80, 0x80, 0x20, 0x1a, 0x0b },           // "hi" again
+	                          { 0x0b, 0x0d, 0x01, 0x00, 0x41, 0x00, 0x0b,                  // at address 0
+	                            0x07, 'h', 'i', 't', 'h', 'e', 'r', 'e' } }));
+	EXPECT_EQ(errors.str(), "");
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+#include "ir/inliner.h"
+#include "ir/passes.h"
+
+#include "codegen.h"
+#include "gtest/gtest.h"
+
+using namespace dp;
+using namespace dp::internal;
+using namespace dp::internal::test;
+
+static ir::InlineStats inlineWithBudget(ir::Module* module, size_t budget) {
+	ir::InlineOptions options;
+	options.budget = budget;
+	ir::InlineStats stats;
+	ir::inlineCalls(module, options, &stats);
+	return stats;
+}
+
+// Three instructions besides the return: a division by zero that must stay.
+static const char kHelper[] = "fun helper() -> () {\n    let x : i32;\n    7 / x;\n};\n";
+
+TEST(testCase, smallHelpersAreInlined) {
+	std::unique_ptr<ir::Module> module = lowerSource(std::string(kHelper) + "fun main() -> () {\n"
+	                                                                         "    helper();\n"
+	                                                                         "    helper();\n"
+	                                                                         "};");
+	EXPECT_EQ(print(*module->functions[1]), "export function main() {\n"
+	                                        "bb0:\n"
+	                                        "  call helper\n"
+	                                        "  call helper\n"
+	                                        "  return\n"
+	                                        "}\n");
+
+	ir::InlineStats stats = inlineWithBudget(module.get(), 64);
+	EXPECT_EQ(stats.sites, 2u);
+	EXPECT_EQ(stats.instructions, 4u + 7u);
+	EXPECT_EQ(print(*module->functions[1]), "export function main() {\n"
+	                                        "bb0:\n"
+	                                        "  %0 = const i32 0\n"
+	                                        "  %1 = const i32 7\n"
+	                                        "  %2 = div i32 %1, %0\n"
+	                                        "  %3 = const i32 0\n"
+	                                        "  %4 = const i32 7\n"
+	                                        "  %5 = div i32 %4, %3\n"
+	                                        "  return\n"
+	                                        "}\n");
+
+	// The second copy computes the same division, which traps first.
+	ir::PassStats passes;
+	ir::optimize(module.get(), &passes);
+	EXPECT_EQ(passes.common, 3u);
+	EXPECT_EQ(module->functions[1]->instructionCount(), 4u);
+}
+
+TEST(testCase, budgetBoundsSizeTimesCalls) {
+	std::string source = std::string(kHelper) + "fun main() -> () {\n    helper();\n    helper();\n};";
+
+	std::unique_ptr<ir::Module> module = lowerSource(source);
+	EXPECT_EQ(inlineWithBudget(module.get(), 5).sites, 0u);
+	EXPECT_EQ(module->functions[1]->instructionCount(), 3u);
+
+	module = lowerSource(source);
+	EXPECT_EQ(inlineWithBudget(module.get(), 6).sites, 2u);
+
+	// An empty body costs nothing, whatever the budget.
+	module = lowerSource("fun nop() -> () {};\nfun main() -> () {\n    nop();\n    nop();\n    nop();\n};");
+	EXPECT_EQ(inlineWithBudget(module.get(), 0).sites, 3u);
+	EXPECT_EQ(module->functions[1]->instructionCount(), 1u);
+}
+
+TEST(testCase, calleesAreInlinedFirst) {
+	// a is declared first, but c is inlined into b before b is measured and
+	// inlined into a.
+	std::unique_ptr<ir::Module> module = lowerSource("fun a() -> () {\n    b();\n};\n"
+	                                                 "fun b() -> () {\n    c();\n};\n" +
+	                                                 std::string(kHelper).replace(4, 6, "c"));
+	ir::InlineStats stats = inlineWithBudget(module.get(), 64);
+	EXPECT_EQ(stats.sites, 2u);
+	for (auto& function : module->functions) {
+		EXPECT_EQ(function->instructionCount(), 4u) << print(*function);
+	}
+}
+
+TEST(testCase, recursiveCallsAreKept) {
+	std::unique_ptr<ir::Module> module = lowerSource("fun even() -> () {\n    odd();\n};\n"
+	                                                 "fun odd() -> () {\n    even();\n};\n"
+	                                                 "fun self() -> () {\n    self();\n};");
+	ir::InlineStats stats = inlineWithBudget(module.get(), 64);
+	// odd is finished first and inlined into even, which then calls itself.
+	EXPECT_EQ(stats.sites, 1u);
+	EXPECT_EQ(print(*module->functions[0]), "export function even() {\n"
+	                                        "bb0:\n"
+	                                        "  call even\n"
+	                                        "  return\n"
+	                                        "}\n");
+	EXPECT_EQ(print(*module->functions[1]), "export function odd() {\n"
+	                                        "bb0:\n"
+	                                        "  call even\n"
+	                                        "  return\n"
+	                                        "}\n");
+	EXPECT_EQ(module->functions[2]->instructionCount(), 2u);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
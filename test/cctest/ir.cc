@@ -0,0 +1,188 @@
+#include "ir/builder.h"
+#include "ir/passes.h"
+
+#include "codegen.h"
+#include "gtest/gtest.h"
+
+using namespace dp;
+using namespace dp::internal;
+using namespace dp::internal::test;
+
+TEST(testCase, lowerAndOptimizeStraightLineCode) {
+	std::unique_ptr<ir::Function> function = lowerBody("let x : i32;\n"
+	                                                   "let a : i32 = x + 1;\n"
+	                                                   "let b : i32 = a;\n"
+	                                                   "let c : i32 = x + 1;\n"
+	                                                   "let d : i32 = 7 / b;\n"
+	                                                   "let e : i32 = 7 / c;\n"
+	                                                   "x * 2;\n"
+	                                                   "let f : f64 = 1.5;\n"
+	                                                   "f / 2;");
+	EXPECT_EQ(print(*function), "export function main() {\n"
+	                            "bb0:\n"
+	                            "  %0 = const i32 0\n"
+	                            "  %1 = const i32 1\n"
+	                            "  %2 = add i32 %0, %1\n"
+	                            "  %3 = copy i32 %2\n"
+	                            "  %4 = const i32 1\n"
+	                            "  %5 = add i32 %0, %4\n"
+	                            "  %6 = const i32 7\n"
+	                            "  %7 = div i32 %6, %3\n"
+	                            "  %8 = const i32 7\n"
+	                            "  %9 = div i32 %8, %5\n"
+	                            "  %10 = const i32 2\n"
+	                            "  %11 = mul i32 %0, %10\n"
+	                            "  %12 = const f64 1.5\n"
+	                            "  %13 = const f64 2\n"
+	                            "  %14 = div f64 %12, %13\n"
+	                            "  return\n"
+	                            "}\n");
+
+	ir::PassStats stats;
+	ir::optimize(function.get(), &stats);
+	// Only the division that may trap is left, and what it needs.
+	EXPECT_EQ(print(*function), "export function main() {\n"
+	                            "bb0:\n"
+	                            "  %0 = const i32 0\n"
+	                            "  %1 = const i32 1\n"
+	                            "  %2 = add i32 %0, %1\n"
+	                            "  %3 = const i32 7\n"
+	                            "  %4 = div i32 %3, %2\n"
+	                            "  return\n"
+	                            "}\n");
+	EXPECT_EQ(stats.copies, 1u);
+	EXPECT_EQ(stats.common, 4u);
+	EXPECT_EQ(stats.dead, 5u);
+}
+
+TEST(testCase, phisAreDefUseChained) {
+	// if (c) { v = 2 } ; use v
+	ir::Function          function("diamond");
+	ir::Builder           builder(&function);
+	ir::BasicBlock*       entry = builder.createBlock();
+	ir::BasicBlock*       then  = builder.createBlock();
+	ir::BasicBlock*       join  = builder.createBlock();
+	ir::Builder::Variable v     = builder.newVariable(PrimitiveVariableTypes::I32);
+
+	builder.setInsertBlock(entry);
+	builder.sealBlock(entry);
+	ir::Instruction* one = builder.constant(PrimitiveVariableTypes::I32, 1);
+	builder.writeVariable(v, one);
+	builder.brIf(one, then, join);
+
+	builder.setInsertBlock(then);
+	builder.sealBlock(then);
+	builder.writeVariable(v, builder.constant(PrimitiveVariableTypes::I32, 2));
+	builder.br(join);
+
+	builder.setInsertBlock(join);
+	builder.sealBlock(join);
+	ir::Instruction* phi = builder.readVariable(v);
+	builder.binary(ir::Opcode::Div, one, phi);
+	builder.ret();
+
+	EXPECT_EQ(phi->op, ir::Opcode::Phi);
+	EXPECT_EQ(phi->users().size(), 1u);
+	ASSERT_EQ(one->users().size(), 3u);
+	EXPECT_EQ(print(function), "function diamond() {\n"
+	                           "bb0:\n"
+	                           "  %0 = const i32 1\n"
+	                           "  br_if %0, bb1, bb2\n"
+	                           "bb1:  ; preds bb0\n"
+	                           "  %1 = const i32 2\n"
+	                           "  br bb2\n"
+	                           "bb2:  ; preds bb0, bb1\n"
+	                           "  %2 = phi i32 [%0, bb0], [%1, bb1]\n"
+	                           "  %3 = div i32 %0, %2\n"
+	                           "  return\n"
+	                           "}\n");
+
+	// Nothing to remove: the phi merges two values and feeds a division.
+	ir::PassStats stats;
+	ir::optimize(&function, &stats);
+	EXPECT_EQ(stats.copies + stats.common + stats.dead, 0u);
+}
+
+TEST(testCase, loopInvariantPhiIsACopy) {
+	// v = 0; do { } while (0); 7 / v
+	ir::Function          function("loop");
+	ir::Builder           builder(&function);
+	ir::BasicBlock*       entry = builder.createBlock();
+	ir::BasicBlock*       body  = builder.createBlock();
+	ir::BasicBlock*       done  = builder.createBlock();
+	ir::Builder::Variable v     = builder.newVariable(PrimitiveVariableTypes::I32);
+
+	builder.setInsertBlock(entry);
+	builder.sealBlock(entry);
+	ir::Instruction* zero = builder.constant(PrimitiveVariableTypes::I32, 0);
+	builder.writeVariable(v, zero);
+	builder.br(body);
+
+	// The loop header is read before its back edge exists.
+	builder.setInsertBlock(body);
+	ir::Instruction* header = builder.readVariable(v);
+	builder.brIf(builder.constant(PrimitiveVariableTypes::I32, 0), body, done);
+	builder.sealBlock(body);
+
+	builder.setInsertBlock(done);
+	builder.sealBlock(done);
+	ir::Instruction* quotient =
+			builder.binary(ir::Opcode::Div, builder.constant(PrimitiveVariableTypes::I32, 7), builder.readVariable(v));
+	builder.ret();
+
+	EXPECT_EQ(header->op, ir::Opcode::Phi);
+	ASSERT_EQ(header->operands().size(), 2u);
+	EXPECT_EQ(header->operand(0), zero);
+	EXPECT_EQ(header->operand(1), header);
+	EXPECT_EQ(quotient->operand(1), header);
+
+	// The phi only ever sees `zero`, and the zero in the loop is the one in
+	// the entry, which dominates it.
+	ir::PassStats stats;
+	ir::optimize(&function, &stats);
+	EXPECT_EQ(stats.copies, 1u);
+	EXPECT_EQ(stats.common, 1u);
+	EXPECT_EQ(stats.dead, 0u);
+	EXPECT_EQ(quotient->operand(1), zero);
+	EXPECT_EQ(print(function), "function loop() {\n"
+	                           "bb0:\n"
+	                           "  %0 = const i32 0\n"
+	                           "  br bb1\n"
+	                           "bb1:  ; preds bb0, bb1\n"
+	                           "  br_if %0, bb1, bb2\n"
+	                           "bb2:  ; preds bb1\n"
+	                           "  %1 = const i32 7\n"
+	                           "  %2 = div i32 %1, %0\n"
+	                           "  return\n"
+	                           "}\n");
+}
+
+TEST(testCase, selfTailCallsBecomeLoops) {
+	std::unique_ptr<ir::Function> function = lowerBody("let x : i32;\n"
+	                                                   "7 / x;\n"
+	                                                   "main();");
+	ir::PassStats stats;
+	ir::optimize(function.get(), &stats);
+	EXPECT_EQ(stats.loops, 1u);
+	EXPECT_EQ(print(*function), "export function main() {\n"
+	                            "bb0:\n"
+	                            "  %0 = const i32 0\n"
+	                            "  %1 = const i32 7\n"
+	                            "  br bb1\n"
+	                            "bb1:  ; preds bb0, bb1\n"
+	                            "  %2 = div i32 %1, %0\n"
+	                            "  br bb1\n"
+	                            "}\n");
+
+	// Only a call right before the return is a tail call.
+	function = lowerBody("let x : i32;\n"
+	                     "main();\n"
+	                     "7 / x;");
+	EXPECT_EQ(ir::loopSelfTailCalls(function.get()), 0u);
+	EXPECT_EQ(function->blocks.size(), 1u);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
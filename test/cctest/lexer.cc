@@ -0,0 +1,156 @@
+#include "parsing/fast_lexer.h"
+#include "parsing/mapped_stream.h"
+#include "parsing/parsing.h"
+
+#include "gtest/gtest.h"
+#include <cstdio>
+#include <dirent.h>
+#include <random>
+#include <unistd.h>
+
+using namespace dp;
+using namespace dp::internal;
+
+static void expectSameTokens(antlr4::CharStream& input) {
+	std::string mismatch;
+	EXPECT_TRUE(compareWithGeneratedLexer(input, &mismatch)) << mismatch;
+}
+
+static void expectSameTokens(const std::string& source) {
+	antlr4::ANTLRInputStream input(source);
+	expectSameTokens(input);
+}
+
+TEST(testCase, examplesLexIdentically) {
+	DIR* dir = opendir(DEEPLANG_EXAMPLE_DIR);
+	ASSERT_NE(dir, nullptr);
+	size_t files = 0;
+	while (dirent* entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.size() < 3 || name.compare(name.size() - 3, 3, ".dp") != 0) {
+			continue;
+		}
+		MappedCharStream input(std::string(DEEPLANG_EXAMPLE_DIR) + "/" + name);
+		ASSERT_TRUE(input.isOpen());
+		expectSameTokens(input);
+		files++;
+	}
+	closedir(dir);
+	EXPECT_GT(files, 0u);
+}
+
+TEST(testCase, edgeCasesLexIdentically) {
+	const char* cases[] = {
+			"",
+			"$ $a a$ _ __x9",
+			"LET Let letmut LetMutX constructor constructors",
+			"0 00 07 10 1.5 .5 1. 1.e5 1e5 1e+5 1e- 1.5E-3x .5e2 ..5",
+			"== => = >= > <= <> < != ! && & || | :: : -> - ~ ^ % ? @",
+			"a/b // line\nb //\n//\r\n//x /* c */ /**/ /***/ /*/ */ /*! x */",
+			"/* unterminated",
+			"//",
+			"\"abc\" \"\" \"a b\" \"unterminated",
+			"# ` \\ ' \v x",
+			"\t\f\r\n  \n\n",
+			"let s = \"x\"; /* caf\xc3\xa9 \xe5\xad\x97 */ \xc3\xa9 y",
+	};
+	for (const char* source : cases) {
+		SCOPED_TRACE(source);
+		expectSameTokens(source);
+	}
+}
+
+// Random sequences of grammar fragments glued together with no separator,
+// so tokens run into each other, plus stray bytes from the whole printable
+// range and a few non-ASCII characters.
+TEST(testCase, fuzzedInputLexesIdentically) {
+	const char* fragments[] = {
+			"let", "LET", "fun", "if", "sig", "ident", "_x", "$", "$y", "0", "7", "42", "3.", ".", ".25",
+			"1e", "e9", "+", "-", "*", "/", "=", ">", "<", "!", "&", "|", ":", "(", ")", "{",
+			"}", "[", "]", ";", ",", "\"", "\"s\"", "/*", "*/", "//", "// ", "\n", "\r", "\t", " ",
+			"\xc3\xa9", "\xe2\x82\xac",
+	};
+	const size_t   fragmentCount = sizeof(fragments) / sizeof(fragments[0]);
+	std::mt19937   random(20201015);
+	std::uniform_int_distribution<size_t> pickFragment(0, fragmentCount - 1);
+	std::uniform_int_distribution<int>    pickByte(0x20, 0x7E);
+	std::uniform_int_distribution<int>    coin(0, 9);
+
+	for (int round = 0; round < 2000; round++) {
+		std::string source;
+		size_t      length = 1 + round % 64;
+		for (size_t i = 0; i < length; i++) {
+			if (coin(random) == 0) {
+				source += static_cast<char>(pickByte(random));
+			} else {
+				source += fragments[pickFragment(random)];
+			}
+		}
+		SCOPED_TRACE(source);
+		expectSameTokens(source);
+		if (HasFailure()) {
+			break;
+		}
+	}
+}
+
+// Seeks back and forth over more code points than one checkpoint covers,
+// and past the end, and checks each position against a full offset table.
+TEST(testCase, mappedStreamSeeksAnywhere) {
+	std::string source;
+	for (int i = 0; i < 500; i++) {
+		source += i % 3 ? "a" : i % 7 ? "\xc3\xa9" : "\xf0\x9f\x98\x80";
+	}
+	source += "\xff\xc3"; // malformed, then truncated
+	std::string fileName = "/tmp/dp_lexer_test_" + std::to_string(::getpid()) + ".dp";
+	FILE*       file     = fopen(fileName.c_str(), "wb");
+	ASSERT_NE(file, nullptr);
+	fwrite(source.data(), 1, source.size(), file);
+	fclose(file);
+
+	std::vector<size_t> offsets;
+	for (size_t i = 0; i < source.size(); i += utf8SequenceLength(&source[i], source.data() + source.size())) {
+		offsets.push_back(i);
+	}
+	size_t count = offsets.size();
+	offsets.push_back(source.size());
+
+	MappedCharStream input(fileName);
+	ASSERT_TRUE(input.isOpen());
+	EXPECT_FALSE(input.isAscii());
+	std::mt19937                          random(20201016);
+	std::uniform_int_distribution<size_t> pick(0, count + 2);
+	for (int i = 0; i < 2000; i++) {
+		size_t start = pick(random);
+		size_t stop  = pick(random);
+		input.seek(start);
+		ASSERT_EQ(input.index(), std::min(start, count));
+		std::string text;
+		if (start <= stop && start < count) {
+			text = source.substr(offsets[start], offsets[std::min(stop + 1, count)] - offsets[start]);
+		}
+		ASSERT_EQ(input.getText(antlr4::misc::Interval(start, stop)), text);
+	}
+	EXPECT_EQ(input.size(), count);
+	remove(fileName.c_str());
+}
+
+TEST(testCase, fastLexerParsesTheSameModule) {
+	std::string source;
+	for (int i = 0; i < 100; i++) {
+		source += "let v" + std::to_string(i) + " : i32 = " + std::to_string(i + 1) + " + v0; // c\n";
+	}
+	antlr4::ANTLRInputStream input(source);
+	Parser                   parser;
+	parser.setLexer(LexerKind::Fast);
+	Module* module = parser.parseModule(input);
+
+	EXPECT_EQ(module->stmts.size(), 100u);
+	EXPECT_EQ(parser.stats().llFallbacks, 0u);
+	delete module;
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,94 @@
+#include "codegen/locals.h"
+
+#include "codegen.h"
+#include "gtest/gtest.h"
+
+using namespace dp;
+using namespace dp::internal;
+using namespace dp::internal::test;
+
+TEST(testCase, longChainsShareOneSlotPerType) {
+	std::string body = "let x : i32;\nlet y : f64;\nlet i0 : i32 = 7 / x;\nlet f0 : f64 = y * 2;\n";
+	for (int i = 1; i < 1000; i++) {
+		std::string n = std::to_string(i), p = std::to_string(i - 1);
+		body += "let i" + n + " : i32 = i" + p + " / i" + p + ";\n";
+		body += "let f" + n + " : f64 = f" + p + " + f" + p + ";\n";
+	}
+	std::unique_ptr<ir::Function> function = lowerBody(body);
+	LocalAllocation               allocation(*function);
+
+	// Every i and f but the last two, which are never read. x and y are
+	// constants.
+	EXPECT_EQ(allocation.valueCount(), 1998u);
+	EXPECT_EQ(allocation.localCount(), 2u);
+	EXPECT_EQ(allocation.count(PrimitiveVariableTypes::I32), 1u);
+	EXPECT_EQ(allocation.count(PrimitiveVariableTypes::F64), 1u);
+}
+
+TEST(testCase, overlappingValuesGetTheirOwnSlot) {
+	std::unique_ptr<ir::Function> function = lowerBody("let x : i32;\n"
+	                                                   "let a : i32 = 7 / x;\n"
+	                                                   "let b : i32 = 9 / x;\n"
+	                                                   "let c : i32 = a / b;\n"
+	                                                   "c / c;");
+	LocalAllocation allocation(*function);
+	const auto&     insts = function->entry()->insts;
+	// const 0, const 7, a, const 9, b, c, c / c, return
+	const ir::Instruction* a = insts[2].get();
+	const ir::Instruction* b = insts[4].get();
+	const ir::Instruction* c = insts[5].get();
+	ASSERT_EQ(c->op, ir::Opcode::Div);
+
+	EXPECT_TRUE(allocation.onStack(insts[0].get()));
+	EXPECT_FALSE(allocation.inLocal(insts[6].get()));
+	EXPECT_EQ(allocation.valueCount(), 3u);
+	EXPECT_EQ(allocation.localCount(), 2u);
+	EXPECT_NE(allocation.slot(a), allocation.slot(b));
+	// c is set after its operands are read for the last time.
+	EXPECT_EQ(allocation.slot(c), allocation.slot(a));
+}
+
+TEST(testCase, copiesTakeTheSlotOfTheirOperand) {
+	std::unique_ptr<ir::Function> function = lowerBody("let x : i32;\n"
+	                                                   "let a : i32 = 7 / x;\n"
+	                                                   "let b : i32 = a;\n"
+	                                                   "b / b;");
+	LocalAllocation allocation(*function);
+	const auto&     insts = function->entry()->insts;
+	// const 0, const 7, a, copy, b / b, return
+	const ir::Instruction* a    = insts[2].get();
+	const ir::Instruction* copy = insts[3].get();
+	ASSERT_EQ(copy->op, ir::Opcode::Copy);
+	EXPECT_EQ(allocation.valueCount(), 2u);
+	EXPECT_EQ(allocation.localCount(), 1u);
+	EXPECT_EQ(allocation.slot(copy), allocation.slot(a));
+}
+
+TEST(testCase, slotsAreGroupedByType) {
+	std::unique_ptr<ir::Function> function = lowerBody("let x : i32;\n"
+	                                                   "let y : f64;\n"
+	                                                   "let z : i64;\n"
+	                                                   "let a : f64 = y / 2;\n"
+	                                                   "let b : i32 = 7 / x;\n"
+	                                                   "let c : i64 = 7 / z;\n"
+	                                                   "a + a;\n"
+	                                                   "b + b;\n"
+	                                                   "c + c;");
+	LocalAllocation allocation(*function);
+	EXPECT_EQ(allocation.count(PrimitiveVariableTypes::I32), 1u);
+	EXPECT_EQ(allocation.count(PrimitiveVariableTypes::I64), 1u);
+	EXPECT_EQ(allocation.count(PrimitiveVariableTypes::F64), 1u);
+	for (auto& inst : function->entry()->insts) {
+		if (allocation.inLocal(inst.get())) {
+			uint32_t expected = inst->type == PrimitiveVariableTypes::I32   ? 0
+			                    : inst->type == PrimitiveVariableTypes::I64 ? 1
+			                                                                : 2;
+			EXPECT_EQ(allocation.slot(inst.get()), expected);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
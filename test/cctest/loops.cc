@@ -0,0 +1,222 @@
+#include "ir/builder.h"
+#include "ir/loops.h"
+#include "ir/passes.h"
+
+#include "codegen.h"
+#include "gtest/gtest.h"
+
+using namespace dp;
+using namespace dp::internal;
+using namespace dp::internal::test;
+
+// The instructions run on every iteration of `loop`.
+static size_t instructionsIn(const ir::Loop& loop) {
+	size_t count = 0;
+	for (const ir::BasicBlock* block : loop.blocks) {
+		count += block->insts.size();
+	}
+	return count;
+}
+
+TEST(testCase, nestedLoopsAreFoundInnerFirst) {
+	// bb0 -> bb1 -> bb2 <-> bb2 -> bb3 -> bb1 -> bb4
+	ir::Function    function("nested");
+	ir::Builder     builder(&function);
+	ir::BasicBlock* entry = builder.createBlock();
+	ir::BasicBlock* outer = builder.createBlock();
+	ir::BasicBlock* inner = builder.createBlock();
+	ir::BasicBlock* latch = builder.createBlock();
+	ir::BasicBlock* exit  = builder.createBlock();
+
+	builder.setInsertBlock(entry);
+	builder.br(outer);
+	builder.setInsertBlock(outer);
+	builder.brIf(builder.constant(PrimitiveVariableTypes::I32, 1), inner, exit);
+	builder.setInsertBlock(inner);
+	builder.brIf(builder.constant(PrimitiveVariableTypes::I32, 1), inner, latch);
+	builder.setInsertBlock(latch);
+	builder.br(outer);
+	builder.setInsertBlock(exit);
+	builder.ret();
+
+	ir::DominatorTree     dominators(function);
+	std::vector<ir::Loop> loops = ir::findLoops(dominators);
+	ASSERT_EQ(loops.size(), 2u);
+
+	EXPECT_EQ(loops[0].header, inner);
+	EXPECT_EQ(loops[0].latches, std::vector<ir::BasicBlock*>{inner});
+	EXPECT_EQ(loops[0].blocks.size(), 1u);
+	// The block before it also leaves the outer loop.
+	EXPECT_EQ(loops[0].preheader, nullptr);
+
+	EXPECT_EQ(loops[1].header, outer);
+	EXPECT_EQ(loops[1].latches, std::vector<ir::BasicBlock*>{latch});
+	EXPECT_EQ(loops[1].blocks.size(), 3u);
+	EXPECT_TRUE(loops[1].contains(inner));
+	EXPECT_FALSE(loops[1].contains(exit));
+	EXPECT_EQ(loops[1].preheader, entry);
+}
+
+TEST(testCase, invariantsLeaveTailCallLoops) {
+	std::unique_ptr<ir::Function> function = lowerBody("let x : i32;\n"
+	                                                   "let y : i32 = x + 1;\n"
+	                                                   "7 / y;\n"
+	                                                   "main();");
+	ir::PassStats stats;
+	ir::optimize(function.get(), &stats);
+	EXPECT_EQ(stats.loops, 1u);
+	EXPECT_EQ(stats.hoisted, 1u);
+
+	// The division may trap, so it stays where it was; what it divides by is
+	// computed once.
+	EXPECT_EQ(print(*function), "export function main() {\n"
+	                            "bb0:\n"
+	                            "  %0 = const i32 0\n"
+	                            "  %1 = const i32 1\n"
+	                            "  %2 = add i32 %0, %1\n"
+	                            "  %3 = const i32 7\n"
+	                            "  br bb1\n"
+	                            "bb1:  ; preds bb0, bb1\n"
+	                            "  %4 = div i32 %3, %2\n"
+	                            "  br bb1\n"
+	                            "}\n");
+	ir::DominatorTree     dominators(*function);
+	std::vector<ir::Loop> loops = ir::findLoops(dominators);
+	ASSERT_EQ(loops.size(), 1u);
+	EXPECT_EQ(instructionsIn(loops[0]), 2u);
+}
+
+TEST(testCase, multiplicationsByTheCounterBecomeAdditions) {
+	// i = 0; do { (i * 12) / (100 + 1) } while (i++);
+	ir::Function          function("counted");
+	ir::Builder           builder(&function);
+	ir::BasicBlock*       entry  = builder.createBlock();
+	ir::BasicBlock*       header = builder.createBlock();
+	ir::BasicBlock*       latch  = builder.createBlock();
+	ir::BasicBlock*       exit   = builder.createBlock();
+	ir::Builder::Variable i      = builder.newVariable(PrimitiveVariableTypes::I32);
+
+	builder.setInsertBlock(entry);
+	builder.sealBlock(entry);
+	builder.writeVariable(i, builder.constant(PrimitiveVariableTypes::I32, 0));
+	builder.br(header);
+
+	builder.setInsertBlock(header);
+	ir::Instruction* counter = builder.readVariable(i);
+	ir::Instruction* twelve   = builder.constant(PrimitiveVariableTypes::I32, 12);
+	ir::Instruction* scaled   = builder.binary(ir::Opcode::Mul, counter, twelve);
+	ir::Instruction* hundred  = builder.constant(PrimitiveVariableTypes::I32, 100);
+	ir::Instruction* one      = builder.constant(PrimitiveVariableTypes::I32, 1);
+	ir::Instruction* bound    = builder.binary(ir::Opcode::Add, hundred, one);
+	ir::Instruction* quotient = builder.binary(ir::Opcode::Div, scaled, bound);
+	builder.brIf(counter, latch, exit);
+
+	builder.setInsertBlock(latch);
+	builder.sealBlock(latch);
+	ir::Instruction* previous = builder.readVariable(i);
+	builder.writeVariable(i, builder.binary(ir::Opcode::Add, previous, builder.constant(PrimitiveVariableTypes::I32, 1)));
+	builder.br(header);
+	builder.sealBlock(header);
+
+	builder.setInsertBlock(exit);
+	builder.sealBlock(exit);
+	builder.ret();
+
+	EXPECT_EQ(counter->op, ir::Opcode::Phi);
+	{
+		ir::DominatorTree     dominators(function);
+		std::vector<ir::Loop> loops = ir::findLoops(dominators);
+		ASSERT_EQ(loops.size(), 1u);
+		EXPECT_EQ(loops[0].preheader, entry);
+		EXPECT_EQ(instructionsIn(loops[0]), 11u);
+	}
+
+	ir::PassStats stats;
+	ir::optimize(&function, &stats);
+	EXPECT_EQ(stats.hoisted, 1u);
+	EXPECT_EQ(stats.reduced, 1u);
+	EXPECT_EQ(bound->block, entry);
+	EXPECT_EQ(quotient->operand(0)->op, ir::Opcode::Phi);
+	EXPECT_EQ(print(function), "function counted() {\n"
+	                           "bb0:\n"
+	                           "  %0 = const i32 0\n"
+	                           "  %1 = const i32 100\n"
+	                           "  %2 = const i32 1\n"
+	                           "  %3 = add i32 %1, %2\n"
+	                           "  %4 = const i32 12\n"
+	                           "  %5 = mul i32 %0, %4\n"
+	                           "  br bb1\n"
+	                           "bb1:  ; preds bb0, bb2\n"
+	                           "  %6 = phi i32 [%5, bb0], [%11, bb2]\n"
+	                           "  %7 = phi i32 [%0, bb0], [%9, bb2]\n"
+	                           "  %8 = div i32 %6, %3\n"
+	                           "  br_if %7, bb2, bb3\n"
+	                           "bb2:  ; preds bb1\n"
+	                           "  %9 = add i32 %7, %2\n"
+	                           "  %10 = const i32 12\n"
+	                           "  %11 = add i32 %6, %10\n"
+	                           "  br bb1\n"
+	                           "bb3:  ; preds bb1\n"
+	                           "  return\n"
+	                           "}\n");
+	// The loop adds 12 instead of multiplying by it.
+	ir::DominatorTree     dominators(function);
+	std::vector<ir::Loop> loops = ir::findLoops(dominators);
+	ASSERT_EQ(loops.size(), 1u);
+	for (const ir::BasicBlock* block : loops[0].blocks) {
+		for (auto& inst : block->insts) {
+			EXPECT_NE(inst->op, ir::Opcode::Mul);
+		}
+	}
+}
+
+// Without hoisting first, the factor is still defined in the loop, so the
+// start value needs one of its own.
+TEST(testCase, startValuesAreComputedInThePreheader) {
+	// i = 0; do { i * 12 } while (i++);
+	ir::Function          function("counted");
+	ir::Builder           builder(&function);
+	ir::BasicBlock*       entry  = builder.createBlock();
+	ir::BasicBlock*       header = builder.createBlock();
+	ir::BasicBlock*       latch  = builder.createBlock();
+	ir::BasicBlock*       exit   = builder.createBlock();
+	ir::Builder::Variable i      = builder.newVariable(PrimitiveVariableTypes::I32);
+
+	builder.setInsertBlock(entry);
+	builder.sealBlock(entry);
+	builder.writeVariable(i, builder.constant(PrimitiveVariableTypes::I32, 0));
+	builder.br(header);
+
+	builder.setInsertBlock(header);
+	ir::Instruction* counter = builder.readVariable(i);
+	builder.binary(ir::Opcode::Mul, counter, builder.constant(PrimitiveVariableTypes::I32, 12));
+	builder.brIf(counter, latch, exit);
+
+	builder.setInsertBlock(latch);
+	builder.sealBlock(latch);
+	ir::Instruction* previous = builder.readVariable(i);
+	builder.writeVariable(i, builder.binary(ir::Opcode::Add, previous, builder.constant(PrimitiveVariableTypes::I32, 1)));
+	builder.br(header);
+	builder.sealBlock(header);
+
+	builder.setInsertBlock(exit);
+	builder.sealBlock(exit);
+	builder.ret();
+
+	EXPECT_EQ(ir::reduceStrength(&function), 1u);
+	size_t products = 0;
+	for (auto& inst : entry->insts) {
+		if (inst->op == ir::Opcode::Mul) {
+			EXPECT_EQ(inst->operand(0)->block, entry);
+			EXPECT_EQ(inst->operand(1)->block, entry);
+			EXPECT_EQ(inst->operand(1)->bits, 12u);
+			products++;
+		}
+	}
+	EXPECT_EQ(products, 1u);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
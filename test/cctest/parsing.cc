@@ -0,0 +1,100 @@
+#include "parsing/parsing.h"
+
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <sstream>
+
+using namespace dp;
+using namespace dp::internal;
+
+static std::string makeModuleSource(size_t count) {
+	std::ostringstream source;
+	for (size_t i = 0; i < count; i++) {
+		source << "let v" << i << " : i32 = " << (i + 1) << ";\n";
+	}
+	return source.str();
+}
+
+// What building the AST of a module of `count` top-level declarations
+// allocated in its arena.
+struct AstSize {
+	size_t allocations;
+	size_t bytes;
+};
+
+static AstSize parseModuleOf(size_t count) {
+	antlr4::ANTLRInputStream input(makeModuleSource(count));
+	Parser                   parser;
+	Module*                  module = parser.parseModule(input);
+
+	EXPECT_EQ(module->stmts.size(), count);
+	EXPECT_EQ(parser.stats().llFallbacks, 0u);
+	AstSize size = { module->arena.allocationCount(), module->arena.bytesAllocated() };
+	delete module;
+	return size;
+}
+
+// Splicing the tail of the statement list at every level allocated a list
+// per statement, of every length up to the whole: quadratic in bytes. Built
+// in one pass, ten times the statements take ten times the arena. The 100k
+// parse also covers recursion that does not deepen with the list.
+TEST(testCase, statementsScaleLinearly) {
+	AstSize per1k   = parseModuleOf(1000);
+	AstSize per10k  = parseModuleOf(10000);
+	AstSize per100k = parseModuleOf(100000);
+
+	EXPECT_NEAR(static_cast<double>(per10k.allocations) / per1k.allocations, 10, 0.1);
+	EXPECT_NEAR(static_cast<double>(per100k.allocations) / per10k.allocations, 10, 0.1);
+	EXPECT_NEAR(static_cast<double>(per10k.bytes) / per1k.bytes, 10, 0.1);
+	EXPECT_NEAR(static_cast<double>(per100k.bytes) / per10k.bytes, 10, 0.1);
+}
+
+TEST(testCase, sllParsesValidInputWithoutFallback) {
+	antlr4::ANTLRInputStream input(makeModuleSource(100));
+	Parser                   parser;
+	Module*                  module = parser.parseModule(input);
+
+	EXPECT_EQ(module->stmts.size(), 100u);
+	EXPECT_EQ(parser.stats().sllParses, 1u);
+	EXPECT_EQ(parser.stats().llFallbacks, 0u);
+	delete module;
+}
+
+// The SLL stage bails out on the missing `;` without reporting anything;
+// the LL reparse reports it, once.
+TEST(testCase, invalidInputFallsBackToLL) {
+	antlr4::ANTLRInputStream input("let a : i32 = 1\nlet b : i32 = 2;\n");
+	std::ostringstream       errors;
+	Parser                   parser;
+	parser.setErrorStream(&errors);
+	Module* module = parser.parseModule(input);
+
+	EXPECT_EQ(parser.stats().sllParses, 1u);
+	EXPECT_EQ(parser.stats().llFallbacks, 1u);
+	EXPECT_GT(parser.stats().llSeconds, 0);
+	EXPECT_GT(parser.stats().syntaxErrors, 0u);
+	std::string text = errors.str();
+	EXPECT_EQ(std::count(text.begin(), text.end(), '\n'), 1) << text;
+	EXPECT_EQ(text.find("line 2:0"), 0u) << text;
+	EXPECT_TRUE(module->stmts.empty());
+	delete module;
+}
+
+TEST(testCase, integerLiteralsOutOfRangeAreReported) {
+	antlr4::ANTLRInputStream input("let a : i64 = 9223372036854775807;\nlet b : i64 = 9223372036854775808;\n"
+	                               "let c : i64 = 99999999999999999999;\n");
+	std::ostringstream       errors;
+	Parser                   parser;
+	parser.setErrorStream(&errors);
+	Module* module = parser.parseModule(input);
+
+	EXPECT_EQ(errors.str(), "line 2:14 integer literal out of range: 9223372036854775808\n"
+	                        "line 3:14 integer literal out of range: 99999999999999999999\n");
+	EXPECT_EQ(parser.stats().syntaxErrors, 2u);
+	delete module;
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,76 @@
+#include "codegen/peephole.h"
+
+#include "gtest/gtest.h"
+
+using namespace dp;
+using namespace dp::internal;
+
+static InstructionList rewrite(InstructionList code, PeepholeStats* stats) {
+	peephole(&code, stats);
+	return code;
+}
+
+TEST(testCase, setThenGetIsATee) {
+	PeepholeStats stats;
+	EXPECT_EQ(rewrite({ { kI32Const, 7 }, { kLocalSet, 0 }, { kLocalGet, 0 }, { kLocalGet, 0 }, { kI32Add, 0 } }, &stats),
+	          (InstructionList{ { kI32Const, 7 }, { kLocalTee, 0 }, { kLocalGet, 0 }, { kI32Add, 0 } }));
+	// Another local is another value.
+	EXPECT_EQ(rewrite({ { kLocalSet, 0 }, { kLocalGet, 1 } }, &stats),
+	          (InstructionList{ { kLocalSet, 0 }, { kLocalGet, 1 } }));
+	EXPECT_EQ(stats.hits[0], 1u);
+	EXPECT_EQ(stats.removed, 1u);
+}
+
+TEST(testCase, droppedPushesGoAway) {
+	PeepholeStats stats;
+	// The division may trap, so its drop stays.
+	EXPECT_EQ(rewrite({ { kLocalGet, 0 }, { kDrop, 0 }, { kF64Const, 0 }, { kDrop, 0 }, { kLocalGet, 0 },
+	                    { kLocalGet, 1 }, { 0x6d, 0 }, { kDrop, 0 } }, // i32.div_s
+	                  &stats),
+	          (InstructionList{ { kLocalGet, 0 }, { kLocalGet, 1 }, { 0x6d, 0 }, { kDrop, 0 } }));
+	// What a tee leaves is dropped, which makes the tee a set.
+	EXPECT_EQ(rewrite({ { kI64Const, 1 }, { kLocalSet, 2 }, { kLocalGet, 2 }, { kDrop, 0 } }, &stats),
+	          (InstructionList{ { kI64Const, 1 }, { kLocalSet, 2 } }));
+	EXPECT_EQ(stats.hits[0], 1u);
+	EXPECT_EQ(stats.hits[1], 3u);
+	EXPECT_EQ(stats.removed, 6u);
+}
+
+TEST(testCase, constantsAreCombinedWithWrapAround) {
+	PeepholeStats stats;
+	EXPECT_EQ(rewrite({ { kI32Const, 0x7fffffff }, { kI32Const, 1 }, { kI32Add, 0 } }, &stats),
+	          (InstructionList{ { kI32Const, 0x80000000 } }));
+	EXPECT_EQ(rewrite({ { kI32Const, 0 }, { kI32Const, 1 }, { kI32Sub, 0 } }, &stats),
+	          (InstructionList{ { kI32Const, 0xffffffff } }));
+	// The shift count is taken modulo the width.
+	EXPECT_EQ(rewrite({ { kI64Const, 1 }, { kI64Const, 65 }, { kI64Shl, 0 } }, &stats),
+	          (InstructionList{ { kI64Const, 2 } }));
+	// A folded constant is an operand of the next instruction.
+	EXPECT_EQ(rewrite({ { kI32Const, 6 }, { kI32Const, 3 }, { kI32Const, 4 }, { kI32Or, 0 }, { kI32And, 0 } }, &stats),
+	          (InstructionList{ { kI32Const, 6 } }));
+	// Not across widths.
+	EXPECT_EQ(rewrite({ { kI32Const, 1 }, { kI64Const, 1 }, { kI64Add, 0 } }, &stats),
+	          (InstructionList{ { kI32Const, 1 }, { kI64Const, 1 }, { kI64Add, 0 } }));
+	EXPECT_EQ(stats.hits[2], 5u);
+}
+
+TEST(testCase, multipliesByPowersOfTwoAreShifts) {
+	PeepholeStats stats;
+	EXPECT_EQ(rewrite({ { kLocalGet, 0 }, { kI32Const, 8 }, { kI32Mul, 0 } }, &stats),
+	          (InstructionList{ { kLocalGet, 0 }, { kI32Const, 3 }, { kI32Shl, 0 } }));
+	EXPECT_EQ(rewrite({ { kLocalGet, 0 }, { kI64Const, uint64_t(1) << 40 }, { kI64Mul, 0 } }, &stats),
+	          (InstructionList{ { kLocalGet, 0 }, { kI64Const, 40 }, { kI64Shl, 0 } }));
+	EXPECT_EQ(rewrite({ { kLocalGet, 0 }, { kI32Const, 6 }, { kI32Mul, 0 } }, &stats),
+	          (InstructionList{ { kLocalGet, 0 }, { kI32Const, 6 }, { kI32Mul, 0 } }));
+	// 2 * 4 is folded, then x * 8 is a shift.
+	EXPECT_EQ(rewrite({ { kLocalGet, 0 }, { kI32Const, 2 }, { kI32Const, 4 }, { kI32Mul, 0 }, { kI32Mul, 0 } }, &stats),
+	          (InstructionList{ { kLocalGet, 0 }, { kI32Const, 3 }, { kI32Shl, 0 } }));
+	EXPECT_EQ(stats.hits[2], 1u);
+	EXPECT_EQ(stats.hits[3], 3u);
+	EXPECT_EQ(stats.removed, 2u);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,101 @@
+#include "repl/repl.h"
+
+#include "gtest/gtest.h"
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dp;
+using namespace dp::internal;
+
+static std::string function(int i, int value) {
+	return "fun f" + std::to_string(i) + "() -> () {\n    let a : i32 = " + std::to_string(value) + ";\n};";
+}
+
+TEST(testCase, splitsTopLevelStatements) {
+	std::string              rest;
+	std::vector<std::string> statements =
+			splitStatements("fun f() -> () { let a : i32 = 1; };  let s = \";\"; // ;\n/* ; */ let b", &rest);
+	ASSERT_EQ(statements.size(), 2u);
+	EXPECT_EQ(statements[0], "fun f() -> () { let a : i32 = 1; };");
+	EXPECT_EQ(statements[1], "let s = \";\";");
+	EXPECT_EQ(rest, " // ;\n/* ; */ let b");
+}
+
+TEST(testCase, onlyChangedDeclarationsAreReparsed) {
+	Repl               repl((CompileOptions()));
+	std::ostringstream out;
+	for (int i = 0; i < 300; i++) {
+		ASSERT_TRUE(repl.eval(function(i, i), out)) << out.str();
+	}
+	EXPECT_EQ(repl.definitionCount(), 300u);
+	EXPECT_EQ(repl.stats().parsed, 300u);
+	EXPECT_EQ(repl.stats().compiled, 300u);
+
+	// Pasting the session back in with one function changed touches only it.
+	std::string session;
+	for (int i = 0; i < 300; i++) {
+		session += function(i, i == 150 ? -1 : i) + "\n";
+	}
+	out.str(std::string());
+	ASSERT_TRUE(repl.eval(session, out));
+	EXPECT_EQ(repl.stats().parsed, 301u);
+	EXPECT_EQ(repl.stats().unchanged, 299u);
+	EXPECT_EQ(repl.stats().compiled, 301u);
+	EXPECT_NE(out.str().find("redefined f150"), std::string::npos) << out.str();
+	EXPECT_EQ(repl.definitionCount(), 300u);
+}
+
+TEST(testCase, failedDefinitionKeepsThePreviousOne) {
+	Repl               repl((CompileOptions()));
+	std::ostringstream out;
+	ASSERT_TRUE(repl.eval(function(0, 1), out));
+	EXPECT_FALSE(repl.eval("fun f0() -> () { let a : i32 = b; };", out));
+	EXPECT_NE(out.str().find("variable 'b' is not declared"), std::string::npos) << out.str();
+	EXPECT_FALSE(repl.eval("fun f0() -> () { let = ; };", out));
+	EXPECT_FALSE(repl.eval("let x : i32 = 1;", out));
+	EXPECT_EQ(repl.stats().compiled, 1u);
+
+	// The original text is still the current definition.
+	ASSERT_TRUE(repl.eval(function(0, 1), out));
+	EXPECT_EQ(repl.stats().unchanged, 1u);
+}
+
+TEST(testCase, callsNameEarlierDefinitions) {
+	Repl               repl((CompileOptions()));
+	std::ostringstream out;
+	EXPECT_FALSE(repl.eval("fun g() -> () { f0(); };", out));
+	EXPECT_NE(out.str().find("function 'f0' is not declared"), std::string::npos) << out.str();
+
+	ASSERT_TRUE(repl.eval(function(0, 1), out));
+	ASSERT_TRUE(repl.eval("fun g() -> () { f0(); g(); };", out)) << out.str();
+	// The caller keeps calling f0 by index, so redefining f0 needs nothing
+	// else recompiled.
+	ASSERT_TRUE(repl.eval(function(0, 2), out));
+	EXPECT_EQ(repl.stats().compiled, 3u);
+
+	std::string wasm = "/tmp/dp_repl_test_calls_" + std::to_string(::getpid()) + ".wasm";
+	EXPECT_TRUE(repl.eval(":emit " + wasm, out)) << out.str();
+	::unlink(wasm.c_str());
+}
+
+TEST(testCase, runReadsMultiLineInputAndCommands) {
+	std::string        wasm = "/tmp/dp_repl_test_" + std::to_string(::getpid()) + ".wasm";
+	std::istringstream in("fun main() -> () {\n    let a : i32 = 1;\n};\n:list\n:emit " + wasm + "\n:quit\nfun g");
+	std::ostringstream out;
+	Repl               repl((CompileOptions()));
+	repl.run(in, out);
+
+	EXPECT_EQ(repl.definitionCount(), 1u);
+	EXPECT_NE(out.str().find("... "), std::string::npos);
+	EXPECT_NE(out.str().find("defined main\n"), std::string::npos) << out.str();
+	EXPECT_NE(out.str().find("dp> main\n"), std::string::npos) << out.str();
+	struct stat st;
+	EXPECT_EQ(::stat(wasm.c_str(), &st), 0);
+	::unlink(wasm.c_str());
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+#include "driver/server.h"
+
+#include "gtest/gtest.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace dp;
+using namespace dp::internal;
+
+static std::string temporaryPath(const std::string& name) {
+	return "/tmp/dp_server_test_" + std::to_string(::getpid()) + "_" + name;
+}
+
+static void waitForSocket(const std::string& path) {
+	struct stat st;
+	for (int i = 0; i < 500 && ::stat(path.c_str(), &st) != 0; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+TEST(testCase, servesRequestsUntilShutdown) {
+	std::string socketPath = temporaryPath("sock");
+	std::string source     = temporaryPath("in.dp");
+	std::string output     = temporaryPath("out.wasm");
+	{
+		std::ofstream out(source);
+		out << "fun main() -> () {\n    let a : i32 = 1;\n    let b : i32 = a + 2;\n};\n";
+	}
+
+	std::ostringstream log;
+	CompileServer      server(socketPath, CompileOptions());
+	bool               served = false;
+	std::thread        thread([&]() { served = server.run(log); });
+	waitForSocket(socketPath);
+
+	for (int i = 0; i < 3; i++) {
+		std::ostringstream diagnostics;
+		EXPECT_EQ(requestCompile(socketPath, source, output, true, diagnostics), 0);
+		EXPECT_NE(diagnostics.str().find("dfa hit rate"), std::string::npos) << diagnostics.str();
+	}
+
+	std::ostringstream quiet;
+	EXPECT_EQ(requestCompile(socketPath, source, output, false, quiet), 0);
+
+	std::ostringstream diagnostics;
+	EXPECT_EQ(requestCompile(socketPath, temporaryPath("missing.dp"), output, false, diagnostics), 1);
+	EXPECT_NE(diagnostics.str().find("cannot read"), std::string::npos);
+
+	EXPECT_EQ(requestShutdown(socketPath), 0);
+	thread.join();
+
+	EXPECT_TRUE(served);
+	EXPECT_NE(log.str().find("request 5:"), std::string::npos) << log.str();
+	EXPECT_NE(log.str().find("served 5 requests"), std::string::npos) << log.str();
+	// Prediction is only profiled for requests with stats.
+	std::string line = log.str().substr(log.str().find("request 3:"));
+	EXPECT_NE(line.substr(0, line.find('\n')).find("dfa hit rate"), std::string::npos) << log.str();
+	line = log.str().substr(log.str().find("request 4:"));
+	EXPECT_EQ(line.substr(0, line.find('\n')).find("dfa hit rate"), std::string::npos) << log.str();
+
+	struct stat st;
+	EXPECT_EQ(::stat(output.c_str(), &st), 0);
+	::unlink(source.c_str());
+	::unlink(output.c_str());
+}
+
+TEST(testCase, clientReportsUnreachableServer) {
+	std::ostringstream diagnostics;
+	EXPECT_EQ(requestCompile(temporaryPath("nobody"), "in.dp", "out.wasm", false, diagnostics), -1);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,75 @@
+#include "utils/symbol_table.h"
+
+#include "gtest/gtest.h"
+
+using namespace dp;
+using namespace dp::internal;
+
+TEST(testCase, equalStringsInternToOneSymbol) {
+	std::string name = "count";
+	Symbol      a    = Symbol::intern(name);
+	Symbol      b    = Symbol::intern(std::string("cou") + "nt");
+	EXPECT_EQ(a, b);
+	EXPECT_EQ(a.id(), b.id());
+	EXPECT_EQ(b.str(), "count");
+	EXPECT_NE(a, Symbol::intern("counts"));
+	EXPECT_FALSE(a.empty());
+}
+
+TEST(testCase, innerBindingsShadowUntilTheirScopeExits) {
+	ScopedSymbolTable<int> table;
+	Symbol                 x = Symbol::intern("x");
+	Symbol                 y = Symbol::intern("y");
+
+	table.enterScope();
+	EXPECT_TRUE(table.insert(x, 1));
+	EXPECT_TRUE(table.insert(y, 2));
+	EXPECT_FALSE(table.insert(x, 3)); // already bound in this scope
+	EXPECT_EQ(*table.lookup(x), 1);
+
+	table.enterScope();
+	EXPECT_TRUE(table.insert(x, 10));
+	EXPECT_EQ(*table.lookup(x), 10);
+	EXPECT_EQ(*table.lookup(y), 2); // falls through to the outer scope
+	table.enterScope();
+	EXPECT_EQ(*table.lookup(x), 10);
+	EXPECT_TRUE(table.insert(x, 100));
+	EXPECT_EQ(*table.lookup(x), 100);
+	EXPECT_EQ(table.depth(), 3u);
+
+	table.exitScope();
+	EXPECT_EQ(*table.lookup(x), 10);
+	table.exitScope();
+	EXPECT_EQ(*table.lookup(x), 1);
+	EXPECT_EQ(*table.lookup(y), 2);
+
+	// Bindings can be updated through the pointer a lookup returns.
+	*table.lookup(y) = 20;
+	EXPECT_EQ(*table.lookup(y), 20);
+	table.exitScope();
+	EXPECT_EQ(table.lookup(x), nullptr);
+	EXPECT_EQ(table.depth(), 0u);
+}
+
+TEST(testCase, unknownNamesAreNotFound) {
+	ScopedSymbolTable<int> table;
+	Symbol                 unseen = Symbol::intern("neverBound");
+	EXPECT_EQ(table.lookup(unseen), nullptr);
+
+	table.enterScope();
+	EXPECT_TRUE(table.insert(Symbol::intern("bound"), 1));
+	EXPECT_EQ(table.lookup(unseen), nullptr);
+	const ScopedSymbolTable<int>& constTable = table;
+	EXPECT_EQ(constTable.lookup(unseen), nullptr);
+	// A name bound only in an inner scope is gone once it exits.
+	table.enterScope();
+	EXPECT_TRUE(table.insert(unseen, 2));
+	table.exitScope();
+	EXPECT_EQ(table.lookup(unseen), nullptr);
+	table.exitScope();
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
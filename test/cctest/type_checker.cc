@@ -0,0 +1,163 @@
+#include "parsing/parsing.h"
+#include "sema/type_checker.h"
+
+#include "gtest/gtest.h"
+#include <sstream>
+
+using namespace dp;
+using namespace dp::internal;
+
+// Parses `body` as the body of `fun main() -> ()` and type-checks it.
+static ModulePtr checkBody(const std::string& body, std::string* errors) {
+	antlr4::ANTLRInputStream input("fun main() -> () {\n" + body + "\n};");
+	Parser                   parser;
+	ModulePtr                module(parser.parseModule(input));
+	EXPECT_EQ(parser.stats().syntaxErrors, 0u) << body;
+
+	std::ostringstream out;
+	TypeChecker        checker(out);
+	checker.check(module.get());
+	*errors = out.str();
+	return module;
+}
+
+static Statement* statementOf(Module* module, size_t i) {
+	FunctionDeclaration* main = static_cast<FunctionDeclaration*>(module->stmts[0]);
+	return static_cast<BlockExpession*>(main->body->expr)->stmts[i];
+}
+
+static VariableDeclaration* variableOf(Module* module, size_t i) {
+	return static_cast<VariableDeclaration*>(statementOf(module, i));
+}
+
+TEST(testCase, literalsTakeTheDeclaredType) {
+	std::string errors;
+	ModulePtr   module = checkBody("let a : i64 = 1;\n"
+	                               "let b : f32 = 2;\n"
+	                               "let c : f64 = 0.5;\n"
+	                               "let d : i32 = 3;\n"
+	                               "let e : i64 = 4294967296;",
+	                               &errors);
+	ASSERT_EQ(errors, "");
+
+	const PrimitiveVariableTypes types[] = { PrimitiveVariableTypes::I64, PrimitiveVariableTypes::F32,
+		                                     PrimitiveVariableTypes::F64, PrimitiveVariableTypes::I32,
+		                                     PrimitiveVariableTypes::I64 };
+	for (size_t i = 0; i < 5; i++) {
+		VariableDeclaration* var = variableOf(module.get(), i);
+		EXPECT_EQ(static_cast<VariableType*>(var->vartype)->typ, types[i]);
+		EXPECT_EQ(var->init->type->typ, types[i]);
+	}
+	LiteralExpression* a = static_cast<LiteralExpression*>(variableOf(module.get(), 0)->init);
+	EXPECT_EQ(a->typ, LiteralExpression::Typ::DPI64);
+	EXPECT_EQ(a->i64val, 1);
+	LiteralExpression* b = static_cast<LiteralExpression*>(variableOf(module.get(), 1)->init);
+	EXPECT_EQ(b->typ, LiteralExpression::Typ::DPF32);
+	EXPECT_EQ(b->f32val, 2.0f);
+	LiteralExpression* e = static_cast<LiteralExpression*>(variableOf(module.get(), 4)->init);
+	EXPECT_EQ(e->i64val, 4294967296);
+}
+
+TEST(testCase, stringsAreNotNumbers) {
+	std::string errors;
+	ModulePtr   module = checkBody("let s : str = \"hello\";\n"
+	                               "let t : str = s;",
+	                               &errors);
+	ASSERT_EQ(errors, "");
+	VariableDeclaration* s = variableOf(module.get(), 0);
+	EXPECT_EQ(static_cast<VariableType*>(s->vartype)->typ, PrimitiveVariableTypes::Str);
+	EXPECT_EQ(s->init->type->typ, PrimitiveVariableTypes::Str);
+	EXPECT_EQ(static_cast<LiteralExpression*>(s->init)->typ, LiteralExpression::Typ::DPString);
+
+	// Their value is where the bytes are, which is no number to compute with.
+	checkBody("let t : i64 = \"world\";", &errors);
+	EXPECT_NE(errors.find("expected i64, found str"), std::string::npos) << errors;
+	checkBody("let s : str = \"a\";\nlet t : str = \"b\";\ns + t;", &errors);
+	EXPECT_NE(errors.find("operands must be numbers, found str"), std::string::npos) << errors;
+	checkBody("let s : str = \"a\";\ns * 1;", &errors);
+	EXPECT_NE(errors.find("expected str, found i32"), std::string::npos) << errors;
+	checkBody("let s : str = 1;", &errors);
+	EXPECT_NE(errors.find("expected str, found i32"), std::string::npos) << errors;
+}
+
+TEST(testCase, operandsAgreeOnOneType) {
+	std::string errors;
+	ModulePtr   module = checkBody("let a : i64 = 1;\n"
+	                               "let b : i64 = 2 * a + 3;\n"
+	                               "let x : f64 = 1.5;\n"
+	                               "1 + x;",
+	                               &errors);
+	ASSERT_EQ(errors, "");
+
+	BinaryExpression* sum = static_cast<BinaryExpression*>(variableOf(module.get(), 1)->init);
+	EXPECT_TRUE(sum->type->isI64());
+	EXPECT_TRUE(sum->left->type->isI64());
+	EXPECT_TRUE(static_cast<BinaryExpression*>(sum->left)->left->type->isI64());
+	EXPECT_TRUE(sum->right->type->isI64());
+
+	// An untyped literal on the left follows the variable on the right.
+	Expression* statement = static_cast<ExpressionStatement*>(statementOf(module.get(), 3))->expr;
+	EXPECT_TRUE(statement->type->isF64());
+	EXPECT_EQ(static_cast<LiteralExpression*>(static_cast<BinaryExpression*>(statement)->left)->typ,
+	          LiteralExpression::Typ::DPF64);
+}
+
+TEST(testCase, mismatchesAreReported) {
+	struct {
+		const char* body;
+		const char* error;
+	} cases[] = {
+		{ "let a : i64 = 1;\nlet b : i32 = a;", "line 3:14 expected i32, found i64" },
+		{ "let a : i32 = 1.5;", "expected i32, found f64" },
+		{ "let a : i32 = 4294967296;", "literal 4294967296 does not fit in i32" },
+		{ "let a : i32 = 1;\nlet b : f32 = 2;\na + b;", "expected i32, found f32" },
+		{ "let a : string = 1;", "unknown type 'string'" },
+		{ "let a : () = 1;", "variable 'a' cannot have type ()" },
+		{ "let a : i32 = b;", "variable 'b' is not declared" },
+		{ "let a : i32 = 1;\nlet a : i64 = 2;", "variable 'a' is already declared in this scope" },
+		{ "let a : i32 = \"s\";", "expected i32, found str" },
+		{ "g();", "function 'g' is not declared" },
+		{ "main(1);", "function 'main' takes no arguments" },
+	};
+	for (auto& c : cases) {
+		std::string errors;
+		checkBody(c.body, &errors);
+		EXPECT_NE(errors.find(c.error), std::string::npos) << c.body << "\n" << errors;
+	}
+}
+
+TEST(testCase, onlyFunctionsAtTheTopLevel) {
+	antlr4::ANTLRInputStream input("let a : i32 = 1;\nfun f() -> i32 {};");
+	Parser                   parser;
+	ModulePtr                module(parser.parseModule(input));
+	std::ostringstream       out;
+	TypeChecker              checker(out);
+	EXPECT_FALSE(checker.check(module.get()));
+	EXPECT_EQ(checker.errorCount(), 2u);
+	EXPECT_NE(out.str().find("variables must be declared inside a function"), std::string::npos);
+	EXPECT_NE(out.str().find("function 'f' cannot return i32"), std::string::npos);
+}
+
+TEST(testCase, callsNameDeclaredFunctions) {
+	antlr4::ANTLRInputStream input("fun f() -> () {\n    g();\n    f();\n    h();\n};\n"
+	                               "fun g() -> () {};\nfun g() -> () {};");
+	Parser                   parser;
+	ModulePtr                module(parser.parseModule(input));
+	std::ostringstream       out;
+	TypeChecker              checker(out);
+	TypeChecker::FunctionSet external = { Symbol::intern("h") };
+	checker.setExternalFunctions(&external);
+	EXPECT_FALSE(checker.check(module.get()));
+	EXPECT_EQ(checker.errorCount(), 1u) << out.str();
+	EXPECT_NE(out.str().find("function 'g' is already declared"), std::string::npos);
+
+	BlockExpession* body = static_cast<BlockExpession*>(static_cast<FunctionDeclaration*>(module->stmts[0])->body->expr);
+	Expression*     call = static_cast<ExpressionStatement*>(body->stmts[0])->expr;
+	ASSERT_EQ(call->kind(), ExpressionKind::Call);
+	EXPECT_TRUE(call->type->isUnit());
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}